@@ -1987,7 +1987,7 @@ void ecomment(z)
     char *oname;
     char *uname;
 
-    oname = z->oname;
+    oname = ZONAME(z);
 # ifdef UNICODE_SUPPORT
     uname = z->uname;
 # else
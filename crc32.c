@@ -676,8 +676,16 @@ void free_crc_table()
 #endif /* (IZ_CRC_BE_OPTIMIZ || IZ_CRC_LE_OPTIMIZ) */
 
 
+/* With runtime dispatch, crc32() (below) calls through crc32_kernel,
+   and this portable version is crc32_c(). */
+#ifdef DISPATCH_CRC32
+#  define CRC32_PORTABLE crc32_c
+#else
+#  define CRC32_PORTABLE crc32
+#endif
+
 /* ========================================================================= */
-ulg crc32(crc, buf, len)
+ulg CRC32_PORTABLE(crc, buf, len)
     ulg crc;                    /* crc shift register */
     register ZCONST uch *buf;   /* pointer to bytes to pump through */
     extent len;                 /* number of bytes in buf[] */
@@ -726,7 +734,173 @@ ulg crc32(crc, buf, len)
 
   return REV_BE(c) ^ 0xffffffffL;   /* (instead of ~c for 64-bit machines) */
 }
+
+
+#ifdef DISPATCH_CRC32
+
+#include <smmintrin.h>
+#include <wmmintrin.h>
+
+ulg (*crc32_kernel) OF((ulg crc, ZCONST uch *buf, extent len)) = crc32_c;
+
+/* ========================================================================= */
+ulg crc32(crc, buf, len)
+    ulg crc;                    /* crc shift register */
+    ZCONST uch *buf;            /* pointer to bytes to pump through */
+    extent len;                 /* number of bytes in buf[] */
+{
+  return (*crc32_kernel)(crc, buf, len);
+}
+
+
+/* ========================================================================= */
+/* CRC-32 by carry-less multiplication (PCLMULQDQ), folding 64 bytes per
+ * step.  This follows Intel's "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction" (Gopal et al., 2009), with
+ * the bit-reflected constants for the Zip polynomial given there.  Less
+ * than 64 bytes, and whatever is left past the last 16-byte block, goes
+ * to crc32_c().
+ */
+IZ_TARGET("sse4.1,pclmul")
+ulg crc32_pclmul(crc, buf, len)
+    ulg crc;                    /* crc shift register */
+    ZCONST uch *buf;            /* pointer to bytes to pump through */
+    extent len;                 /* number of bytes in buf[] */
+{
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+  extent n;
+
+  if (buf == NULL || len < 64)
+    return crc32_c(crc, buf, len);
+
+  n = len & ~(extent)15;
+
+  x1 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x00));
+  x2 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x10));
+  x3 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x20));
+  x4 = _mm_loadu_si128((ZCONST __m128i *)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)(crc ^ 0xffffffffL)));
+  x0 = _mm_set_epi32(1, (int)0xc6e41596, 1, 0x54442bd4);     /* k2:k1 */
+  buf += 64;
+  len -= 64;
+  n -= 64;
+
+  /* Fold four 128-bit lanes in parallel. */
+  while (n >= 64)
+  {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((ZCONST __m128i *)(buf + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                       _mm_loadu_si128((ZCONST __m128i *)(buf + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                       _mm_loadu_si128((ZCONST __m128i *)(buf + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                       _mm_loadu_si128((ZCONST __m128i *)(buf + 0x30)));
+    buf += 64;
+    len -= 64;
+    n -= 64;
+  }
+
+  /* Fold the four lanes into one. */
+  x0 = _mm_set_epi32(0, (int)0xccaa009e, 1, 0x751997d0);     /* k4:k3 */
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Any remaining whole 16-byte blocks. */
+  while (n >= 16)
+  {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((ZCONST __m128i *)buf));
+    buf += 16;
+    len -= 16;
+    n -= 16;
+  }
+
+  /* Fold 128 bits to 64, then Barrett-reduce to 32. */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x0 = _mm_set_epi32(0, 0, 1, 0x63cd6124);                   /* 0:k5 */
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_set_epi32(1, (int)0xf7011641, 1, (int)0xdb710641); /* u:P */
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  crc = ((ulg)_mm_extract_epi32(x1, 1) & 0xffffffffL) ^ 0xffffffffL;
+  return len ? crc32_c(crc, buf, len) : crc;
+}
+#endif /* DISPATCH_CRC32 */
 #endif /* !ASM_CRC */
+
+
+/* ========================================================================= */
+/* Multiply a by b modulo the CRC-32 polynomial, both bit-reflected (the
+ * top bit is x^0).
+ */
+local ulg crc32_multmodp(a, b)
+    ulg a;
+    ulg b;
+{
+  ulg m = (ulg)1 << 31;
+  ulg p = 0;
+
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+        break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ 0xedb88320L : b >> 1;
+  }
+  return p;
+}
+
+/* ========================================================================= */
+/* Return crc32(crc, buf, len) for a buf of len zero bytes, without the
+ * buffer, in time log(len).  A zero byte multiplies the CRC register by
+ * x^8, so len of them multiply it by x^(8*len), found by squaring.
+ */
+ulg crc32_zeros(crc, len)
+    ulg crc;                    /* crc shift register */
+    uzoff_t len;                /* number of zero bytes */
+{
+  ulg p = (ulg)1 << 31;         /* x^0 */
+  ulg sq = (ulg)1 << 23;        /* x^8 */
+
+  while (len) {
+    if (len & 1)
+      p = crc32_multmodp(sq, p);
+    len >>= 1;
+    if (len)
+      sq = crc32_multmodp(sq, sq);
+  }
+  return crc32_multmodp(p, (crc ^ 0xffffffffL) & 0xffffffffL) ^ 0xffffffffL;
+}
 #endif /* !CRC_TABLE_ONLY */
 #endif /* !USE_ZLIB */
 #endif /* !USE_ZLIB || USE_OWN_CRCTAB */
@@ -199,6 +199,14 @@ unsigned int near prev_length;
 local int           eofile;        /* flag set at end of input file */
 local unsigned      lookahead;     /* number of valid bytes ahead in window */
 
+#ifdef IZ_SPARSE
+local unsigned zero_start, zero_end;
+/* window[zero_start..zero_end-1] came from a hole in the input file
+ * (read_buf_zeros), so it is all zeros.  Runs of it are emitted as
+ * MAX_MATCH matches at distance 1 without searching or hashing them.
+ */
+#endif
+
 unsigned near max_chain_length;
 /* To speed up deflation, hash chains are never searched beyond this length.
  * A higher limit improves compression ratio but degrades the speed.
@@ -265,10 +273,24 @@ local config configuration_table[10] = {
  */
 
 local void fill_window   OF((void));
+#ifdef IZ_SPARSE
+local void note_zeros    OF((unsigned start, unsigned n));
+#endif
 
 local uzoff_t deflate_fast OF((void));    /* now use uzoff_t 7/24/04 EG */
 
+#ifdef DISPATCH_LONGEST_MATCH
+   /* The C version is longest_match_c(); deflate calls through
+    * longest_match_kernel, which cpu_dispatch_init() may point at
+    * longest_match_sse2() instead.
+    */
+#  define LONGEST_MATCH_C longest_match_c
+#  define LONGEST_MATCH(cur_match) (*longest_match_kernel)(cur_match)
+#else
+#  define LONGEST_MATCH_C longest_match
+#  define LONGEST_MATCH(cur_match) longest_match(cur_match)
       int  longest_match OF((IPos cur_match));
+#endif
 #if defined(ASMV) && !defined(RISCOS)
       void match_init OF((void)); /* asm code initialization */
 #endif
@@ -371,6 +393,10 @@ void lm_init (pack_level, flags)
     j = WSIZE;
 #ifndef MAXSEG_64K
     if (sizeof(int) > 2) j <<= 1; /* Can read 64K in one step */
+#endif
+#ifdef IZ_SPARSE
+    zero_start = zero_end = 0;
+    read_buf_zeros = 0;
 #endif
     lookahead = (*read_buf)((char*)window, j);
 
@@ -379,6 +405,9 @@ void lm_init (pack_level, flags)
        return;
     }
     eofile = 0;
+#ifdef IZ_SPARSE
+    note_zeros(0, lookahead);
+#endif
     /* Make sure that we always have enough lookahead. This is important
      * if input comes from a device such as a tty.
      */
@@ -422,7 +451,7 @@ void lm_free()
  * match.S. The code is functionally equivalent, so you can use the C version
  * if desired.
  */
-int longest_match(cur_match)
+int LONGEST_MATCH_C(cur_match)
     IPos cur_match;                             /* current match */
 {
     unsigned chain_length = max_chain_length;   /* max hash chain length */
@@ -551,6 +580,73 @@ int longest_match(cur_match)
 }
 #endif /* ASMV */
 
+#ifdef DISPATCH_LONGEST_MATCH
+#include <emmintrin.h>
+
+int (*longest_match_kernel) OF((IPos cur_match)) = longest_match_c;
+
+/* ===========================================================================
+ * Same as longest_match_c(), but once the first two bytes (and the bytes
+ * at best_len-1 and best_len) agree, compare 16 bytes at a time with
+ * SSE2.  Starting at scan+2, 16 compares of 16 bytes reach exactly
+ * MAX_MATCH (2 + 16*16 = 258), so nothing past strstart+257 is read,
+ * which is inside the MIN_LOOKAHEAD guaranteed by fill_window().
+ */
+IZ_TARGET("sse2")
+int longest_match_sse2(cur_match)
+    IPos cur_match;                             /* current match */
+{
+    unsigned chain_length = max_chain_length;   /* max hash chain length */
+    register uch far *scan = window + strstart; /* current string */
+    register uch far *match;                    /* matched string */
+    register int len;                           /* length of current match */
+    int best_len = prev_length;                 /* best match length so far */
+    IPos limit = strstart > (IPos)MAX_DIST ? strstart - (IPos)MAX_DIST : NIL;
+    register uch scan_end1  = scan[best_len-1];
+    register uch scan_end   = scan[best_len];
+    unsigned diff;                              /* mask of differing bytes */
+
+    if (prev_length >= good_match) {
+        chain_length >>= 2;
+    }
+
+    Assert(strstart <= window_size-MIN_LOOKAHEAD, "insufficient lookahead");
+
+    do {
+        Assert(cur_match < strstart, "no future");
+        match = window + cur_match;
+
+        if (match[best_len]   != scan_end  ||
+            match[best_len-1] != scan_end1 ||
+            match[0]          != scan[0]   ||
+            match[1]          != scan[1])      continue;
+
+        len = 2;
+        do {
+            diff = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                     _mm_loadu_si128((__m128i *)(scan + len)),
+                     _mm_loadu_si128((__m128i *)(match + len)))) ^ 0xffff;
+            if (diff != 0) {
+                len += __builtin_ctz(diff);
+                break;
+            }
+            len += 16;
+        } while (len < MAX_MATCH);
+
+        if (len > best_len) {
+            match_start = cur_match;
+            best_len = len;
+            if (len >= nice_match) break;
+            scan_end1  = scan[best_len-1];
+            scan_end   = scan[best_len];
+        }
+    } while ((cur_match = prev[cur_match & WMASK]) > limit
+             && --chain_length != 0);
+
+    return best_len;
+}
+#endif /* DISPATCH_LONGEST_MATCH */
+
 #ifdef DEBUG
 /* ===========================================================================
  * Check that the match at match_start is indeed a match.
@@ -634,6 +730,10 @@ local void fill_window()
             strstart    -= WSIZE; /* we now have strstart >= MAX_DIST: */
 
             block_start -= (long) WSIZE;
+#ifdef IZ_SPARSE
+            zero_start = zero_start >= WSIZE ? zero_start - WSIZE : 0;
+            zero_end = zero_end >= WSIZE ? zero_end - WSIZE : 0;
+#endif
 
             for (n = 0; n < HASH_SIZE; n++) {
                 m = head[n];
@@ -669,15 +769,53 @@ local void fill_window()
          */
         Assert(more >= 2, "more < 2");
 
+#ifdef IZ_SPARSE
+        read_buf_zeros = 0;
+#endif
         n = (*read_buf)((char*)window+strstart+lookahead, more);
         if (n == 0 || n == (unsigned)EOF) {
             eofile = 1;
         } else {
+#ifdef IZ_SPARSE
+            note_zeros(strstart+lookahead, n);
+#endif
             lookahead += n;
         }
     } while (lookahead < MIN_LOOKAHEAD && !eofile);
 }
 
+#ifdef IZ_SPARSE
+/* ===========================================================================
+ * Note that window[start..start+n-1] was just read.  If read_buf() says
+ * it was a hole, it extends the zero run ending at start or starts a new
+ * one.
+ */
+local void note_zeros(start, n)
+    unsigned start;             /* window index of the bytes read */
+    unsigned n;                 /* number of bytes read */
+{
+    if (!read_buf_zeros) return;
+    if (zero_end != start || zero_start == zero_end) zero_start = start;
+    zero_end = start + n;
+}
+
+/* A MAX_MATCH match at distance 1 at strstart, all within the zero run */
+#  define ZERO_RUN() (strstart > zero_start && strstart + MAX_MATCH <= zero_end)
+
+/* ===========================================================================
+ * Emit a MAX_MATCH match of zeros at distance 1 at strstart, skipping the
+ * hash insertions as deflate_fast() does after a long match.
+ */
+#  define ZERO_MATCH(flush) { \
+     check_match(strstart, strstart-1, MAX_MATCH); \
+     flush = ct_tally(1, MAX_MATCH - MIN_MATCH); \
+     strstart += MAX_MATCH; \
+     lookahead -= MAX_MATCH; \
+     ins_h = window[strstart]; \
+     UPDATE_HASH(ins_h, window[strstart+1]); \
+   }
+#endif /* IZ_SPARSE */
+
 /* ===========================================================================
  * Processes a new input file and return its compressed length. This
  * function does not perform lazy evaluation of matches and inserts
@@ -692,6 +830,14 @@ local uzoff_t deflate_fast()
 
     prev_length = MIN_MATCH-1;
     while (lookahead != 0) {
+#ifdef IZ_SPARSE
+        if (ZERO_RUN()) {
+            ZERO_MATCH(flush);
+            if (flush) FLUSH_BLOCK(0), block_start = strstart;
+            if (lookahead < MIN_LOOKAHEAD) fill_window();
+            continue;
+        }
+#endif
         /* Insert the string window[strstart .. strstart+2] in the
          * dictionary, and set hash_head to the head of the hash chain:
          */
@@ -715,7 +861,7 @@ local uzoff_t deflate_fast()
              */
             if ((unsigned)nice_match > lookahead) nice_match = (int)lookahead;
 #  endif
-            match_length = longest_match (hash_head);
+            match_length = LONGEST_MATCH(hash_head);
             /* longest_match() sets match_start */
             if (match_length > lookahead) match_length = lookahead;
 #endif
@@ -798,6 +944,17 @@ uzoff_t deflate()
 
     /* Process the input block. */
     while (lookahead != 0) {
+#ifdef IZ_SPARSE
+        /* With no match or literal pending (so match_length is
+         * MIN_MATCH-1), a run of zeros needs no lazy evaluation.
+         */
+        if (!match_available && ZERO_RUN()) {
+            ZERO_MATCH(flush);
+            if (flush) FLUSH_BLOCK(0), block_start = strstart;
+            if (lookahead < MIN_LOOKAHEAD) fill_window();
+            continue;
+        }
+#endif
         /* Insert the string window[strstart .. strstart+2] in the
          * dictionary, and set hash_head to the head of the hash chain:
          */
@@ -824,7 +981,7 @@ uzoff_t deflate()
              */
             if ((unsigned)nice_match > lookahead) nice_match = (int)lookahead;
 #  endif
-            match_length = longest_match (hash_head);
+            match_length = LONGEST_MATCH(hash_head);
             /* longest_match() sets match_start */
             if (match_length > lookahead) match_length = lookahead;
 #endif
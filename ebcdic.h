@@ -49,7 +49,7 @@
 #  define ZCONST const
 # endif
 
-# ifdef EBCDIC
+# ifdef IZ_EBCDIC_TABLES
 #  ifndef MTS           /* MTS uses a slightly "special" EBCDIC code page */
 
 ZCONST uch ebcdic[] = {
@@ -220,7 +220,7 @@ ZCONST uch ascii[] = {
 #   endif /* defined(ZIP) || defined(IZ_CRYPT_ANY) */
 
 #  endif /* ?MTS */
-# endif /* EBCDIC */
+# endif /* IZ_EBCDIC_TABLES */
 
 /*---------------------------------------------------------------------------
 
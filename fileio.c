@@ -36,6 +36,17 @@
 # include <sys/time.h>
 #endif /* def HAVE_SYS_TIME_H */
 
+#ifdef IZ_COPY_RANGE
+# include <unistd.h>
+# include <sys/ioctl.h>
+# include <linux/fs.h>          /* FICLONERANGE */
+#endif /* def IZ_COPY_RANGE */
+
+#ifdef IZ_PREALLOC
+# include <unistd.h>
+# include <fcntl.h>             /* fallocate() */
+#endif /* def IZ_PREALLOC */
+
 #ifdef NO_MKTIME
 time_t mktime OF((struct tm *));
 #endif
@@ -113,6 +124,10 @@ int rename OF((ZCONST char *, ZCONST char *));
 local int optionerr OF((char *, ZCONST char *, int, int));
 local unsigned long get_shortopt OF((char **, int, int *, int *, char **, int *, int));
 local unsigned long get_longopt OF((char **, int, int *, int *, char **, int *, int));
+local int name_in_arena OF((ZCONST zvoid *));
+#ifdef IZ_PREALLOC
+local void prealloc_more OF((uzoff_t));
+#endif
 
 /* aSc added, lcc warning  Missing prototype for display_dot_char */
 local void display_dot_char(int chr);
@@ -213,6 +228,11 @@ local int fqcmpz OF((ZCONST zvoid *, ZCONST zvoid *));
 local int fqcmp_icfirst OF((ZCONST zvoid *, ZCONST zvoid *));
 /* new iname sort */
 local int fqcmpz_icfirst OF((ZCONST zvoid *, ZCONST zvoid *));
+/* names to sort by */
+local char *fname_key OF((ZCONST zvoid *));
+local char *finame_key OF((ZCONST zvoid *));
+/* -sz duplicate check */
+local int found_dup OF((struct flist far *));
 
 
 /* Local module level variables. */
@@ -370,16 +390,16 @@ struct flist far *f;    /* entry to delete */
   if (t != NULL)
     t->lst = f->lst;                    /* and next to last */
   if (f->name != NULL)                  /* free memory used */
-    free((zvoid *)(f->name));
+    name_free((zvoid *)(f->name));
   if (f->zname != NULL)
-    free((zvoid *)(f->zname));
+    name_free((zvoid *)(f->zname));
   if (f->iname != NULL)
-    free((zvoid *)(f->iname));
+    name_free((zvoid *)(f->iname));
   if (f->oname != NULL)
-    free((zvoid *)(f->oname));
+    name_free((zvoid *)(f->oname));
 #ifdef UNICODE_SUPPORT
   if (f->uname)
-    free((zvoid *)f->uname);
+    name_free((zvoid *)f->uname);
 # ifdef WIN32
   if (f->namew)
     free((zvoid *)f->namew);
@@ -398,7 +418,7 @@ struct flist far *f;    /* entry to delete */
 /* ---------------------------------------------- */
 /* sort functions */
 
-/* Used by qsort() */
+/* Used by qsort() and name_sort() */
 
 #if 0
 /* fqcmp() was old name sort function, now replaced by fqcmp_icfirst(). */
@@ -476,6 +496,20 @@ local int fqcmpz_icfirst(a, b)
                 (*(struct flist far **)b)->iname);
 }
 
+/* Names to key the found list by in name_sort(). */
+
+local char *fname_key(f)
+  ZCONST zvoid *f;              /* pointer to found entry */
+{
+  return ((struct flist far *)f)->name;
+}
+
+local char *finame_key(f)
+  ZCONST zvoid *f;              /* pointer to found entry */
+{
+  return ((struct flist far *)f)->iname;
+}
+
 /* ---------------------------------------------- */
 
 
@@ -689,7 +723,7 @@ int proc_archive_name(n, caseflag)
         free(uzname);
         if (verbose)
             zfprintf(mesg, "zip diagnostic: %scluding %s\n",
-               z->mark ? "in" : "ex", z->oname);
+               z->mark ? "in" : "ex", ZONAME(z));
         m = 0;
       }
       free(pw);
@@ -699,7 +733,7 @@ int proc_archive_name(n, caseflag)
         z->mark = pcount ? filter(z->zname, caseflag) : 1;
         if (verbose)
             zfprintf(mesg, "zip diagnostic: %scluding %s\n",
-               z->mark ? "in" : "ex", z->oname);
+               z->mark ? "in" : "ex", ZONAME(z));
         m = 0;
       }
 #endif
@@ -725,9 +759,9 @@ int proc_archive_name(n, caseflag)
           z->mark = pcount ? filter(zuname, caseflag) : 1;
           if (verbose) {
               zfprintf(mesg, "zip diagnostic: %scluding %s\n",
-                 z->mark ? "in" : "ex", z->oname);
+                 z->mark ? "in" : "ex", ZONAME(z));
               zfprintf(mesg, "     Escaped Unicode:  %s\n",
-                 z->ouname);
+                 ZOUNAME(z));
           }
           m = 0;
         }
@@ -771,7 +805,7 @@ int check_dup_sort(sort_found_list)
     for (j = 0, f = found; f != NULL; f = f->nxt)
       s[j++] = f;
     /* Check names as given (f->name) */
-    qsort((char *)s, fcount, sizeof(struct flist far *), fqcmp_icfirst);
+    name_sort((zvoid **)s, fcount, fname_key, NSORT_LOWER, fqcmp_icfirst);
     for (k = j = fcount - 1; j > 0; j--)
       if (strcmp(s[j - 1]->name, s[j]->name) == 0)
         /* remove duplicate entry from list */
@@ -858,7 +892,8 @@ int check_dup_sort(sort_found_list)
 
     /* use fqcmpz_icfirst, which sorts first ignoring case, then using case,
        which tends to sort in same order as Unix shell */
-    qsort((char *)nodup, fcount, sizeof(struct flist far *), fqcmpz_icfirst);
+    name_sort((zvoid **)nodup, fcount, finame_key, NSORT_LOWER,
+              fqcmpz_icfirst);
 
 #if 0
     /* for ports where we don't know if fqcmpz_icfirst() is supported */
@@ -985,6 +1020,109 @@ int check_dup_sort(sort_found_list)
   return ZE_OK;
 }
 
+
+/* Duplicate check for -sz
+ *
+ * check_dup_sort() needs the whole found list, which with -sz is never
+ * there, as files are zipped up in batches while the scan goes on.
+ * Instead newname() offers each new file to found_dup(), which keeps
+ * the internal name and file name of every file found so far in fdup,
+ * an open-addressed table hashed on the internal name.  The table holds
+ * the arena copies (name_alloc(), name_dup()) that go on to zfiles,
+ * which stay put even after name_free(), so it costs two pointers per
+ * file and no names.  The rules are those of check_dup_sort(): the same
+ * file found again is dropped, and two files with the same internal
+ * name are an error.
+ */
+struct fdup_slot {
+  char *iname;                  /* internal name, NULL if slot free */
+  char *name;                   /* file system name */
+};
+
+local struct fdup_slot *fdup = NULL;
+local extent fdup_mask;         /* table size - 1 (power of 2) */
+local extent fdup_count;        /* slots used */
+
+local int found_dup(f)
+  struct flist far *f;          /* file just found */
+/* Return 1 if f was found before and should be dropped, else add it to
+   fdup and return 0.  Does not return if the internal name of f is
+   already taken by another file. */
+{
+  struct fdup_slot *t;
+  char *iname;
+  char *name;
+  extent size;
+  extent i, j;
+
+  if (fdup == NULL || 2 * (fdup_count + 1) > fdup_mask + 1) {
+    /* start or double the table, then rehash */
+    size = fdup == NULL ? 1024 : 2 * (fdup_mask + 1);
+    if (size > ((extent)-1) / (2 * sizeof(struct fdup_slot)) ||
+        (t = (struct fdup_slot *)calloc(size, sizeof(struct fdup_slot)))
+        == NULL)
+      ZIPERR(ZE_MEM, "was checking for duplicate names");
+    if (fdup != NULL) {
+      for (j = 0; j <= fdup_mask; j++) {
+        if (fdup[j].iname == NULL)
+          continue;
+        for (i = (extent)zname_hash(fdup[j].iname) & (size - 1);
+             t[i].iname != NULL; i = (i + 1) & (size - 1))
+          ;
+        t[i] = fdup[j];
+      }
+      free((zvoid *)fdup);
+    }
+    fdup = t;
+    fdup_mask = size - 1;
+  }
+
+  for (i = (extent)zname_hash(f->iname) & fdup_mask; fdup[i].iname != NULL;
+       i = (i + 1) & fdup_mask) {
+    if (strcmp(fdup[i].iname, f->iname) != 0)
+      continue;
+    if (strcmp(fdup[i].name, f->name) == 0)
+      return 1;
+    sprintf(errbuf, "first full name:  %s\n", fdup[i].name);
+    sprintf(errbuf + strlen(errbuf), "second full name: %s\n", f->name);
+#ifdef EBCDIC
+    strtoebc(f->iname, f->iname);
+#endif
+    sprintf(errbuf + strlen(errbuf), "name in zip file repeated: %s",
+            f->iname);
+    if (pathput == 0) {
+      strcat(errbuf, "\nthis may be a result of using -j");
+    }
+#ifdef EBCDIC
+    strtoasc(f->iname, f->iname);
+#endif
+    zipwarn(errbuf, "");
+    ZIPERR(ZE_PARMS, "cannot repeat names in zip file");
+  }
+
+  /* names not from the arena (newnamew()) may be freed with the entry */
+  iname = f->iname;
+  if (!name_in_arena(iname))
+    iname = name_dup(iname, "found_dup", NO_FLUFF);
+  name = f->name;
+  if (!name_in_arena(name))
+    name = name_dup(name, "found_dup", NO_FLUFF);
+  fdup[i].iname = iname;
+  fdup[i].name = name;
+  fdup_count++;
+  return 0;
+}
+
+void found_dup_free()
+/* Free the -sz duplicate table. */
+{
+  if (fdup != NULL) {
+    free((zvoid *)fdup);
+    fdup = NULL;
+  }
+  fdup_count = 0;
+}
+
 int filter(name, casesensitive)
   char *name;
   int casesensitive;
@@ -1127,8 +1265,9 @@ int newnamew(namew, zflags, casesensitive)
    *
    * After 5 seconds output Scanning files...
    * then a dot every 2 seconds
+   * (not with -sz, where the adding: lines show the progress)
    */
-  if (noisy) {
+  if (noisy && stream_add != 2) {
     /* If find files then output message after delay */
     if (scan_count == 0) {
       time_t current = time(NULL);
@@ -1253,13 +1392,13 @@ int newnamew(namew, zflags, casesensitive)
         return ZE_MEM;
       }
       strcpy(z->name, name);
-      if (z->oname) free(z->oname);
+      if (z->oname) name_free(z->oname);
       z->oname = oname;
       oname = NULL;
       z->dosflag = dosflag;
 
 #ifdef FORCE_NEWNAME
-      free((zvoid *)(z->iname));
+      name_free((zvoid *)(z->iname));
       z->iname = iname;
       iname = NULL;
 #else
@@ -1408,6 +1547,15 @@ int newnamew(namew, zflags, casesensitive)
     if (name == label) {
       label = f->name;
     }
+    if (stream_add == 2) {
+      /* -sz: drop a repeat, else zip up the found list once a batch */
+      if (found_dup(f)) {
+        fnxt = f->lst;
+        fexpel(f);
+      } else if (fcount >= FOUND_BATCH) {
+        zipup_found();
+      }
+    }
   }
   if (undosm) free(undosm);
   if (inamew) free(inamew);
@@ -1526,8 +1674,9 @@ int newname(name, zflags, casesensitive)
    *
    * After 5 seconds output Scanning files...
    * then a dot every 2 seconds
+   * (not with -sz, where the adding: lines show the progress)
    */
-  if (noisy) {
+  if (noisy && stream_add != 2) {
     /* If find files then output message after delay */
     if (scan_count == 0) {
       time_t current = time(NULL);
@@ -1650,12 +1799,12 @@ int newname(name, zflags, casesensitive)
         return ZE_MEM;
       }
       strcpy(z->name, name_flsys);
-      if (z->oname) free(z->oname);
+      if (z->oname) name_free(z->oname);
       z->oname = oname;
       z->dosflag = dosflag;
 
 #ifdef FORCE_NEWNAME
-      free((zvoid *)(z->iname));
+      name_free((zvoid *)(z->iname));
       z->iname = iname;
 #else
       /* Better keep the old name. Useful when updating on MSDOS a zip file
@@ -1745,7 +1894,7 @@ int newname(name, zflags, casesensitive)
 
     if ((f = (struct flist far *)farmalloc(sizeof(struct flist))) == NULL ||
         fcount + 1 < fcount ||
-        (f->name = malloc(strlen(name) + 1 + pad_name)) == NULL)
+        (f->name = name_alloc(strlen(name) + 1 + pad_name)) == NULL)
     {
       if (f != NULL)
         farfree((zvoid far *)f);
@@ -1757,8 +1906,14 @@ int newname(name, zflags, casesensitive)
       return ZE_MEM;
     }
     strcpy(f->name, name_flsys);
-    f->iname = iname;
-    f->zname = zname;
+    /* One copy in the name arena for iname and whichever of zname,
+       oname and uname are the same (name_share()).  undosm is done
+       with here, as zname may go. */
+    f->iname = name_dup(iname, "newname", NO_FLUFF);
+    free((zvoid *)iname);
+    if (undosm != zname)
+      free((zvoid *)undosm);
+    undosm = zname = f->zname = name_share(zname, f->iname);
 
 #ifdef UNIX_APPLE
     /* Free the special AppleDouble name storage. */
@@ -1772,7 +1927,7 @@ int newname(name, zflags, casesensitive)
 #ifdef UNICODE_SUPPORT
     /* Unicode */
     /* WIN32 should be using newnamew() */
-    f->uname = local_to_utf8_string(iname);
+    f->uname = name_share(local_to_utf8_string(f->iname), f->iname);
 #ifdef UNICODE_SUPPORT_WIN32
     f->namew = NULL;
     f->inamew = NULL;
@@ -1783,7 +1938,7 @@ int newname(name, zflags, casesensitive)
 #endif /* def UNICODE_SUPPORT_WIN32 */
 #endif /* def UNICODE_SUPPORT */
 
-    f->oname = oname;
+    f->oname = name_share(oname, f->iname);
     f->dosflag = dosflag;
 
     f->zflags = zflags;
@@ -1797,6 +1952,15 @@ int newname(name, zflags, casesensitive)
     if (name == label) {
       label = f->name;
     }
+    if (stream_add == 2) {
+      /* -sz: drop a repeat, else zip up the found list once a batch */
+      if (found_dup(f)) {
+        fnxt = f->lst;
+        fexpel(f);
+      } else if (fcount >= FOUND_BATCH) {
+        zipup_found();
+      }
+    }
   }
   if (undosm != zname)
     free((zvoid *)undosm);
@@ -2437,6 +2601,167 @@ FILE *fopen_utf8(char *filename, char *mode)
 #endif /* def UNICODE_SUPPORT_WIN32 */
 
 
+#ifdef IZ_COPY_RANGE
+
+/* Entries smaller than this are copied through the buffers as before.
+   The kernel copy needs y flushed first, which for small entries would
+   cost more write() calls than it saves. */
+#ifndef COPY_RANGE_MIN
+#  define COPY_RANGE_MIN 0x10000L
+#endif
+
+/* Copy len bytes with copy_file_range(), advancing *in_off and *out_off.
+   Returns the number of bytes copied, which is less than len only if the
+   kernel stopped (error, or copying is not supported between these two
+   files). */
+local uzoff_t copy_range_cfr(in_fd, in_off, out_fd, out_off, len)
+  int in_fd;
+  loff_t *in_off;
+  int out_fd;
+  loff_t *out_off;
+  uzoff_t len;
+{
+  uzoff_t done = 0;
+  ssize_t r;
+  size_t chunk;
+
+  while (done < len) {
+    chunk = (len - done > 0x40000000L) ? 0x40000000L : (size_t)(len - done);
+    r = copy_file_range(in_fd, in_off, out_fd, out_off, chunk, 0);
+    if (r <= 0)
+      break;
+    done += (uzoff_t)r;
+  }
+  return done;
+}
+
+/* copy_range_fd() - copy n bytes at offset in_start of in_fd to y in
+ * the kernel.
+ *
+ * Both files must be regular files.  If the input and output offsets
+ * are at the same place within a file system block (as for every entry
+ * before the first changed one when an archive is updated), the whole
+ * blocks are cloned with FICLONERANGE, which on btrfs and XFS shares the
+ * data instead of copying it.  Everything else goes through
+ * copy_file_range(), which copies inside the kernel (or on the server,
+ * for NFS 4.2 and SMB).  y is left positioned after the bytes copied,
+ * and the count is returned; the caller writes whatever is left (all of
+ * it, if this returns 0) the usual way.
+ */
+local uzoff_t copy_range_fd(in_fd, in_start, n)
+  int in_fd;
+  zoff_t in_start;
+  uzoff_t n;
+{
+  int out_fd;
+  struct stat in_st, out_st;
+  zoff_t out_start;
+  loff_t in_off, out_off;
+  uzoff_t done = 0;
+#ifdef FICLONERANGE
+  struct file_clone_range fcr;
+  uzoff_t head, whole;
+  zoff_t bs;
+#endif
+
+  if (n < COPY_RANGE_MIN)
+    return 0;
+  out_fd = fileno(y);
+  if (fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0 ||
+      !S_ISREG(in_st.st_mode) || !S_ISREG(out_st.st_mode))
+    return 0;
+  if (in_start < 0 || (uzoff_t)in_start + n > (uzoff_t)in_st.st_size)
+    return 0;                   /* entry continues on the next split */
+  if (fflush(y) != 0 || (out_start = zftello(y)) < 0)
+    return 0;
+  in_off = (loff_t)in_start;
+  out_off = (loff_t)out_start;
+#ifdef IZ_PREALLOC
+  /* these bytes skip bfwrite(), so reserve space for them here */
+  prealloc_more(n);
+#endif
+
+#ifdef FICLONERANGE
+  bs = (zoff_t)in_st.st_blksize;
+  if (in_st.st_dev == out_st.st_dev && bs > 0 &&
+      in_start % bs == out_start % bs)
+  {
+    head = (uzoff_t)((bs - in_start % bs) % bs);
+    whole = head < n ? (n - head) / bs * bs : 0;
+    if (whole > 0 &&
+        copy_range_cfr(in_fd, &in_off, out_fd, &out_off, head) == head)
+    {
+      done = head;
+      fcr.src_fd = in_fd;
+      fcr.src_offset = (__u64)in_off;
+      fcr.src_length = (__u64)whole;
+      fcr.dest_offset = (__u64)out_off;
+      if (ioctl(out_fd, FICLONERANGE, &fcr) == 0) {
+        in_off += whole;
+        out_off += whole;
+        done += whole;
+      }
+    }
+  }
+#endif /* def FICLONERANGE */
+
+  done += copy_range_cfr(in_fd, &in_off, out_fd, &out_off, n - done);
+
+  /* copy_file_range() with offsets does not move the descriptor, so
+     put y where stdio would have left it. */
+  if (zfseeko(y, out_start + (zoff_t)done, SEEK_SET) != 0) {
+    ZIPERR(ZE_WRITE, "seek failed after kernel copy");
+  }
+  return done;
+}
+
+/* copy_range() - copy n bytes of entry data from in_file to y in the
+ * kernel.
+ *
+ * Used by bfcopy() for an entry copied whole, from a regular file to a
+ * regular file, when the output is not being split.  Both streams are
+ * left positioned after the bytes copied, and the count is returned.
+ */
+local uzoff_t copy_range(n)
+  uzoff_t n;
+{
+  zoff_t in_start;
+  uzoff_t done;
+
+  /* The stdio read buffer is ahead of the entry, so work from the
+     logical position, not the descriptor's offset. */
+  if (n < COPY_RANGE_MIN || (in_start = zftello(in_file)) < 0)
+    return 0;
+  done = copy_range_fd(fileno(in_file), in_start, n);
+  if (done > 0 && zfseeko(in_file, in_start + (zoff_t)done, SEEK_SET) != 0) {
+    ZIPERR(ZE_WRITE, "seek failed after kernel copy");
+  }
+  return done;
+}
+
+/* zfcopy_fd() - write n bytes at offset off of input file fd as entry
+ * data, as zfwrite() would for an unencrypted entry, but in the kernel.
+ *
+ * Used by zipup() to store mapped files (the crc having been computed
+ * from the mapping).  Does nothing (returns 0) when the output is split
+ * or encrypted, or is not a regular file.  Returns the bytes copied.
+ */
+uzoff_t zfcopy_fd(fd, off, n)
+  int fd;
+  zoff_t off;
+  uzoff_t n;
+{
+  uzoff_t done;
+
+  if (split_size != 0 || key != NULL)
+    return 0;
+  done = copy_range_fd(fd, off, n);
+  bytes_this_split += done;
+  bytes_this_entry += done;
+  return done;
+}
+#endif /* def IZ_COPY_RANGE */
+
 /* always copies from global in_file to global output file y */
 int bfcopy(n)
   /* now use uzoff_t for all file sizes 5/14/05 CS */
@@ -2489,6 +2814,17 @@ int bfcopy(n)
   des_good = 0;
 
   m = 0;
+#ifdef IZ_COPY_RANGE
+  /* Whole entry, no output splits, no progress dots:  let the kernel
+     copy (or share) the data. */
+  if (!des && n != (uzoff_t)(-1L) && split_size == 0 &&
+      !(copy_only && dot_size > 0))
+  {
+    m = copy_range(n);
+    bytes_this_split += m;
+    bytes_this_entry += m;
+  }
+#endif /* def IZ_COPY_RANGE */
   while (des || n == (uzoff_t)(-1L) || m < n)
   {
     if (des || n == (uzoff_t)(-1))
@@ -3530,6 +3866,7 @@ int close_split(disk_number, tempfile, temp_name)
   }
 
   fclose(tempfile);
+  free_out_buffer(tempfile);
 
   rename_split(temp_name, split_path);
   set_filetype(split_path);
@@ -3537,6 +3874,192 @@ int close_split(disk_number, tempfile, temp_name)
   return ZE_OK;
 }
 
+#ifdef IZ_PREALLOC
+
+/* Preallocation of the archive being written
+ *
+ * An archive written outbuf_size bytes at a time can end up in many
+ * small extents.  Once y is open, prealloc_begin() is called, and from
+ * then on bfwrite() calls prealloc_more() whenever the writes are about
+ * to pass the space reserved so far, as does copy_range_fd() for the
+ * entries the kernel copies (copy_range() and zfcopy_fd()).  That reserves the next piece with
+ * fallocate(FALLOC_FL_KEEP_SIZE), which leaves the file size alone.  A
+ * piece is prealloc_step bytes, or less near the end: what is left to
+ * do (bytes_total less bytes_so_far) is scaled by the ratio of output
+ * to input seen so far.  prealloc_end() trims what was reserved past
+ * the end of the finished archive.  Only unsplit archives in regular
+ * files are preallocated, and if fallocate() fails (no support in the
+ * file system, or the disk is full) preallocation just stops.
+ */
+local FILE *pa_file = NULL;     /* file being preallocated, or NULL */
+local zoff_t pa_alloc;          /* file offset reserved up to */
+local uzoff_t pa_next;          /* bytes_this_split that needs more */
+local uzoff_t pa_out0;          /* bytes_this_split at prealloc_begin() */
+local uzoff_t pa_in0;           /* bytes_so_far at prealloc_begin() */
+
+void prealloc_begin(f)
+  FILE *f;
+{
+  struct stat st;
+
+  pa_file = NULL;
+  if (prealloc_step == 0 || split_size != 0)
+    return;
+  if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode))
+    return;
+  pa_alloc = (zoff_t)st.st_size;
+  pa_next = bytes_this_split;
+  pa_out0 = bytes_this_split;
+  pa_in0 = bytes_so_far;
+  pa_file = f;
+}
+
+/* Reserve space for at least the need bytes about to be written to
+   pa_file, and usually the next prealloc_step bytes.  Does nothing if y
+   is not being preallocated or already has room for them. */
+local void prealloc_more(need)
+  uzoff_t need;
+{
+  zoff_t pos;
+  uzoff_t left;
+  uzoff_t in;
+  uzoff_t out;
+  uzoff_t len;
+
+  if (pa_file == NULL || pa_file != y ||
+      bytes_this_split + need <= pa_next)
+    return;
+  if ((pos = zftello(pa_file)) < 0) {
+    pa_file = NULL;
+    return;
+  }
+  /* estimate the bytes still to be written */
+  left = (bytes_total > bytes_so_far) ? bytes_total - bytes_so_far : 0;
+  in = bytes_so_far - pa_in0;
+  out = bytes_this_split - pa_out0;
+  if (in > 0 && out < in)
+    left = (uzoff_t)((double)left * ((double)out / (double)in));
+
+  len = IZ_MIN(left, prealloc_step);
+  if (len < PREALLOC_MIN)
+    len = IZ_MIN(PREALLOC_MIN, prealloc_step);
+  if (len < need)
+    len = need;
+
+  if (pos + (zoff_t)len > pa_alloc) {
+    if (pa_alloc < pos)
+      pa_alloc = pos;
+    if (fallocate(fileno(pa_file), FALLOC_FL_KEEP_SIZE, (off_t)pa_alloc,
+                  (off_t)(pos + (zoff_t)len - pa_alloc)) != 0) {
+      pa_file = NULL;
+      return;
+    }
+    pa_alloc = pos + (zoff_t)len;
+  }
+  pa_next = bytes_this_split + (uzoff_t)(pa_alloc - pos);
+}
+
+/* Called with the finished archive f (after putend(), before fclose()).
+   Truncating to the current size frees the space reserved past it.
+   Returns 0, or EOF if what was still buffered could not be written (as
+   fclose() would, which then no longer can). */
+int prealloc_end(f)
+  FILE *f;
+{
+  zoff_t pos;
+
+  if (pa_file == NULL || pa_file != f) {
+    pa_file = NULL;
+    return 0;
+  }
+  pa_file = NULL;
+  if (fflush(f) != 0)
+    return EOF;
+  if ((pos = zftello(f)) < 0)
+    return 0;
+  if (pa_alloc > pos && ftruncate(fileno(f), (off_t)pos) != 0) {
+    zipwarn("could not free space preallocated past end of archive", "");
+  }
+  return 0;
+}
+#endif /* def IZ_PREALLOC */
+
+/* Output buffers
+ *
+ * set_out_buffer() gives a file the archive is being written to (the
+ * temp file, the grown archive, stdout, or a split) a full stdio buffer
+ * of outbuf_size bytes, aligned to OUTBUF_ALIGN.  The many small header
+ * writes from putlocal() and putcentral() then go out in the same
+ * write() as the entry data around them, and a 4 MiB default means few
+ * write() calls per entry for large entries.  With split method 1 the
+ * split holding the current local header stays open while the next one
+ * is written, so more than one buffer can be in use; each is remembered
+ * with its file until free_out_buffer() is called after the fclose().
+ * Returns 1 if f got a buffer, 0 if stdio keeps its default one.
+ */
+#define OUT_BUFFERS 4
+
+local struct out_buffer {
+  FILE *file;
+  char *buf;
+} out_buffers[OUT_BUFFERS];
+
+int set_out_buffer(f)
+  FILE *f;
+{
+#if (!defined(VMS) && !defined(CMS_MVS))
+  int i;
+  char *buf = NULL;
+
+  for (i = 0; i < OUT_BUFFERS && out_buffers[i].buf != NULL; i++)
+    ;
+  if (i == OUT_BUFFERS || outbuf_size == 0)
+    return 0;
+
+# if defined(UNIX) && !defined(NO_POSIX_MEMALIGN)
+  if (posix_memalign((void **)&buf, OUTBUF_ALIGN, outbuf_size) != 0)
+    buf = NULL;
+# else
+  buf = (char *)malloc(outbuf_size);
+# endif
+  if (buf == NULL) {
+    ZIPERR(ZE_MEM, "output buffer");
+  }
+
+# ifdef _IOFBF
+  if (setvbuf(f, buf, _IOFBF, outbuf_size) != 0) {
+    free(buf);
+    return 0;
+  }
+# else
+  setbuf(f, buf);
+# endif
+  out_buffers[i].file = f;
+  out_buffers[i].buf = buf;
+  return 1;
+#else /* VMS || CMS_MVS */
+  return 0;
+#endif /* ?(VMS || CMS_MVS) */
+}
+
+/* Release the buffer set_out_buffer() gave f.  f must already be closed
+ * (the pointer is only compared).
+ */
+void free_out_buffer(f)
+  FILE *f;
+{
+  int i;
+
+  for (i = 0; i < OUT_BUFFERS; i++) {
+    if (out_buffers[i].buf != NULL && out_buffers[i].file == f) {
+      free(out_buffers[i].buf);
+      out_buffers[i].buf = NULL;
+      out_buffers[i].file = NULL;
+      break;
+    }
+  }
+}
+
 /* bfwrite - buffered fwrite
    Does the fwrite but also counts bytes and does splits */
 size_t bfwrite(buffer, size, count, mode)
@@ -3594,6 +4117,10 @@ size_t bfwrite(buffer, size, count, mode)
 
   /* -------------------------------- */
   if (bytes_to_write > 0) {
+#ifdef IZ_PREALLOC
+    if (pa_file == y && bytes_this_split + bytes_to_write > pa_next)
+      prealloc_more((uzoff_t)bytes_to_write);
+#endif
     /* write out the bytes for this split */
     r = fwrite(buffer, size, bytes_to_write, y);
     bytes_written += r;
@@ -3707,6 +4234,7 @@ size_t bfwrite(buffer, size, count, mode)
           if ((y = fdopen(yd, FOPW_TMP)) == NULL) {
             ZIPERR(ZE_TEMP, tempzip);
           }
+          set_out_buffer(y);
 # ifdef CHANGE_DIRECTORY
           if (out_to_start_dir) {
             change_to_working_dir();
@@ -3724,6 +4252,7 @@ size_t bfwrite(buffer, size, count, mode)
         if ((y = zfopen(tempzip, FOPW_TMP)) == NULL) {
           ZIPERR(ZE_TEMP, tempzip);
         }
+        set_out_buffer(y);
 #endif
 
         r = fwrite((char *)buffer + bytes_written, 1, bytes_to_write, y);
@@ -4211,15 +4740,15 @@ int get_entry_comment(z)
       char *c;
       /* add leading space to indent each line of comment */
       c = string_replace(z->comment, "\n", "\n ", REPLACE_ALL, CASE_INS);
-      sprintf(errbuf, "\nCurrent comment for %s:\n %s", z->oname, c);
+      sprintf(errbuf, "\nCurrent comment for %s:\n %s", ZONAME(z), c);
       print_utf8(errbuf);
       free(c);
-      sprintf(errbuf, "\nEnter one-line comment for %s:\n ", z->oname);
+      sprintf(errbuf, "\nEnter one-line comment for %s:\n ", ZONAME(z));
       print_utf8(errbuf);
       sprintf(errbuf, "(ENTER=keep, TAB ENTER=remove, SPACE ENTER=multiline)\n ");
       print_utf8(errbuf);
     } else {
-      sprintf(errbuf, "\nEnter one-line comment for %s:\n ", z->oname);
+      sprintf(errbuf, "\nEnter one-line comment for %s:\n ", ZONAME(z));
       print_utf8(errbuf);
       sprintf(errbuf, "(SPACE ENTER=multiline)\n ");
       print_utf8(errbuf);
@@ -4243,7 +4772,7 @@ int get_entry_comment(z)
           /* get multi-line comment */
           free(eline);
           eline = NULL;
-          sprintf(errbuf, "\nEnter multi-line comment for %s:\n", z->oname);
+          sprintf(errbuf, "\nEnter multi-line comment for %s:\n", ZONAME(z));
           print_utf8(errbuf);
           sprintf(errbuf, "(Enter line with just \".\" to end)\n ");
           print_utf8(errbuf);
@@ -4312,7 +4841,7 @@ int get_entry_comment(z)
         if (strlen(e) == 2 && e[0] == ' ') {
           /* get multi-line comment */
           e[0] = '\0';
-          sprintf(errbuf, "\nEnter multi-line comment for %s:\n", z->oname);
+          sprintf(errbuf, "\nEnter multi-line comment for %s:\n", ZONAME(z));
           print_utf8(errbuf);
           sprintf(errbuf, "(Enter line with just \".\" to end)\n ");
           print_utf8(errbuf);
@@ -4558,6 +5087,144 @@ wchar_t *string_dupw(in_stringw, error_message, fluff)
 #endif /* WIN32 */
 
 
+/* Name arena
+ *
+ * The names of the entries read from the archive (scanzipf_regnew())
+ * and of the files found (newname()) mostly live until zip is done, and
+ * with millions of entries a malloc() per name costs time and allocator
+ * overhead.  name_alloc() carves them from large blocks instead, each
+ * block twice the size of the one before, from NAME_ARENA_MIN up to
+ * NAME_ARENA_MAX, so there are never many blocks.  Names from the arena
+ * must be released with name_free(), which frees what came from
+ * malloc() and ignores what came from a block, so a name can be freed
+ * without knowing where it came from.  name_arena_free() frees all the
+ * blocks at the end.
+ */
+struct name_block {
+  struct name_block *next;      /* block allocated before this one */
+  extent size;                  /* bytes in buf */
+  extent used;                  /* bytes handed out */
+  char buf[1];
+};
+
+local struct name_block *name_blocks = NULL;  /* newest first */
+
+/* name_alloc - allocate n bytes for a name
+ *
+ * Returns NULL if out of memory.  Large requests go to malloc().
+ */
+char *name_alloc(n)
+  extent n;
+{
+  struct name_block *b;
+  extent size;
+  char *p;
+
+  if (n > NAME_ARENA_MAX / 4)
+    return (char *)malloc(n);
+  b = name_blocks;
+  if (b == NULL || b->size - b->used < n) {
+    size = NAME_ARENA_MIN;
+    if (b != NULL)
+      size = IZ_MIN(2 * b->size, NAME_ARENA_MAX);
+    if ((b = (struct name_block *)malloc(sizeof(struct name_block) + size))
+        == NULL)
+      return NULL;
+    b->next = name_blocks;
+    b->size = size;
+    b->used = 0;
+    name_blocks = b;
+  }
+  p = b->buf + b->used;
+  b->used += n;
+  return p;
+}
+
+/* name_dup - duplicate a string in the name arena
+ *
+ * Same as string_dup(), but the copy must be released with name_free().
+ */
+#ifndef NO_PROTO
+char *name_dup(ZCONST char *in_string, ZCONST char *error_message, int fluff)
+#else
+char *name_dup(in_string, error_message, fluff)
+  ZCONST char *in_string;
+  char *error_message;
+  int fluff;
+#endif
+{
+  char *out_string;
+
+  if (in_string == NULL)
+    return NULL;
+
+  if (fluff < 0)
+    return NULL;
+
+  if ((out_string = name_alloc(strlen(in_string) + fluff + 1)) == NULL) {
+    sprintf(errbuf, "could not allocate memory in name_dup: %s", error_message);
+    ZIPERR(ZE_MEM, errbuf);
+  }
+
+  strcpy(out_string, in_string);
+  return out_string;
+}
+
+local int name_in_arena(p)
+  ZCONST zvoid *p;
+{
+  struct name_block *b;
+
+  for (b = name_blocks; b != NULL; b = b->next) {
+    if ((ZCONST char *)p >= b->buf && (ZCONST char *)p < b->buf + b->size)
+      return 1;
+  }
+  return 0;
+}
+
+/* name_free - free a name from name_alloc(), name_dup() or malloc() */
+void name_free(p)
+  zvoid *p;
+{
+  if (p != NULL && !name_in_arena(p))
+    free(p);
+}
+
+/* name_share - let p be the arena name s if they are the same string
+ *
+ * The forms of an entry's name (iname, zname, oname, uname, and name
+ * for archive entries) are the same string for most entries, and each
+ * used to be a copy of its own.  If s is from the arena and p is equal
+ * to it, p is freed and s returned, so the forms share one copy;
+ * otherwise p is returned.  Shared names must be released only with
+ * name_free(), which leaves arena names alone.
+ */
+char *name_share(p, s)
+  char *p;                      /* name from malloc() or the arena */
+  char *s;                      /* arena name to use instead */
+{
+  if (p == NULL || s == NULL || p == s || strcmp(p, s) != 0 ||
+      !name_in_arena(s))
+    return p;
+  name_free((zvoid *)p);
+  return s;
+}
+
+/* name_arena_free - free all the name blocks
+ *
+ * Every name from the arena is gone after this.
+ */
+void name_arena_free()
+{
+  struct name_block *b;
+
+  while ((b = name_blocks) != NULL) {
+    name_blocks = b->next;
+    free((zvoid *)b);
+  }
+}
+
+
 /* string_replace - replace substring with string
  *
  * Not MBCS aware!
@@ -5569,6 +6236,16 @@ int is_utf8_string(instring, has_bom, count, ascii_count, utf8_count)
   /* Run through bytes, looking for good and bad UTF-8 characters. */
   for (; instring[index];)
   {
+    /* Take runs of 7-bit ASCII a block at a time.  Only the multi-byte
+       sequences between them need the byte-at-a-time checks below. */
+    t = (int)ascii_span(instring + index, 0);
+    if (t) {
+      index += t;
+      char_count += t;
+      ascii_char_count += t;
+      continue;
+    }
+
     uc = (unsigned char)instring[index++];
 
     lead = uc;
@@ -6469,18 +7146,10 @@ int is_ascii_stringw(wchar_t *wchar_string)
  */
 int is_ascii_string(char *mbstring)
 {
-  char *p;
-  uch c;
-
   if (mbstring == NULL)
     return 0;
 
-  for (p = mbstring; (c = (uch)*p) != '\0'; p++) {
-    if (c > 0x7F) {
-      return 0;
-    }
-  }
-  return 1;
+  return mbstring[ascii_span(mbstring, 0)] == '\0';
 }
 
 
@@ -6500,6 +7169,11 @@ char *local_to_utf8_string(char *local_string)
 
   if (local_string == NULL)
     return NULL;
+#   ifndef EBCDIC
+  /* 7-bit ASCII is the same in UTF-8, so skip the wide conversions. */
+  if (is_ascii_string(local_string))
+    return string_dup(local_string, "local_to_utf8_string", NO_FLUFF);
+#   endif
 #   ifdef UNICODE_SUPPORT_WIN32
   wide_string = local_to_wide_string_windows(local_string);
 #   else
@@ -7133,8 +7807,8 @@ char *wide_to_escape_stringz(zwchar *wide_string)
 {
   int i;
   int wsize = 0;
-  char buf[9];
   char *buffer = NULL;
+  char *bufend;
   char *escape_string = NULL;
 
   if (wide_string == NULL)
@@ -7146,22 +7820,23 @@ char *wide_to_escape_stringz(zwchar *wide_string)
     ZIPERR(ZE_MEM, "wide_to_escape_stringz");
   }
 
-  /* convert it */
-  buffer[0] = '\0';
+  /* convert it, appending at bufend rather than strcat()ing each char */
+  bufend = buffer;
+  *bufend = '\0';
 
   for (i = 0; i < wsize; i++) {
     if (wide_string[i] <= 0x7f && isprint((char)wide_string[i])) {
       /* ASCII */
-      buf[0] = (char)wide_string[i];
-      buf[1] = '\0';
-      strcat(buffer, buf);
+      *bufend++ = (char)wide_string[i];
     } else {
       /* use escape for wide character */
       char *e = wide_char_to_escape_string(wide_string[i]);
-      strcat(buffer, e);
+      strcpy(bufend, e);
+      bufend += strlen(e);
       free(e);
     }
   }
+  *bufend = '\0';
   if ((escape_string = (char *)malloc(strlen(buffer) + 1)) == NULL) {
     ZIPERR(ZE_MEM, "wide_to_escape_stringz");
   }
@@ -7314,6 +7989,13 @@ char *utf8_to_local_stringz(char *utf8_string)
   if (utf8_string == NULL)
     return NULL;
 
+# ifndef EBCDIC
+  /* 7-bit ASCII is unchanged in any ASCII-based local charset.  (With
+     -UN=escape, ASCII is not escaped, either.) */
+  if (is_ascii_string(utf8_string))
+    return string_dup(utf8_string, "utf8_to_local_stringz", NO_FLUFF);
+# endif
+
   wide_string = utf8_to_wide_stringz(utf8_string);
   if (wide_string == NULL)
     return NULL;
@@ -7448,8 +8130,15 @@ char *utf8_to_local_stringz(char *utf8_string)
  */
 char *utf8_to_escape_string(char *utf8_string)
 {
-  zwchar *wide_string = utf8_to_wide_stringz(utf8_string);
-  char *escape_string = wide_to_escape_stringz(wide_string);
+  zwchar *wide_string;
+  char *escape_string;
+
+  /* Printable ASCII is never escaped, so the result would be a copy. */
+  if (utf8_string && utf8_string[ascii_span(utf8_string, 1)] == '\0')
+    return string_dup(utf8_string, "utf8_to_escape_string", NO_FLUFF);
+
+  wide_string = utf8_to_wide_stringz(utf8_string);
+  escape_string = wide_to_escape_stringz(wide_string);
   free(wide_string);
   return escape_string;
 }
@@ -388,6 +388,11 @@ uzoff_t bytes_this_split = 0;     /* bytes written to the current split */
 int read_split_archive = 0;       /* 1=scanzipf_reg detected spanning signature */
 int split_method = 0;             /* 0=no splits, 1=seekable, 2=data desc, -1=no */
 uzoff_t split_size = 0;           /* how big each split should be */
+extent outbuf_size = OUTBUF_SZ;   /* stdio buffer size for output (--write-buffer) */
+uzoff_t prealloc_step = PREALLOC_STEP; /* archive preallocation step (--prealloc) */
+int read_ahead = 0;               /* 1=open and read input files ahead (-ra) */
+int nocache = 0;                  /* input out of page cache, 2=O_DIRECT (-nc) */
+int stream_add = 0;               /* 1=zip new files as found (-sz), 2=scanning */
 int split_bell = 0;               /* when pause for next split ring bell */
 uzoff_t bytes_prev_splits = 0;    /* total bytes written to all splits before this */
 uzoff_t bytes_this_entry = 0;     /* bytes written for this entry across all splits */
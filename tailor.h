@@ -873,6 +873,157 @@ typedef struct ztimbuf {
 #  define SBSZ CBSZ     /* copy buf size for STORED entries, see zipup() */
 #endif
 
+/* stdio buffer for the archive being written and each of its splits
+ * (set_out_buffer() in fileio.c).  Every flush is one write(), so on
+ * network and FUSE file systems a large buffer saves many round trips.
+ * Can be changed at run time with --write-buffer.
+ */
+#ifndef OUTBUF_SZ
+#  if defined(SMALL_MEM) || defined(MEDIUM_MEM)
+#    define OUTBUF_SZ ZBSZ
+#  else
+#    define OUTBUF_SZ 0x400000L /* 4 MiB */
+#  endif
+#endif
+#ifndef OUTBUF_ALIGN
+#  define OUTBUF_ALIGN 4096     /* alignment of the buffer (page size) */
+#endif
+
+/* The central directory of an existing archive is read in blocks of up
+ * to CD_BLOCK_MAX bytes and parsed from memory (cd_blk_start() in
+ * zipfile.c).
+ */
+#ifndef CD_BLOCK_MAX
+#  if defined(SMALL_MEM) || defined(MEDIUM_MEM)
+#    define CD_BLOCK_MAX 0x8000L
+#  else
+#    define CD_BLOCK_MAX 0x1000000L     /* 16 MiB */
+#  endif
+#endif
+
+/* Entry and file names are allocated from blocks of NAME_ARENA_MIN
+ * bytes, doubling up to NAME_ARENA_MAX (name_alloc() in fileio.c).
+ * Defining NAME_ARENA_MAX as 0 gives every name its own malloc(), and
+ * then the forms of a name are not shared either (name_share()).
+ */
+#if defined(SMALL_MEM) || defined(MEDIUM_MEM)
+#  ifndef NAME_ARENA_MIN
+#    define NAME_ARENA_MIN 0x1000
+#  endif
+#  ifndef NAME_ARENA_MAX
+#    define NAME_ARENA_MAX 0x4000
+#  endif
+#else
+#  ifndef NAME_ARENA_MIN
+#    define NAME_ARENA_MIN 0x10000L     /* 64 KiB */
+#  endif
+#  ifndef NAME_ARENA_MAX
+#    define NAME_ARENA_MAX 0x4000000L   /* 64 MiB */
+#  endif
+#endif
+
+/* The entries of the archive read by scanzipf_regnew() are allocated in
+ * blocks of consecutive structures, starting at ZLIST_BLOCK_MIN entries
+ * and doubling up to ZLIST_BLOCK_MAX (zlist_alloc() in zipfile.c).
+ */
+#if defined(SMALL_MEM) || defined(MEDIUM_MEM)
+#  ifndef ZLIST_BLOCK_MIN
+#    define ZLIST_BLOCK_MIN 16
+#  endif
+#  ifndef ZLIST_BLOCK_MAX
+#    define ZLIST_BLOCK_MAX 64
+#  endif
+#else
+#  ifndef ZLIST_BLOCK_MIN
+#    define ZLIST_BLOCK_MIN 256
+#  endif
+#  ifndef ZLIST_BLOCK_MAX
+#    define ZLIST_BLOCK_MAX 0x10000     /* 64 Ki entries */
+#  endif
+#endif
+
+/* name_sort() (util.c) sorts lists of NSORT_PAR_MIN or more names with
+ * up to NSORT_THREADS threads where the port supports it (IZ_PSORT).
+ * Runs of NSORT_INSERT names or fewer are sorted by insertion.
+ */
+#ifndef NSORT_THREADS
+#  define NSORT_THREADS 8
+#endif
+#ifndef NSORT_PAR_MIN
+#  define NSORT_PAR_MIN 0x10000L        /* 64 Ki names */
+#endif
+#ifndef NSORT_INSERT
+#  define NSORT_INSERT 16
+#endif
+
+/* Between cen_batch_begin() and cen_batch_end() (zipfile.c), central
+ * headers from putcentral() are collected and written CEN_BATCH bytes
+ * at a time.  0 writes each header as it is made.
+ */
+#ifndef CEN_BATCH
+#  if defined(SMALL_MEM) || defined(MEDIUM_MEM)
+#    define CEN_BATCH 0
+#  else
+#    define CEN_BATCH 0x100000L         /* 1 MiB */
+#  endif
+#endif
+
+/* With -sz, newname() has the found list zipped up (zipup_found() in
+ * zip.c) each time it holds FOUND_BATCH files, so the scan of a new
+ * archive's files never builds up more than that.
+ */
+#ifndef FOUND_BATCH
+#  if defined(SMALL_MEM) || defined(MEDIUM_MEM)
+#    define FOUND_BATCH 16
+#  else
+#    define FOUND_BATCH 256
+#  endif
+#endif
+
+/* Where the port supports it (IZ_PREALLOC), the archive being written
+ * can be given disk space ahead of the writes, up to PREALLOC_STEP bytes
+ * at a time, so a large archive ends up in few extents.  Each step is no
+ * less than PREALLOC_MIN (unless the step itself is smaller), so the
+ * central directory does not cost a call per header.  The step can be
+ * changed at run time with --prealloc.  It is 0 (off) by default,
+ * as file systems that delay allocation (ext4, XFS, btrfs) already lay
+ * out an archive in few extents, and the space reserved by two zips
+ * writing at once comes out interleaved.
+ */
+#ifndef PREALLOC_STEP
+#  define PREALLOC_STEP 0
+#endif
+#ifndef PREALLOC_MIN
+#  define PREALLOC_MIN 0x100000L        /* 1 MiB */
+#endif
+
+/* find_next_signature() in zipfile.c, used for -F and -FF and to find
+ * the end records, scans the archive SIG_SCAN_BUFSIZE bytes at a time.
+ */
+#ifndef SIG_SCAN_BUFSIZE
+#  if defined(SMALL_MEM) || defined(MEDIUM_MEM)
+#    define SIG_SCAN_BUFSIZE 0x1000
+#  else
+#    define SIG_SCAN_BUFSIZE 0x40000     /* 256 KiB */
+#  endif
+#endif
+
+/* Where the port supports it (IZ_MAPIN), regular input files of at
+ * least MAPIN_MIN and at most MAPIN_MAX bytes are memory mapped, and the
+ * compressors are fed from the mapping MAPIN_CHUNK bytes at a time.
+ * MAPIN_MIN must be more than SBSZ: mapped files skip the check for a
+ * file that fits one buffer and is better stored.
+ */
+#ifndef MAPIN_MIN
+#  define MAPIN_MIN 0x10000L            /* 64 KiB */
+#endif
+#ifndef MAPIN_MAX
+#  define MAPIN_MAX 0x40000000L         /* 1 GiB */
+#endif
+#ifndef MAPIN_CHUNK
+#  define MAPIN_CHUNK 0x40000           /* 256 KiB */
+#endif
+
 #ifndef MEMORY16
 #  ifdef __WATCOMC__
 #    undef huge
@@ -913,6 +1064,61 @@ typedef struct ztimbuf {
 #   define DYN_ALLOC
 #endif
 
+/* EBCDIC <--> ASCII translation tables (ebcdic.h) and the strtoasc(),
+ * memtoasc(), etc. conversion functions (util.c).  EBCDIC ports always
+ * get these.  Defining IZ_FORCE_EBCDIC_TABLES builds them on an ASCII
+ * system, too, so that the translation code can be exercised (through
+ * the Zip library, say) where no EBCDIC system is available.
+ */
+#if defined(EBCDIC) || defined(IZ_FORCE_EBCDIC_TABLES)
+#  ifndef IZ_EBCDIC_TABLES
+#    define IZ_EBCDIC_TABLES
+#  endif
+#endif
+
+/* Runtime CPU feature dispatch.  With gcc or clang on x86 and x86_64,
+ * the vector versions of the hot loops (CRC, longest_match(), text
+ * detection, EOL translation, table translation) are compiled with
+ * IZ_TARGET() for the instruction set they need, and cpu_dispatch_init()
+ * (util.c) picks the best version for the CPU actually running, once at
+ * startup.  A distribution build then neither leaves speed on the table
+ * nor fails on older CPUs.  Define NO_CPU_DISPATCH (or NO_SIMD) to use
+ * only what the compiler targets.
+ */
+#if !defined(NO_SIMD) && !defined(NO_CPU_DISPATCH)
+#  if (defined(__GNUC__) && (__GNUC__ >= 5)) || defined(__clang__)
+#    if defined(__x86_64__) || defined(__i386__)
+#      ifndef IZ_CPU_DISPATCH
+#        define IZ_CPU_DISPATCH
+#      endif
+#    endif
+#  endif
+#endif
+#ifdef IZ_CPU_DISPATCH
+#  define IZ_TARGET(isa) __attribute__((target(isa)))
+#else
+#  define IZ_TARGET(isa)
+#endif
+
+/* Vector (SIMD) versions of some byte-at-a-time loops (util.c).  These
+ * are used when the compiler targets SSE2 (any x86_64 compiler) or SSSE3
+ * (gcc/clang -mssse3 or better), or, for SSSE3, when the choice is made
+ * at run time (IZ_CPU_DISPATCH).  Define NO_SIMD to use only the
+ * portable C versions.
+ */
+#ifndef NO_SIMD
+#  if defined(__SSE2__) || defined(_M_X64)
+#    ifndef IZ_SSE2
+#      define IZ_SSE2
+#    endif
+#  endif
+#  if defined(__SSSE3__) || defined(IZ_CPU_DISPATCH)
+#    ifndef IZ_SSSE3
+#      define IZ_SSSE3
+#    endif
+#  endif
+#endif
+
 
 /* LARGE_FILE_SUPPORT
  *
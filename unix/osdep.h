@@ -29,6 +29,96 @@
 # endif
 #endif
 
+/* In-kernel copy of unchanged entries (copy_range() in fileio.c), with
+   the Linux copy_file_range() and FICLONERANGE.  copy_file_range() is a
+   GNU extension in glibc.  unix/configure sets NO_COPY_FILE_RANGE if
+   the C library lacks it. */
+#if (defined(linux) || defined(__linux__)) && !defined(NO_COPY_FILE_RANGE)
+# ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+# endif
+# ifndef IZ_COPY_RANGE
+#   define IZ_COPY_RANGE
+# endif
+#endif
+
+/* Sort large name lists (found list, archive entries) with several
+   threads (name_sort() in util.c).  unix/configure sets NO_PTHREAD if
+   the threads library is missing, and otherwise links it in. */
+#if (defined(linux) || defined(__linux__)) && !defined(NO_PTHREAD)
+# ifndef IZ_PSORT
+#   define IZ_PSORT
+# endif
+#endif
+
+/* Reserve space for the archive being written ahead of the writes
+   with the Linux fallocate() (prealloc_more() in fileio.c, -pr option).
+   unix/configure sets NO_FALLOCATE if the C library lacks it. */
+#if (defined(linux) || defined(__linux__)) && !defined(NO_FALLOCATE)
+# ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+# endif
+# ifndef IZ_PREALLOC
+#   define IZ_PREALLOC
+# endif
+#endif
+
+/* Read ahead of the files being added with io_uring (uring_prefetch() in
+   unix/unix.c, -ra option).  Needs gcc or clang for the __atomic
+   builtins.  unix/configure sets NO_IO_URING if the headers lack it. */
+#if (defined(linux) || defined(__linux__)) && !defined(NO_IO_URING)
+# if defined(__GNUC__) || defined(__clang__)
+#   ifndef IZ_URING
+#     define IZ_URING
+#   endif
+# endif
+#endif
+
+/* Keep the files being added out of the page cache (-nc), with
+   posix_fadvise() and, on Linux, O_NOATIME and O_DIRECT (nc_open() in
+   unix/unix.c).  unix/configure sets NO_POSIX_FADVISE if it is missing. */
+#ifndef NO_POSIX_FADVISE
+# if (defined(linux) || defined(__linux__)) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE          /* O_DIRECT, O_NOATIME */
+# endif
+# ifndef IZ_NOCACHE
+#   define IZ_NOCACHE
+# endif
+#endif
+
+/* Read the holes of sparse input files as zeros without reading them,
+   finding them with lseek(SEEK_DATA) and lseek(SEEK_HOLE) (sp_read() in
+   unix/unix.c).  unix/configure sets NO_SEEK_HOLE if they are missing. */
+#ifndef NO_SEEK_HOLE
+# if (defined(linux) || defined(__linux__)) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE          /* SEEK_DATA, SEEK_HOLE */
+# endif
+# ifndef IZ_SPARSE
+#   define IZ_SPARSE
+# endif
+#endif
+
+/* Hand the compressors pointers into a mapping of each input file
+   instead of read() copies (in_map_open() in zipup.c).  Not together
+   with the older deflate-only MMAP or BIG_MEM window, nor where EBCDIC
+   text is converted in the input buffer. */
+#if !defined(NO_MAPIN) && !defined(MMAP) && !defined(BIG_MEM)
+# if !defined(EBCDIC) && !defined(ZOS_UNIX)
+#   ifndef IZ_MAPIN
+#     define IZ_MAPIN
+#   endif
+# endif
+#endif
+
+/* Update the archive in place, with a journal of the bytes overwritten
+   (journal_begin() in zipfile.c).  Needs ftruncate(), fsync() and
+   flock(). */
+#ifndef NO_INPLACE_UPDATE
+# ifndef INPLACE_UPDATE
+#   define INPLACE_UPDATE
+# endif
+#endif
+
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -783,9 +783,9 @@ int caseflag;           /* true to force case-sensitive match */
               z->mark = pcount ? filter(z->zuname, caseflag) : 1;
               if (verbose) {
                   zfprintf(mesg, "zip diagnostic: %scluding %s\n",
-                     z->mark ? "in" : "ex", z->oname);
+                     z->mark ? "in" : "ex", ZONAME(z));
                   zfprintf(mesg, "     Escaped Unicode:  %s\n",
-                     z->ouname);
+                     ZOUNAME(z));
               }
               m = 0;
 #if 0
@@ -1686,6 +1686,767 @@ int wild(w)
 
 /* ------------------------------------ */
 
+#ifdef IZ_URING
+
+/* Read-ahead of input files with io_uring (-ra).
+ *
+ * For trees of small files most of the time goes to open() and the first
+ * read() of each file.  zip calls uring_prefetch() for the next files in
+ * the found list, which queues an IORING_OP_OPENAT and then an
+ * IORING_OP_READ of the first URING_BUFSZ bytes for each.  When zipup()
+ * gets to the file, zopen() (ufile_open(), uring_open()) takes the
+ * descriptor and zread() (uring_read()) returns the data already read
+ * before reading
+ * the rest from the file.  Files zip skipped are dropped by
+ * uring_skip_to().  If io_uring is not available (old kernel, seccomp),
+ * everything goes straight to open() and read() as before.
+ */
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define URING_DEPTH     16              /* files read ahead */
+#define URING_BUFSZ     0x10000L        /* bytes read ahead per file */
+
+/* read-ahead slot states */
+#define RA_FREE         0       /* unused */
+#define RA_OPEN         1       /* open in flight */
+#define RA_READ         2       /* read in flight */
+#define RA_DONE         3       /* open, got bytes read */
+#define RA_FAIL         4       /* failed, let zip open() it */
+#define RA_INUSE        5       /* handed to zopen() */
+
+struct ra_slot {
+  int state;            /* RA_ state */
+  int drop;             /* free when in flight op completes */
+  ulg seq;              /* place in found list */
+  char *name;           /* file name */
+  int fd;               /* descriptor, -1 if not open */
+  char *buf;            /* read-ahead buffer */
+  long got;             /* bytes read ahead */
+  long pos;             /* bytes returned by uring_read() */
+};
+
+/* one more than the depth for the file zip is reading */
+local struct ra_slot ra[URING_DEPTH + 1];
+
+local int ra_ring = -1;         /* ring fd, -1 not set up, -2 not usable */
+local unsigned ra_inflight = 0; /* operations submitted, not completed */
+local unsigned *sq_tail, *sq_mask, *sq_array;
+local unsigned *cq_head, *cq_tail, *cq_mask;
+local struct io_uring_sqe *sqes;
+local struct io_uring_cqe *cqes;
+
+local int ra_start OF((void));
+local int ra_submit OF((struct ra_slot *, int));
+local void ra_complete OF((struct ra_slot *, int));
+local void ra_reap OF((int));
+local void ra_free OF((struct ra_slot *));
+local struct ra_slot *ra_inuse OF((int));
+local int uring_open OF((char *, int));
+local long uring_read OF((int, char *, extent));
+local int uring_rewind OF((int));
+local int uring_close OF((int));
+
+
+local int ra_start()
+/* Set up the ring the first time.  Return true if it can be used. */
+{
+  struct io_uring_params p;
+  size_t sqsz, cqsz;    /* ring sizes */
+  char *sq, *cq;        /* rings */
+  int fd;               /* ring */
+  int i;
+
+  if (ra_ring != -1)
+    return ra_ring >= 0;
+  ra_ring = -2;
+  memset(&p, 0, sizeof(p));
+  if ((fd = (int)syscall(__NR_io_uring_setup, URING_DEPTH * 2, &p)) < 0)
+    return 0;
+  sqsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cqsz > sqsz)
+      sqsz = cqsz;
+  }
+  sq = (char *)mmap(0, sqsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+  if (sq == (char *)MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    cq = sq;
+  } else {
+    cq = (char *)mmap(0, cqsz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq == (char *)MAP_FAILED) {
+      close(fd);
+      return 0;
+    }
+  }
+  sqes = (struct io_uring_sqe *)mmap(0,
+           p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == (struct io_uring_sqe *)MAP_FAILED) {
+    close(fd);
+    return 0;
+  }
+  sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  sq_array = (unsigned *)(sq + p.sq_off.array);
+  cq_head = (unsigned *)(cq + p.cq_off.head);
+  cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  for (i = 0; i <= URING_DEPTH; i++) {
+    ra[i].state = RA_FREE;
+    ra[i].fd = -1;
+  }
+  ra_ring = fd;
+  return 1;
+}
+
+
+local int ra_submit(s, op)
+  struct ra_slot *s;    /* slot */
+  int op;               /* IORING_OP_OPENAT or IORING_OP_READ */
+/* Submit the open or read for slot s.  Return true if submitted. */
+{
+  unsigned tail = *sq_tail;
+  unsigned i = tail & *sq_mask;
+  struct io_uring_sqe *e = &sqes[i];
+
+  memset(e, 0, sizeof(*e));
+  e->opcode = (uch)op;
+  if (op == IORING_OP_OPENAT) {
+    e->fd = AT_FDCWD;
+    e->addr = (unsigned long)s->name;
+    /* O_NONBLOCK so a FIFO cannot hold up the ring, no effect on files */
+    e->open_flags = O_RDONLY | O_NONBLOCK | O_NOCTTY;
+  } else {
+    e->fd = s->fd;
+    e->addr = (unsigned long)s->buf;
+    e->len = URING_BUFSZ;
+    e->off = 0;
+  }
+  e->user_data = (unsigned long)(s - ra);
+  sq_array[i] = i;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  if (syscall(__NR_io_uring_enter, ra_ring, 1, 0, 0, NULL, 0) != 1) {
+    /* not taken, the kernel only looks at the tail in io_uring_enter() */
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+    return 0;
+  }
+  ra_inflight++;
+  return 1;
+}
+
+
+local void ra_complete(s, res)
+  struct ra_slot *s;    /* slot */
+  int res;              /* result of the open or read */
+/* Move slot s on when its open or read completes. */
+{
+  struct stat st;
+
+  if (s->state == RA_OPEN) {
+    if (res < 0) {
+      if (res == -EINVAL) {
+        /* kernel without IORING_OP_OPENAT, stop trying */
+        read_ahead = 0;
+      }
+      s->state = RA_FAIL;
+    } else {
+      s->fd = res;
+      if (s->drop) {
+        s->state = RA_FAIL;
+      } else if (fstat(s->fd, &st) || !S_ISREG(st.st_mode)) {
+        /* only regular files, zip opens anything else itself */
+        close(s->fd);
+        s->fd = -1;
+        s->state = RA_FAIL;
+      } else {
+        s->state = RA_READ;
+        if (!ra_submit(s, IORING_OP_READ)) {
+          s->got = 0;
+          s->state = RA_DONE;
+        }
+      }
+    }
+  } else if (s->state == RA_READ) {
+    s->got = res < 0 ? 0 : res;
+    s->state = RA_DONE;
+  }
+  if (s->drop && (s->state == RA_DONE || s->state == RA_FAIL))
+    ra_free(s);
+}
+
+
+local void ra_reap(wait)
+  int wait;             /* true to wait for at least one completion */
+/* Handle the completed operations. */
+{
+  unsigned head, tail;
+  struct io_uring_cqe *c;
+  int n = 0;            /* completions handled */
+
+  for (;;) {
+    head = *cq_head;
+    tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      if (n || !wait || ra_inflight == 0)
+        return;
+      if (syscall(__NR_io_uring_enter, ra_ring, 0, 1, IORING_ENTER_GETEVENTS,
+                  NULL, 0) < 0 && errno != EINTR)
+        return;
+      continue;
+    }
+    c = &cqes[head & *cq_mask];
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    ra_inflight--;
+    ra_complete(&ra[c->user_data], c->res);
+    n++;
+  }
+}
+
+
+local void ra_free(s)
+  struct ra_slot *s;    /* slot */
+/* Close and release slot s.  The buffer is kept for the next file. */
+{
+  if (s->fd >= 0)
+    close(s->fd);
+  if (s->name)
+    free(s->name);
+  s->name = NULL;
+  s->fd = -1;
+  s->drop = 0;
+  s->got = s->pos = 0;
+  s->state = RA_FREE;
+}
+
+
+local struct ra_slot *ra_inuse(fd)
+  int fd;               /* descriptor from zopen() */
+/* Return the slot handed out as fd, or NULL if fd was not read ahead. */
+{
+  int i;
+
+  if (ra_ring < 0)
+    return NULL;
+  for (i = 0; i <= URING_DEPTH; i++) {
+    if (ra[i].state == RA_INUSE && ra[i].fd == fd)
+      return &ra[i];
+  }
+  return NULL;
+}
+
+
+int uring_prefetch(name, seq)
+  char *name;           /* file zip will read soon */
+  ulg seq;              /* its place in the found list */
+/* Start opening and reading name.  Return 0 if the queue is full and
+   name should be offered again later, 1 otherwise (including when read
+   ahead is not possible). */
+{
+  struct ra_slot *s = NULL;
+  int i, n;
+
+  if (!read_ahead || !ra_start())
+    return 1;
+  ra_reap(0);
+  for (i = n = 0; i <= URING_DEPTH; i++) {
+    if (ra[i].state == RA_FREE)
+      s = &ra[i];
+    else if (ra[i].state != RA_INUSE)
+      n++;
+  }
+  if (n >= URING_DEPTH || s == NULL)
+    return 0;
+  if ((s->buf == NULL && (s->buf = malloc(URING_BUFSZ)) == NULL) ||
+      (s->name = malloc(strlen(name) + 1)) == NULL)
+    return 1;
+  strcpy(s->name, name);
+  s->seq = seq;
+  s->state = RA_OPEN;
+  if (!ra_submit(s, IORING_OP_OPENAT))
+    ra_free(s);
+  return 1;
+}
+
+
+void uring_skip_to(seq)
+  ulg seq;              /* place in found list zip is at */
+/* Drop the read-ahead of files before seq, zip has gone past them. */
+{
+  int i;
+
+  if (ra_ring < 0)
+    return;
+  for (i = 0; i <= URING_DEPTH; i++) {
+    if (ra[i].state != RA_FREE && ra[i].state != RA_INUSE && !ra[i].drop &&
+        ra[i].seq < seq) {
+      if (ra[i].state == RA_OPEN || ra[i].state == RA_READ)
+        ra[i].drop = 1;
+      else
+        ra_free(&ra[i]);
+    }
+  }
+}
+
+
+local int uring_open(name, flags)
+  char *name;           /* file to open */
+  int flags;            /* open() flags */
+/* open() replacement for zopen().  Use the read-ahead of name if there
+   is one. */
+{
+  struct ra_slot *s = NULL;
+  int i;
+
+  if (ra_ring >= 0) {
+    for (i = 0; i <= URING_DEPTH; i++) {
+      if (ra[i].state != RA_FREE && ra[i].state != RA_INUSE && !ra[i].drop &&
+          strcmp(ra[i].name, name) == 0) {
+        s = &ra[i];
+        break;
+      }
+    }
+  }
+  if (s == NULL)
+    return open(name, flags);
+  while (s->state == RA_OPEN || s->state == RA_READ) {
+    i = ra_inflight;
+    ra_reap(1);
+    if (ra_inflight == (unsigned)i && (s->state == RA_OPEN ||
+                                       s->state == RA_READ)) {
+      /* ring failed, abandon the slot (it may still complete) */
+      s->drop = 1;
+      return open(name, flags);
+    }
+  }
+  if (s->state != RA_DONE ||
+      lseek(s->fd, (off_t)s->got, SEEK_SET) != (off_t)s->got) {
+    ra_free(s);
+    return open(name, flags);
+  }
+  s->state = RA_INUSE;
+  s->pos = 0;
+  return s->fd;
+}
+
+
+local long uring_read(fd, buf, n)
+  int fd;               /* descriptor from zopen() */
+  char *buf;            /* where to put the data */
+  extent n;             /* bytes wanted */
+/* read() replacement for zread().  Return the bytes read ahead first. */
+{
+  struct ra_slot *s;
+  extent m = 0;         /* bytes from the read-ahead buffer */
+  long r;
+
+  if ((s = ra_inuse(fd)) != NULL && s->pos < s->got) {
+    m = (extent)(s->got - s->pos);
+    if (m > n)
+      m = n;
+    memcpy(buf, s->buf + s->pos, m);
+    s->pos += (long)m;
+    if (m == n)
+      return (long)m;
+  }
+  r = (long)read(fd, buf + m, n - m);
+  if (r < 0)
+    return m ? (long)m : r;
+  return (long)m + r;
+}
+
+
+local int uring_rewind(fd)
+  int fd;               /* descriptor from zopen() */
+/* lseek(fd, 0, SEEK_SET) replacement for zrewind(). */
+{
+  struct ra_slot *s;
+
+  if ((s = ra_inuse(fd)) == NULL)
+    return lseek(fd, 0, SEEK_SET) < 0 ? -1 : 0;
+  s->pos = 0;
+  return lseek(fd, (off_t)s->got, SEEK_SET) < 0 ? -1 : 0;
+}
+
+
+local int uring_close(fd)
+  int fd;               /* descriptor from zopen() */
+/* close() replacement for zclose(). */
+{
+  struct ra_slot *s;
+
+  if ((s = ra_inuse(fd)) != NULL) {
+    s->fd = -1;
+    ra_free(s);
+  }
+  return close(fd);
+}
+
+#endif /* IZ_URING */
+
+
+#ifdef IZ_NOCACHE
+
+/* Input files that stay out of the page cache (-nc).
+ *
+ * For backup runs on busy hosts:  the file is advised sequential, the
+ * next NOCACHE_WINDOW is advised WILLNEED as reading gets to it, and
+ * what has been read is dropped (DONTNEED) a window at a time.  Files
+ * are opened with O_NOATIME where the user may.  With -nc=direct they are
+ * opened with O_DIRECT and read in DIRECT_BUFSZ blocks into an aligned
+ * buffer, so the data does not go through the page cache at all.  One
+ * file is read at a time, so one set of state is enough.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+
+#define NOCACHE_WINDOW  0x400000L       /* advise and drop 4 MiB at a time */
+#define DIRECT_BUFSZ    0x100000L       /* O_DIRECT read size */
+#define DIRECT_ALIGN    4096            /* O_DIRECT buffer alignment */
+
+local int nc_fd = -1;           /* file being read, -1 if none */
+local zoff_t nc_pos;            /* bytes read from it */
+local zoff_t nc_advised;        /* WILLNEED given up to here */
+local zoff_t nc_dropped;        /* DONTNEED given up to here */
+local int nc_direct;            /* opened with O_DIRECT */
+local char *nc_buf = NULL;      /* aligned buffer for O_DIRECT */
+local long nc_have;             /* bytes in nc_buf */
+local long nc_next;             /* next byte of nc_buf to return */
+
+local int nc_open OF((char *, int));
+local long nc_read OF((int, char *, extent));
+local void nc_advise OF((void));
+
+
+local int nc_open(name, flags)
+  char *name;           /* file to open */
+  int flags;            /* open() flags */
+/* open() for -nc. */
+{
+  int fd;
+
+#ifdef O_NOATIME
+  /* only allowed for the owner (or CAP_FOWNER) */
+  if ((fd = open(name, flags | O_NOATIME)) < 0 && errno == EPERM)
+#endif
+    fd = open(name, flags);
+  if (fd < 0)
+    return fd;
+  nc_fd = fd;
+  nc_pos = nc_advised = nc_dropped = 0;
+  nc_have = nc_next = 0;
+  nc_direct = 0;
+#ifdef O_DIRECT
+  if (nocache == 2) {
+    if (nc_buf == NULL) {
+# ifdef NO_POSIX_MEMALIGN
+      nc_buf = (char *)valloc(DIRECT_BUFSZ);
+# else
+      if (posix_memalign((void **)&nc_buf, DIRECT_ALIGN, DIRECT_BUFSZ))
+        nc_buf = NULL;
+# endif
+    }
+    /* not all file systems take it (tmpfs), and then just advise */
+    if (nc_buf != NULL &&
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) == 0)
+      nc_direct = 1;
+  }
+#endif
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  nc_advise();
+  return fd;
+}
+
+
+local void nc_advise()
+/* Ask for the next window ahead of nc_pos and drop whole windows behind
+   it. */
+{
+  if (nc_direct)
+    return;
+  if (nc_pos + NOCACHE_WINDOW > nc_advised) {
+    posix_fadvise(nc_fd, nc_advised, NOCACHE_WINDOW, POSIX_FADV_WILLNEED);
+    nc_advised += NOCACHE_WINDOW;
+  }
+  if (nc_pos - nc_dropped >= NOCACHE_WINDOW) {
+    posix_fadvise(nc_fd, nc_dropped, nc_pos - nc_dropped,
+                  POSIX_FADV_DONTNEED);
+    nc_dropped = nc_pos;
+  }
+}
+
+
+local long nc_read(fd, buf, n)
+  int fd;               /* nc_fd */
+  char *buf;            /* where to put the data */
+  extent n;             /* bytes wanted */
+/* read() for -nc. */
+{
+  long r;
+  extent m;
+
+  if (!nc_direct) {
+    if ((r = (long)read(fd, buf, n)) > 0) {
+      nc_pos += r;
+      nc_advise();
+    }
+    return r;
+  }
+  if (nc_next == nc_have) {
+    /* aligned reads of whole blocks, only the last one comes up short */
+    r = (long)read(fd, nc_buf, DIRECT_BUFSZ);
+    if (r < 0 && errno == EINVAL) {
+      /* refused after all, read through the cache */
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+      nc_direct = 0;
+      return nc_read(fd, buf, n);
+    }
+    if (r <= 0)
+      return r;
+    nc_have = r;
+    nc_next = 0;
+  }
+  m = (extent)(nc_have - nc_next);
+  if (m > n)
+    m = n;
+  memcpy(buf, nc_buf + nc_next, m);
+  nc_next += (long)m;
+  nc_pos += (zoff_t)m;
+  return (long)m;
+}
+
+#endif /* IZ_NOCACHE */
+
+
+#ifdef IZ_SPARSE
+
+/* Sparse input files.
+ *
+ * VM images and database files are often mostly holes.  A file with at
+ * least SPARSE_MIN bytes fewer allocated than its size is read with
+ * lseek(SEEK_DATA) and lseek(SEEK_HOLE):  the holes are returned as
+ * zeros without reading them, one read never mixing hole and data, and
+ * ufile_zeros() tells iz_file_read() so it can add them to the crc with
+ * crc32_zeros().  Not for files read ahead (-ra) or kept out of the page
+ * cache (-nc).  One file is read at a time, so one set of state will do.
+ */
+
+#include <fcntl.h>
+#include <errno.h>
+
+#define SPARSE_MIN      0x10000L        /* 64 KiB of holes */
+
+local int sp_fd = -1;           /* sparse file being read, -1 if none */
+local zoff_t sp_size;           /* its size */
+local zoff_t sp_pos;            /* bytes returned */
+local zoff_t sp_data;           /* start of the data at or after sp_pos */
+local zoff_t sp_hole;           /* end of that data */
+local int sp_zeros;             /* last read was from a hole */
+
+local void sp_start OF((int));
+local long sp_read OF((int, char *, extent));
+
+
+local void sp_start(fd)
+  int fd;               /* file just opened */
+/* Take fd as the sparse file if it has holes. */
+{
+  struct stat s;
+
+  if (fstat(fd, &s) != 0 || !S_ISREG(s.st_mode) ||
+      (zoff_t)s.st_size - (zoff_t)s.st_blocks * 512 < SPARSE_MIN)
+    return;
+  sp_fd = fd;
+  sp_size = (zoff_t)s.st_size;
+  sp_pos = sp_data = sp_hole = 0;
+  sp_zeros = 0;
+}
+
+
+local long sp_read(fd, buf, n)
+  int fd;               /* sp_fd */
+  char *buf;            /* where to put the data */
+  extent n;             /* bytes wanted */
+/* read() for a sparse file. */
+{
+  zoff_t d;
+  long r;
+  int e;
+
+  sp_zeros = 0;
+  if (sp_pos >= sp_hole && sp_pos < sp_size) {
+    /* past the data found last time, look for more */
+    e = errno;                  /* ENXIO at a final hole is not an error */
+    if ((d = (zoff_t)lseek(fd, (off_t)sp_pos, SEEK_DATA)) < 0) {
+      if (errno != ENXIO) {
+        /* not supported by this file system after all */
+        sp_fd = -1;
+        if (lseek(fd, (off_t)sp_pos, SEEK_SET) < 0)
+          return -1L;
+        return (long)read(fd, buf, n);
+      }
+      d = sp_size;              /* a hole to the end */
+    }
+    sp_data = d;
+    sp_hole = sp_size;
+    if (d < sp_size &&
+        (sp_hole = (zoff_t)lseek(fd, (off_t)d, SEEK_HOLE)) < 0)
+      sp_hole = sp_size;
+    errno = e;
+    /* the next read() is at sp_pos, or after the hole */
+    if (lseek(fd, (off_t)(sp_pos > sp_data ? sp_pos : sp_data), SEEK_SET) < 0)
+      return -1L;
+  }
+  if (sp_pos < sp_data) {
+    /* in a hole */
+    if ((zoff_t)n > sp_data - sp_pos)
+      n = (extent)(sp_data - sp_pos);
+    memset(buf, 0, n);
+    sp_pos += (zoff_t)n;
+    sp_zeros = 1;
+    return (long)n;
+  }
+  /* data, up to the next hole */
+  if (sp_pos < sp_hole && (zoff_t)n > sp_hole - sp_pos)
+    n = (extent)(sp_hole - sp_pos);
+  if ((r = (long)read(fd, buf, n)) > 0)
+    sp_pos += r;
+  return r;
+}
+
+
+int ufile_sparse(fd)
+  int fd;               /* descriptor from zopen() */
+/* Return 1 if fd is read as a sparse file. */
+{
+  return fd >= 0 && fd == sp_fd;
+}
+
+
+int ufile_zeros(fd)
+  int fd;               /* descriptor from zopen() */
+/* Return 1 if the last zread() of fd returned zeros from a hole. */
+{
+  return fd >= 0 && fd == sp_fd && sp_zeros;
+}
+
+#endif /* IZ_SPARSE */
+
+
+/* ------------------------------------ */
+
+#if defined(IZ_URING) || defined(IZ_NOCACHE) || defined(IZ_SPARSE)
+
+/* Input file I/O for zipup() (zopen(), zread(), zrewind() and zclose()
+   in unix/zipup.h), for -nc, -ra and sparse files.  -nc takes
+   precedence:  files read ahead would go through the page cache.  Files
+   read ahead are not checked for holes. */
+
+int ufile_open(name, flags)
+  char *name;           /* file to open */
+  int flags;            /* open() flags */
+{
+  int fd;
+
+#ifdef IZ_NOCACHE
+  if (nocache)
+    return nc_open(name, flags);
+#endif
+#ifdef IZ_URING
+  fd = uring_open(name, flags);
+#else
+  fd = open(name, flags);
+#endif
+#ifdef IZ_SPARSE
+  if (fd >= 0 && !read_ahead)
+    sp_start(fd);
+#endif
+  return fd;
+}
+
+
+long ufile_read(fd, buf, n)
+  int fd;               /* descriptor from zopen() */
+  char *buf;            /* where to put the data */
+  extent n;             /* bytes wanted */
+{
+#ifdef IZ_NOCACHE
+  if (fd == nc_fd)
+    return nc_read(fd, buf, n);
+#endif
+#ifdef IZ_SPARSE
+  if (fd == sp_fd)
+    return sp_read(fd, buf, n);
+#endif
+#ifdef IZ_URING
+  return uring_read(fd, buf, n);
+#else
+  return (long)read(fd, buf, n);
+#endif
+}
+
+
+int ufile_rewind(fd)
+  int fd;               /* descriptor from zopen() */
+{
+#ifdef IZ_NOCACHE
+  if (fd == nc_fd) {
+    nc_pos = nc_advised = 0;
+    nc_have = nc_next = 0;
+    if (lseek(fd, 0, SEEK_SET) < 0)
+      return -1;
+    nc_advise();
+    return 0;
+  }
+#endif
+#ifdef IZ_SPARSE
+  if (fd == sp_fd)
+    sp_pos = sp_data = sp_hole = 0;
+#endif
+#ifdef IZ_URING
+  return uring_rewind(fd);
+#else
+  return lseek(fd, 0, SEEK_SET) < 0 ? -1 : 0;
+#endif
+}
+
+
+int ufile_close(fd)
+  int fd;               /* descriptor from zopen() */
+{
+#ifdef IZ_NOCACHE
+  if (fd == nc_fd) {
+    /* drop the rest, including any read ahead by the kernel */
+    if (!nc_direct)
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    nc_fd = -1;
+  }
+#endif
+#ifdef IZ_SPARSE
+  if (fd == sp_fd)
+    sp_fd = -1;
+#endif
+#ifdef IZ_URING
+  return uring_close(fd);
+#else
+  return close(fd);
+#endif
+}
+
+#endif /* IZ_URING || IZ_NOCACHE || IZ_SPARSE */
+
 
 #endif /* !UTIL */
 
@@ -17,9 +17,18 @@
 #define fhow (O_RDONLY|O_BINARY)
 #define fbad (-1)
 typedef int ftype;
-#define zopen(n,p) open(n,p)
-#define zread(f,b,n) read(f,b,n)
-#define zclose(f) close(f)
+#if defined(IZ_URING) || defined(IZ_NOCACHE) || defined(IZ_SPARSE)
+   /* input files may be read ahead (-ra), kept out of the page
+      cache (-nc) or sparse, see ufile_open() */
+#  define zopen(n,p) ufile_open(n,p)
+#  define zread(f,b,n) ufile_read(f,b,n)
+#  define zclose(f) ufile_close(f)
+#  define zrewind( f) (isatty( f) ? -1 : ufile_rewind(f))
+#else
+#  define zopen(n,p) open(n,p)
+#  define zread(f,b,n) read(f,b,n)
+#  define zclose(f) close(f)
+#  define zrewind( f) (isatty( f) ? -1 : lseek(f, 0, SEEK_SET))
+#endif
 #define zerr(f) (k == (extent)(-1L))
-#define zrewind( f) (isatty( f) ? -1 : lseek(f, 0, SEEK_SET))
 #define zstdin 0
@@ -17,10 +17,22 @@
 #include "ebcdic.h"
 #include <ctype.h>
 
+#ifdef IZ_SSSE3
+#  include <tmmintrin.h>
+#else
+#  ifdef IZ_SSE2
+#    include <emmintrin.h>
+#  endif
+#endif
+
 #ifdef MSDOS16
 #  include <dos.h>
 #endif
 
+#ifdef IZ_PSORT
+#  include <pthread.h>
+#endif
+
 #ifdef NO_MKTIME
 #  ifndef IZ_MKTIME_ONLY
 #    define IZ_MKTIME_ONLY      /* only mktime() related code is pulled in */
@@ -690,44 +702,393 @@ int namecmp(string1, string2)
 }
 
 
-#ifdef EBCDIC
+/* Name sort
+ *
+ * name_sort() sorts a table of pointers (to found list or zlist
+ * entries) in the order given by cmp, a qsort() compare function, and
+ * gives the same order as qsort() would.  The first bytes of each name
+ * are folded (fold NSORT_CASEMAP: case_map(), as namecmp() does;
+ * NSORT_LOWER: tolower(), as strcasecmp() does) and packed once into
+ * a key, so most compares are an integer compare and touch no name.
+ * Only names whose keys match go to cmp.  This needs cmp to order
+ * first by the folded bytes, which is true of namecmp() and of the
+ * ignore-case-first compares.
+ *
+ * The table is merge sorted.  With IZ_PSORT, a table of NSORT_PAR_MIN
+ * entries or more is cut in parts that are keyed and sorted by up to
+ * NSORT_THREADS threads, and the parts are then merged in pairs, also
+ * in threads.  If the memory for the keys is not there, this is just
+ * qsort().
+ */
+
+#define NSORT_KEYLEN ((int)sizeof(ulg))
+
+struct nsort_item {
+  ulg k0, k1;                   /* first 2 * NSORT_KEYLEN folded bytes */
+  zvoid *p;                     /* table entry */
+};
+
+struct nsort_part {
+  struct nsort_item *a;         /* items */
+  struct nsort_item *t;         /* scratch of the same size */
+  struct nsort_item *b;         /* second run to merge (merge only) */
+  extent n;                     /* items in a */
+  extent nb;                    /* items in b (merge only) */
+  zvoid **base;                 /* table entries to key (keying only) */
+  char *(*name) OF((ZCONST zvoid *));
+  int fold;
+  int (*cmp) OF((ZCONST zvoid *, ZCONST zvoid *));
+};
+
+local int nsort_cmp OF((ZCONST struct nsort_item *, ZCONST struct nsort_item *,
+                        int (*)(ZCONST zvoid *, ZCONST zvoid *)));
+local void nsort_merge OF((struct nsort_item *, struct nsort_item *, extent,
+                           struct nsort_item *, extent,
+                           int (*)(ZCONST zvoid *, ZCONST zvoid *)));
+local void nsort_run OF((struct nsort_item *, struct nsort_item *, extent,
+                         int (*)(ZCONST zvoid *, ZCONST zvoid *)));
+local zvoid *nsort_part OF((zvoid *));
+local zvoid *nsort_pair OF((zvoid *));
+
+
+local int nsort_cmp(x, y, cmp)
+  ZCONST struct nsort_item *x, *y;
+  int (*cmp) OF((ZCONST zvoid *, ZCONST zvoid *));
+{
+  if (x->k0 != y->k0)
+    return x->k0 < y->k0 ? -1 : 1;
+  if (x->k1 != y->k1)
+    return x->k1 < y->k1 ? -1 : 1;
+  return (*cmp)((ZCONST zvoid *)&x->p, (ZCONST zvoid *)&y->p);
+}
+
+
+local void nsort_merge(d, a, na, b, nb, cmp)
+  struct nsort_item *d;         /* destination, na + nb items */
+  struct nsort_item *a;         /* first sorted run */
+  extent na;
+  struct nsort_item *b;         /* second sorted run */
+  extent nb;
+  int (*cmp) OF((ZCONST zvoid *, ZCONST zvoid *));
+{
+  while (na && nb)
+  {
+    /* take from a on ties, so the merge is stable */
+    if (nsort_cmp(b, a, cmp) < 0) {
+      *d++ = *b++;
+      nb--;
+    } else {
+      *d++ = *a++;
+      na--;
+    }
+  }
+  while (na--)
+    *d++ = *a++;
+  while (nb--)
+    *d++ = *b++;
+}
+
+
+local void nsort_run(a, t, n, cmp)
+  struct nsort_item *a;         /* items to sort */
+  struct nsort_item *t;         /* scratch, n items */
+  extent n;
+  int (*cmp) OF((ZCONST zvoid *, ZCONST zvoid *));
+{
+  extent h, i, j;
+  struct nsort_item x;
+
+  if (n <= NSORT_INSERT)
+  {
+    for (i = 1; i < n; i++)
+    {
+      x = a[i];
+      for (j = i; j > 0 && nsort_cmp(&x, &a[j - 1], cmp) < 0; j--)
+        a[j] = a[j - 1];
+      a[j] = x;
+    }
+    return;
+  }
+  h = n / 2;
+  nsort_run(a, t, h, cmp);
+  nsort_run(a + h, t + h, n - h, cmp);
+  /* names often come in order (sorted directory reads, archives) */
+  if (nsort_cmp(&a[h - 1], &a[h], cmp) <= 0)
+    return;
+  memcpy(t, a, n * sizeof(struct nsort_item));
+  nsort_merge(a, t, h, t + h, n - h, cmp);
+}
+
+
+local zvoid *nsort_part(v)
+  zvoid *v;
+/* Key and sort one part of the table. */
+{
+  struct nsort_part *p = (struct nsort_part *)v;
+  struct nsort_item *a;
+  uch *s;
+  extent i;
+  int k;
+  ulg w[2];
+
+  for (i = 0, a = p->a; i < p->n; i++, a++)
+  {
+    a->p = p->base[i];
+    s = (uch *)(*p->name)(a->p);
+    w[0] = w[1] = 0;
+    for (k = 0; k < 2 * NSORT_KEYLEN; k++)
+    {
+      /* bytes after the end of the name are kept 0 */
+      w[k / NSORT_KEYLEN] = (w[k / NSORT_KEYLEN] << 8) |
+        (*s == 0 ? 0 :
+         (p->fold == NSORT_LOWER ? (uch)tolower(*s) : (uch)case_map(*s)));
+      if (*s)
+        s++;
+    }
+    a->k0 = w[0];
+    a->k1 = w[1];
+  }
+  nsort_run(p->a, p->t, p->n, p->cmp);
+  return NULL;
+}
+
+
+local zvoid *nsort_pair(v)
+  zvoid *v;
+/* Merge two sorted runs into t. */
+{
+  struct nsort_part *p = (struct nsort_part *)v;
+
+  nsort_merge(p->t, p->a, p->n, p->b, p->nb, p->cmp);
+  return NULL;
+}
+
+
+void name_sort(base, n, name, fold, cmp)
+  zvoid **base;                 /* table to sort */
+  extent n;                     /* entries in table */
+  char *(*name) OF((ZCONST zvoid *));   /* name to key an entry by */
+  int fold;                     /* NSORT_CASEMAP or NSORT_LOWER */
+  int (*cmp) OF((ZCONST zvoid *, ZCONST zvoid *));  /* as for qsort() */
+{
+  struct nsort_item *a;         /* items */
+  struct nsort_item *t;         /* scratch, and merge destination */
+  struct nsort_item *x;
+  struct nsort_part part[NSORT_THREADS];
+  extent size;
+  extent i;
+  int parts;                    /* sorted runs */
+  int j, k;
+#ifdef IZ_PSORT
+  pthread_t tid[NSORT_THREADS];
+  int started[NSORT_THREADS];
+  long ncpu;
+#endif
+
+  if (n < 2)
+    return;
+  size = n * sizeof(struct nsort_item);
+  if (size / sizeof(struct nsort_item) != n ||
+      (a = (struct nsort_item *)malloc(size)) == NULL)
+  {
+    qsort((char *)base, n, sizeof(zvoid *), cmp);
+    return;
+  }
+  if ((t = (struct nsort_item *)malloc(size)) == NULL)
+  {
+    free((zvoid *)a);
+    qsort((char *)base, n, sizeof(zvoid *), cmp);
+    return;
+  }
+
+  parts = 1;
+#ifdef IZ_PSORT
+  if (n >= NSORT_PAR_MIN)
+  {
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    parts = ncpu < 1 ? 1 : (ncpu > NSORT_THREADS ? NSORT_THREADS : (int)ncpu);
+  }
+#endif
+
+  /* cut the table in parts and key and sort each */
+  for (j = 0, i = 0; j < parts; j++)
+  {
+    part[j].base = base + i;
+    part[j].a = a + i;
+    part[j].t = t + i;
+    part[j].n = n / parts + ((extent)j < n % parts ? 1 : 0);
+    part[j].name = name;
+    part[j].fold = fold;
+    part[j].cmp = cmp;
+    i += part[j].n;
+  }
+#ifdef IZ_PSORT
+  /* part 0 is done here, as is any part that gets no thread */
+  for (j = 1; j < parts; j++)
+    started[j] = pthread_create(&tid[j], NULL, nsort_part,
+                                (zvoid *)&part[j]) == 0;
+  nsort_part((zvoid *)&part[0]);
+  for (j = 1; j < parts; j++)
+    if (started[j])
+      pthread_join(tid[j], NULL);
+    else
+      nsort_part((zvoid *)&part[j]);
+#else
+  nsort_part((zvoid *)&part[0]);
+#endif
+
+  /* merge runs in pairs into the other array until one is left */
+  while (parts > 1)
+  {
+    for (j = 0, k = 0; j < parts; j += 2, k++)
+    {
+      if (j + 1 < parts) {
+        part[k].b = part[j + 1].a;
+        part[k].nb = part[j + 1].n;
+      } else {
+        part[k].b = NULL;
+        part[k].nb = 0;
+      }
+      part[k].a = part[j].a;
+      part[k].n = part[j].n;
+      part[k].t = part[j].t;
+    }
+#ifdef IZ_PSORT
+    for (j = 1; j < k; j++)
+      started[j] = pthread_create(&tid[j], NULL, nsort_pair,
+                                  (zvoid *)&part[j]) == 0;
+    nsort_pair((zvoid *)&part[0]);
+    for (j = 1; j < k; j++)
+      if (started[j])
+        pthread_join(tid[j], NULL);
+      else
+        nsort_pair((zvoid *)&part[j]);
+#else
+    for (j = 0; j < k; j++)
+      nsort_pair((zvoid *)&part[j]);
+#endif
+    /* the merged runs are now in the other array */
+    for (j = 0; j < k; j++)
+    {
+      x = part[j].a;
+      part[j].a = part[j].t;
+      part[j].t = x;
+      part[j].n += part[j].nb;
+    }
+    parts = k;
+  }
+
+  for (i = 0, x = part[0].a; i < n; i++)
+    base[i] = x[i].p;
+  free((zvoid *)t);
+  free((zvoid *)a);
+}
+
+
+#ifdef IZ_EBCDIC_TABLES
+
+#ifdef IZ_SSSE3
+/* SSSE3 version of memxlate().  PSHUFB can look up only a 16-entry
+ * table, so the 256-entry table is handled as 16 rows of 16 bytes.  The
+ * low nibble of each input byte indexes every row at once, and the high
+ * nibble selects which of the 16 row results to keep.  Returns the
+ * number of bytes translated (a multiple of 16).
+ */
+IZ_TARGET("ssse3")
+local extent memxlate_ssse3(uch *dst, ZCONST uch *src, extent len,
+                            ZCONST uch *table)
+{
+  __m128i row[16];
+  __m128i nib_mask;
+  __m128i v, lo, hi, r;
+  extent done;
+  int h;
+
+  for (h = 0; h < 16; h++)
+    row[h] = _mm_loadu_si128((ZCONST __m128i *)(table + (h << 4)));
+  nib_mask = _mm_set1_epi8(0x0f);
+
+  for (done = 0; len - done >= 16; done += 16)
+  {
+    v = _mm_loadu_si128((ZCONST __m128i *)(src + done));
+    lo = _mm_and_si128(v, nib_mask);
+    hi = _mm_and_si128(_mm_srli_epi16(v, 4), nib_mask);
+    r = _mm_setzero_si128();
+    for (h = 0; h < 16; h++)
+    {
+      r = _mm_or_si128(r,
+            _mm_and_si128(_mm_cmpeq_epi8(hi, _mm_set1_epi8((char)h)),
+                          _mm_shuffle_epi8(row[h], lo)));
+    }
+    _mm_storeu_si128((__m128i *)(dst + done), r);
+  }
+  return done;
+}
+#endif /* IZ_SSSE3 */
+
+
+/* Translate len bytes from mem2 to mem1 through the 256-entry table
+ * (ascii[] or ebcdic[]).  mem1 may be the same as mem2.  This is the
+ * common kernel for the name and comment conversions below and for the
+ * text data translation in zipup.c.
+ */
+char *memxlate(char *mem1, ZCONST char *mem2, extent len, ZCONST uch *table)
+{
+  uch *d = (uch *)mem1;
+  ZCONST uch *s = (ZCONST uch *)mem2;
+
+#ifdef IZ_SSSE3
+# if defined(IZ_CPU_DISPATCH) && !defined(__SSSE3__)
+  if (cpu_features & CPU_SSSE3)
+# endif
+  {
+    extent done = memxlate_ssse3(d, s, len, table);
+
+    d += done;
+    s += done;
+    len -= done;
+  }
+#endif
+  while (len >= 4)
+  {
+    uch c0 = table[s[0]], c1 = table[s[1]];
+    uch c2 = table[s[2]], c3 = table[s[3]];
+
+    d[0] = c0; d[1] = c1; d[2] = c2; d[3] = c3;
+    d += 4;
+    s += 4;
+    len -= 4;
+  }
+  while (len--)
+    *d++ = table[*s++];
+  return mem1;
+}
+
+
 char *strtoasc(char *str1, ZCONST char *str2)
 {
-  char *old;
-  old = str1;
-  while (*str1++ = (char)ascii[(uch)(*str2++)]);
-  return old;
+  /* Translate the terminating NUL, too (ascii[0] == 0). */
+  return memxlate(str1, str2, strlen(str2) + 1, ascii);
 }
 
 
 char *strtoebc(char *str1, ZCONST char *str2)
 {
-  char *old;
-  old = str1;
-  while (*str1++ = (char)ebcdic[(uch)(*str2++)]);
-  return old;
+  return memxlate(str1, str2, strlen(str2) + 1, ebcdic);
 }
 
 
 char *memtoasc(char *mem1, ZCONST char *mem2, unsigned len)
 {
-  char *old;
-  old = mem1;
-  while (len--)
-     *mem1++ = (char)ascii[(uch)(*mem2++)];
-  return old;
+  return memxlate(mem1, mem2, (extent)len, ascii);
 }
 
 
 char *memtoebc(char *mem1, ZCONST char *mem2, unsigned len)
 {
-  char *old;
-  old = mem1;
-  while (len--)
-     *mem1++ = (char)ebcdic[(uch)(*mem2++)];
-  return old;
+  return memxlate(mem1, mem2, (extent)len, ebcdic);
 }
-#endif /* EBCDIC */
+#endif /* IZ_EBCDIC_TABLES */
 
 #ifdef IZ_ISO2OEM_ARRAY
 char *str_iso_to_oem(dst, src)
@@ -1055,13 +1416,34 @@ int printnames()
  * This function returns the same result as set_file_type() in "trees.c".
  * Unlike in set_file_type(), however, the speed depends on the buffer size,
  * so the optimal implementation is different.
+ *
+ * With IZ_CPU_DISPATCH, is_text_buf() calls through is_text_kernel, and
+ * this portable version is is_text_buf_c().
  */
+#ifdef IZ_CPU_DISPATCH
+int (*is_text_kernel) OF((ZCONST char *buf_ptr, size_t buf_size))
+  = is_text_buf_c;
+
 int is_text_buf(buf_ptr, buf_size)
     ZCONST char *buf_ptr;
-    unsigned buf_size;
+    size_t buf_size;
+{
+    if (all_ascii)
+      return 1;
+    return (*is_text_kernel)(buf_ptr, buf_size);
+}
+
+#  define IS_TEXT_BUF_C is_text_buf_c
+#else
+#  define IS_TEXT_BUF_C is_text_buf
+#endif
+
+int IS_TEXT_BUF_C(buf_ptr, buf_size)
+    ZCONST char *buf_ptr;
+    size_t buf_size;
 {
     int result = 0;
-    unsigned i;
+    size_t i;
     unsigned char c;
 
     /* If user wants all files handled as text, we're done.  This
@@ -1094,6 +1476,221 @@ int is_text_buf(buf_ptr, buf_size)
     return result;
 }
 
+#if defined(IZ_CPU_DISPATCH) && !defined(EBCDIC)
+/* SSE2 version of is_text_buf_c(), 16 bytes at a time.  A control
+ * character (c < 32) is black-listed unless it is 7 - 13 (BEL, BS, TAB,
+ * LF, VT, FF, CR), 26 or 27 (SUB, ESC).
+ */
+IZ_TARGET("sse2")
+int is_text_buf_sse2(buf_ptr, buf_size)
+    ZCONST char *buf_ptr;
+    size_t buf_size;
+{
+    int result = 0;
+    size_t i;
+    unsigned char c;
+    __m128i zero = _mm_setzero_si128();
+    __m128i v, ctl, ok;
+
+    for (i = 0; buf_size - i >= 16; i += 16)
+    {
+        v = _mm_loadu_si128((ZCONST __m128i *)(buf_ptr + i));
+        ctl = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xe0)),
+                             zero);
+        ok = _mm_or_si128(
+               _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(6)),
+                             _mm_cmplt_epi8(v, _mm_set1_epi8(14))),
+               _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(1)),
+                              _mm_set1_epi8(27)));
+        if (_mm_movemask_epi8(_mm_andnot_si128(ok, ctl)) != 0)
+            return 0;   /* black-listed character found; stop */
+        if (_mm_movemask_epi8(ctl) != 0xffff)
+            result = 1; /* white-listed character found; keep looking */
+    }
+
+    for (; i < buf_size; ++i)
+    {
+        c = (unsigned char)buf_ptr[i];
+        if (c >= 32)
+            result = 1;
+        else
+        if ((c <= 6) || (c >= 14 && c <= 25) || (c >= 28 && c <= 31))
+            return 0;
+    }
+
+    return result;
+}
+#endif /* IZ_CPU_DISPATCH && !EBCDIC */
+
+
+/* ascii_span() - length of the leading 7-bit ASCII run of a string.
+ *
+ * Returns the number of bytes at the start of s that are 7-bit ASCII
+ * (0x01 - 0x7f), or printable ASCII (0x20 - 0x7e) if printable is set.
+ * The terminating NUL never qualifies, so s[ascii_span(s, p)] == '\0'
+ * means the whole string qualifies.
+ *
+ * Most names are plain ASCII, so this is the fast path for the UTF-8
+ * and Unicode name handling in fileio.c.  Blocks are read only at their
+ * natural alignment, which keeps the reads from running into an
+ * unmapped page past the end of the string.
+ */
+extent ascii_span(ZCONST char *s, int printable)
+{
+  ZCONST uch *p = (ZCONST uch *)s;
+
+#define ASCII_SPAN_OK(c) \
+  (printable ? ((c) >= 0x20 && (c) < 0x7f) : ((c) != 0 && (c) < 0x80))
+
+  for (;;)
+  {
+    /* Byte at a time up to the next block boundary. */
+    for (; ((size_t)p & 15) != 0; p++)
+    {
+      if (!ASCII_SPAN_OK(*p))
+        return (extent)(p - (ZCONST uch *)s);
+    }
+
+#ifdef IZ_SSE2
+    {
+      /* Compare as signed bytes:  0x80 - 0xff are negative. */
+      __m128i low = _mm_set1_epi8(printable ? 0x1f : 0x00);
+      __m128i del = _mm_set1_epi8(0x7f);
+      __m128i v, ok;
+
+      for (;;)
+      {
+        v = _mm_load_si128((ZCONST __m128i *)p);
+        ok = _mm_cmpgt_epi8(v, low);
+        if (printable)
+          ok = _mm_and_si128(ok, _mm_cmplt_epi8(v, del));
+        if (_mm_movemask_epi8(ok) != 0xffff)
+          break;
+        p += 16;
+      }
+    }
+#else /* def IZ_SSE2 */
+    if (!printable)
+    {
+      /* Word at a time:  stop at a word holding a NUL or a high bit. */
+      size_t w;
+      size_t ones = (size_t)-1 / 0xff;          /* 0x0101...01 */
+      size_t highs = ones << 7;                 /* 0x8080...80 */
+
+      for (;;)
+      {
+        memcpy(&w, p, sizeof(w));
+        if (((w - ones) & ~w & highs) || (w & highs))
+          break;
+        p += sizeof(w);
+      }
+    }
+#endif /* def IZ_SSE2 [else] */
+
+    /* Find the byte that ended the block scan (or finish the block). */
+    {
+      ZCONST uch *block_end = p + 16;
+
+      for (; p < block_end; p++)
+      {
+        if (!ASCII_SPAN_OK(*p))
+          return (extent)(p - (ZCONST uch *)s);
+      }
+    }
+  }
+#undef ASCII_SPAN_OK
+}
+
+
+#ifdef IZ_CPU_DISPATCH
+#include <cpuid.h>
+
+int cpu_features = 0;           /* CPU_ bits found by cpu_dispatch_init() */
+
+/* cpu_dispatch_init() - probe the CPU and select the kernels.
+ *
+ * Called once, early in main(), before any file is read.  CPUID leaf 1
+ * has all the feature bits used here.  Each kernel pointer is left at
+ * its portable C version unless the CPU has what the faster one needs.
+ */
+void cpu_dispatch_init()
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  cpu_features = 0;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+  {
+    if (edx & (1U << 26))
+      cpu_features |= CPU_SSE2;
+    if (ecx & (1U << 9))
+      cpu_features |= CPU_SSSE3;
+    if (ecx & (1U << 19))
+      cpu_features |= CPU_SSE41;
+    if (ecx & (1U << 1))
+      cpu_features |= CPU_PCLMUL;
+  }
+
+#ifndef EBCDIC
+  if (cpu_features & CPU_SSE2)
+    is_text_kernel = is_text_buf_sse2;
+#endif
+#ifdef DISPATCH_CRC32
+  if ((cpu_features & (CPU_SSE41 | CPU_PCLMUL)) == (CPU_SSE41 | CPU_PCLMUL))
+    crc32_kernel = crc32_pclmul;
+#endif
+#ifdef DISPATCH_LONGEST_MATCH
+  if (cpu_features & CPU_SSE2)
+    longest_match_kernel = longest_match_sse2;
+#endif
+#ifdef DISPATCH_LF_TO_CRLF
+  if (cpu_features & CPU_SSE2)
+    lf_to_crlf_kernel = lf_to_crlf_sse2;
+#endif
+}
+
+
+/* cpu_dispatch_string() - describe the CPU features found and the
+ * kernels chosen, for zip -v.  Returns a static buffer.
+ */
+char *cpu_dispatch_string()
+{
+  static char buf[160];
+
+  buf[0] = '\0';
+  if (cpu_features & CPU_SSE2)
+    strcat(buf, "SSE2 ");
+  if (cpu_features & CPU_SSSE3)
+    strcat(buf, "SSSE3 ");
+  if (cpu_features & CPU_SSE41)
+    strcat(buf, "SSE4.1 ");
+  if (cpu_features & CPU_PCLMUL)
+    strcat(buf, "PCLMUL ");
+  if (buf[0] == '\0')
+    strcat(buf, "(none) ");
+
+  strcat(buf, "-> text ");
+  strcat(buf, is_text_kernel == is_text_buf_c ? "C" : "SSE2");
+#ifdef DISPATCH_CRC32
+  strcat(buf, ", crc32 ");
+  strcat(buf, crc32_kernel == crc32_c ? "C" : "PCLMUL");
+#endif
+#ifdef DISPATCH_LONGEST_MATCH
+  strcat(buf, ", match ");
+  strcat(buf, longest_match_kernel == longest_match_c ? "C" : "SSE2");
+#endif
+#ifdef DISPATCH_LF_TO_CRLF
+  strcat(buf, ", eol ");
+  strcat(buf, lf_to_crlf_kernel == lf_to_crlf_c ? "C" : "SSE2");
+#endif
+#ifdef IZ_EBCDIC_TABLES
+  strcat(buf, ", xlate ");
+  strcat(buf, (cpu_features & CPU_SSSE3) ? "SSSE3" : "C");
+#endif
+
+  return buf;
+}
+#endif /* IZ_CPU_DISPATCH */
+
 
 /* Below is used to format zoff_t values, which can be either long or long long
    depending on if LARGE FILES are supported.  Function provided by SMS.
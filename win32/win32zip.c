@@ -1097,7 +1097,7 @@ local int procname_win32(n, caseflag, attribs)
         z->mark = pcount ? filter(z->zname, caseflag) : 1;
         if (verbose)
             zfprintf(mesg, "zip diagnostic: %scluding %s\n",
-               z->mark ? "in" : "ex", z->oname);
+               z->mark ? "in" : "ex", ZONAME(z));
         m = 0;
       }
     }
@@ -1122,9 +1122,9 @@ local int procname_win32(n, caseflag, attribs)
           z->mark = pcount ? filter(uname, caseflag) : 1;
           if (verbose) {
               zfprintf(mesg, "zip diagnostic: %scluding %s\n",
-                 z->mark ? "in" : "ex", z->oname);
+                 z->mark ? "in" : "ex", ZONAME(z));
               zfprintf(mesg, "     Escaped Unicode:  %s\n",
-                 z->ouname);
+                 ZOUNAME(z));
           }
           m = 0;
         }
@@ -1263,7 +1263,7 @@ local int procname_win32w(nw, caseflag, attribs)
         free(uzname);
         if (verbose)
             zfprintf(mesg, "zip diagnostic: %scluding %s\n",
-               z->mark ? "in" : "ex", z->oname);
+               z->mark ? "in" : "ex", ZONAME(z));
         m = 0;
       }
     }
@@ -1285,7 +1285,7 @@ local int procname_win32w(nw, caseflag, attribs)
             printf("\n");
 
             printf("e o = ");
-            for (i = 0; z->oname[i]; i++) printf(" %02i", z->oname[i]);
+            for (i = 0; ZONAME(z)[i]; i++) printf(" %02i", ZONAME(z)[i]);
             printf("\n");
 
             printf("e u = ");
@@ -1301,9 +1301,9 @@ local int procname_win32w(nw, caseflag, attribs)
             z->mark = pcount ? filter(z->iname, caseflag) : 1;
             if (verbose) {
                 zfprintf(mesg, "zip diagnostic: %scluding %s\n",
-                   z->mark ? "in" : "ex", z->oname);
+                   z->mark ? "in" : "ex", ZONAME(z));
                 zfprintf(mesg, "     Escaped Unicode:  %s\n",
-                   z->ouname);
+                   ZOUNAME(z));
             }
             m = 0;
           }
@@ -120,6 +120,17 @@ local int unzip_verbose = 0;  /* 1=use "unzip -t" instead of "unzip -tqq" */
 local int tempdir = 0;  /* 1=use temp directory (-b) */
 local int junk_sfx = 0; /* 1=junk the sfx prefix */
 local int show_zip_comment = 0; /* 1=show zipfile comment and exit */
+local int bad_open_is_error = 0; /* if read fails, 0=warning, 1=error */
+
+/* used by scan_files(), keep_found() and zipup_found() */
+local struct zlist far * far *zf_w;     /* where the next new entry goes */
+local int zf_open_err = 0;      /* 1 = a file could not be read */
+local char *tempzbase = NULL;   /* -sz: last part of tempzip, if to leave out */
+local z_stat tempzstat;         /* -sz: stat of tempzip */
+#ifdef IZ_URING
+local ulg ra_seq = 0;           /* place of the next file to read ahead */
+local ulg f_seq = 0;            /* place of the file being added */
+#endif
 
 /* aSc added for lcc */
 #ifdef LCC_WIN32
@@ -255,6 +266,17 @@ local long add_name OF((char *filearg, int verbatim));
 local int DisplayRunningStats OF((void));
 local int BlankRunningStats OF((void));
 
+#ifdef INPLACE_UPDATE
+local int inplace_delete_from OF((uzoff_t *));
+#endif
+
+local int show_stream_entry OF((struct zlist far *));
+local int show_files_stream OF((void));
+local void show_files_total OF((uzoff_t, uzoff_t));
+local void scan_files OF((void));
+local int keep_found OF((struct flist far *));
+local int is_tempzip OF((struct flist far *));
+
 local void version_info OF((void));
 
 # if !defined(WINDLL) && !defined(MACOS)
@@ -307,11 +329,11 @@ local void freeup()
   {
     z = zfiles->nxt;
     if (zfiles->zname && zfiles->zname != zfiles->name)
-      free((zvoid *)(zfiles->zname));
+      name_free((zvoid *)(zfiles->zname));
     if (zfiles->name)
-      free((zvoid *)(zfiles->name));
+      name_free((zvoid *)(zfiles->name));
     if (zfiles->iname)
-      free((zvoid *)(zfiles->iname));
+      name_free((zvoid *)(zfiles->iname));
     if (zfiles->cext && zfiles->cextra && zfiles->cextra != zfiles->extra)
       free((zvoid *)(zfiles->cextra));
     if (zfiles->ext && zfiles->extra)
@@ -319,10 +341,10 @@ local void freeup()
     if (zfiles->com && zfiles->comment)
       free((zvoid *)(zfiles->comment));
     if (zfiles->oname)
-      free((zvoid *)(zfiles->oname));
+      name_free((zvoid *)(zfiles->oname));
 #ifdef UNICODE_SUPPORT
     if (zfiles->uname)
-      free((zvoid *)(zfiles->uname));
+      name_free((zvoid *)(zfiles->uname));
     if (zfiles->zuname)
       free((zvoid *)(zfiles->zuname));
     if (zfiles->ouname)
@@ -336,10 +358,13 @@ local void freeup()
       free((zvoid *)(zfiles->znamew));
 # endif
 #endif
-    farfree((zvoid far *)zfiles);
+    zlist_free(zfiles);
     zfiles = z;
     zcount--;
   }
+  zlist_blocks_free();
+  /* the names left in either list came from name_alloc() */
+  name_arena_free();
 
   if (patterns != NULL) {
     while (pcount-- > 0) {
@@ -755,6 +780,27 @@ ZCONST char *h;         /* message about how it happened */
       tempzip = NULL;
     } else {
       /* -g option, attempt to restore the old file */
+#ifdef INPLACE_UPDATE
+      /* The archive is only written to while its journal is there (from
+         journal_begin() to journal_commit()).  With no journal there is
+         nothing to put back, and the old central directory must not be
+         written over an update that is already on disk. */
+      if (y != NULL)
+        fclose(y);
+      y = NULL;
+      if (journal_active()) {
+        zfprintf(mesg, "attempting to restore %s to its previous state\n",
+           zipfile);
+        if (logfile)
+          zfprintf(logfile, "attempting to restore %s to its previous state\n",
+             zipfile);
+
+        /* Put back what the update overwrote, from the journal. */
+        if (journal_rollback() != ZE_OK) {
+          zipwarn("could not restore archive, see journal for ", zipfile);
+        }
+      }
+#else /* !INPLACE_UPDATE */
 
       /* zip64 support 09/05/2003 R.Nausedat */
       uzoff_t k = 0;                        /* keep count for end header */
@@ -768,6 +814,9 @@ ZCONST char *h;         /* message about how it happened */
         zfprintf(logfile, "attempting to restore %s to its previous state\n",
            zipfile);
 
+      /* headers batched before the error were never written, and must
+         not be written after these */
+      cen_batch_drop();
       zfseeko(y, cenbeg, SEEK_SET);
 
       tempzn = cenbeg;
@@ -780,6 +829,7 @@ ZCONST char *h;         /* message about how it happened */
       putend(k, tempzn - cb, cb, zcomlen, zcomment);
       fclose(y);
       y = NULL;
+#endif /* ?INPLACE_UPDATE */
     }
   }
 
@@ -2339,6 +2389,39 @@ local void help_extended()
 "              compatible with more unzips.)  Using this option could",
 "              require an additional file copy if on another device.",
 "",
+"    --write-buffer size  set output buffer size (default 4m)",
+"              Archive (and split) writes are collected in a buffer of",
+"              this size, so each write to disk is large.  Larger values",
+"              can help on network and FUSE file systems.  With no",
+"              multiplier (k, m, g), size is in MB.  Long option only,",
+"              as -ob is -o -b.",
+"",
+"    --prealloc size  set archive preallocation step, e.g. 64m (default",
+"              0 = off).  Disk space for the archive is reserved this much",
+"              at a time ahead of the writes (Linux fallocate()), so large",
+"              archives are laid out in few extents.  Space left over at",
+"              the end is freed.  With no multiplier (k, m, g), size is in",
+"              MB.  Long option only, as -pr is -p -r.",
+"",
+"    -nc       keep input files out of the page cache",
+"              Files being added are read with posix_fadvise() hints and",
+"              dropped from the cache as they are read, so a backup run",
+"              does not evict the working set of other programs.  -nc=direct",
+"              reads them with O_DIRECT (Linux), bypassing the cache.",
+"              Turns off -ra.",
+"",
+"    -ra       read ahead input files (Linux io_uring)",
+"              While one file is compressed, the next ones are opened and",
+"              their first 64 KB read in the background.  Helps with trees",
+"              of many small files.  Not used when storing links (-y).",
+"",
+"    -sz       zip the files of a new archive as they are found",
+"              Compressing starts with the first files the scan finds",
+"              instead of after the whole scan, and the list of files",
+"              found never holds more than a batch.  Files are added in",
+"              the order found, not sorted.  Only for new archives, not",
+"              with -d, -f, -u, -U, -g, -FS, -sf or split archives.",
+"",
 "Zip error codes:",
 "  This section to be expanded soon.  Zip error codes are detailed in the",
 "  Zip Manual (man page).",
@@ -2468,6 +2551,18 @@ local void version_info()
 # ifdef BIG_MEM
     "BIG_MEM",
 # endif
+# ifdef IZ_URING
+    "IZ_URING             (io_uring read-ahead of input files: -ra)",
+# endif
+# ifdef IZ_NOCACHE
+    "IZ_NOCACHE           (keep input files out of page cache: -nc)",
+# endif
+# ifdef IZ_MAPIN
+    "IZ_MAPIN             (memory-mapped input files, all methods)",
+# endif
+# ifdef IZ_PREALLOC
+    "IZ_PREALLOC          (preallocate archive with fallocate(): --prealloc)",
+# endif
 # ifdef MEDIUM_MEM
     "MEDIUM_MEM",
 # endif
@@ -2786,6 +2881,11 @@ local void version_info()
     zprintf("\n");
   }
 
+#ifdef IZ_CPU_DISPATCH
+  zprintf("CPU features and kernels:  %s\n", cpu_dispatch_string());
+  zprintf("\n");
+#endif
+
   /* Show option environment variables (unconditionally). */
   show_env(0);
 
@@ -2946,7 +3046,7 @@ local ulg get_needed_unzip_features()
                                               &comp_method);
       if (result == 0) {
         /* no AES_WG extra field */
-        zipwarn("file AES WG encrypted, but missing extra field: ", z->oname);
+        zipwarn("file AES WG encrypted, but missing extra field: ", ZONAME(z));
       }
       else {
         /* note actual compression method */
@@ -5033,6 +5133,213 @@ local int BlankRunningStats()
 }
 
 
+#ifdef INPLACE_UPDATE
+
+/* Room to leave between the write and read positions when entries are
+   moved down in place.  zipcopy() rewrites each local header, which can
+   grow it a little (Zip64 extra field). */
+#define INPLACE_SLACK 64
+
+local int inplace_delete_from(from)
+  uzoff_t *from;        /* returns offset of first entry to delete */
+/* Return true if the entries marked for deletion can be removed by
+   moving the entries after them down in place (journaled, see
+   journal_begin()) instead of copying the archive.  All entries must be
+   on one disk in offset order, there must always be room between the
+   write and read positions, and the bytes from the first deleted entry
+   on (moved and journaled, so written twice) must be less than half the
+   archive, so this costs less than a copy. */
+{
+  struct zlist far *z;  /* steps through zfiles */
+  uzoff_t end;          /* end of entry z */
+  uzoff_t gap = 0;      /* bytes freed so far */
+  uzoff_t moved = 0;    /* entries moved so far */
+  int found = 0;        /* seen first deleted entry */
+
+  for (z = zfiles; z != NULL; z = z->nxt) {
+    end = z->nxt != NULL ? z->nxt->off : cenbeg;
+    if (z->dsk != 0 || end <= z->off)
+      return 0;
+    if (z->mark == 1) {
+      if (!found) {
+        *from = z->off;
+        found = 1;
+      }
+      gap += end - z->off;
+    } else if (found) {
+      moved++;
+      if (gap < moved * INPLACE_SLACK)
+        return 0;
+    }
+  }
+  return found && cenbeg - *from < cenbeg / 2;
+}
+
+#endif /* INPLACE_UPDATE */
+
+
+/* Streaming show files
+ *
+ * When -sf, -su or -sU only lists the archive, the entries are shown
+ * as zlist_stream() reads them instead of after readzipfile() has read
+ * them all, so the listing starts at once, memory does not grow with
+ * the archive, and a listing piped into head stops when head does.
+ */
+
+local uzoff_t sf_count;         /* entries listed */
+local uzoff_t sf_bytes;         /* their uncompressed size */
+
+local int show_stream_entry(z)
+  struct zlist far *z;
+/* zlist_stream() visitor.  Show z as the show files loop in main() does
+   for the archive alone.  Return 1 to stop once mesg can't be written. */
+{
+  sf_count++;
+  if ((zoff_t)z->len > 0)
+    sf_bytes += z->len;
+  if (!noisy || !(show_files == 1 || show_files == 3 || show_files == 5))
+    return 0;
+
+#ifdef UNICODE_SUPPORT
+  if (show_files == 5 && ZOUNAME(z) != NULL) {
+    /* sU */
+    zfprintf(mesg, "  %s", ZOUNAME(z));
+  } else if (show_files != 5 && unicode_show && z->uname) {
+    print_utf8("  ");
+    print_utf8(z->uname);
+  } else
+#endif
+    zfprintf(mesg, "  %s", ZONAME(z));
+#ifdef UNICODE_SUPPORT
+  if (show_files == 3 && ZOUNAME(z) != NULL) {
+    /* su */
+    zfprintf(mesg, "\n     Escaped Unicode:  %s", ZOUNAME(z));
+  }
+#endif
+  if (sf_usize) {
+    WriteNumString(z->len, errbuf);
+    zfprintf(mesg, "  (%s)", errbuf);
+  }
+  zfprintf(mesg, "\n");
+
+  if (sf_comment && z->com) {
+    char *tempc;
+    char *c;
+
+    /* display file comment on new line, indenting all lines */
+    tempc = string_replace(z->comment, "\n", "\n    ", REPLACE_ALL, CASE_INS);
+    c = string_cat("    ", tempc, "sf_comment", NO_FLUFF);
+    free(tempc);
+    print_utf8(c);
+    zfprintf(mesg, "\n");
+    free(c);
+  }
+  return ferror(mesg) != 0;
+}
+
+local int show_files_stream()
+/* List the archive opened by zlist_stream_open() with zlist_stream(). */
+{
+  int r;
+
+  zipfile_exists = 1;
+  if (noisy) {
+    fflush(mesg);
+    if (show_files == 1 || show_files == 3 || show_files == 5) {
+      if (mesg_line_started) {
+        zfprintf(mesg, "\n");
+        mesg_line_started = 0;
+      }
+      zfprintf(mesg, "Archive contains:\n");
+    }
+  }
+  sf_count = sf_bytes = 0;
+  if ((r = zlist_stream(show_stream_entry)) != ZE_OK)
+    return r;
+  if (!ferror(mesg))
+    show_files_total(sf_count, sf_bytes);
+  return ZE_OK;
+}
+
+local void show_files_total(count, bytes)
+  uzoff_t count;         /* entries listed */
+  uzoff_t bytes;         /* their uncompressed size */
+/* Show the totals line and, with -sF zcomment, the zipfile comment at the
+   end of a show files listing. */
+{
+  if (!(filesync && show_files)) {
+    char e[10];
+    char b[10];
+
+    if (count == 1)
+      strcpy(e, "entry");
+    else
+      strcpy(e, "entries");
+    
+    if (bytes == 1)
+      strcpy(b, "byte");
+    else
+      strcpy(b, "bytes");
+
+    WriteNumString(bytes, errbuf);
+    if (noisy || logfile == NULL) {
+      if (bytes < 1024) {
+        zfprintf(mesg, "Total %s %s (%s %s)\n",
+                                            zip_fuzofft(count, NULL, NULL),
+                                            e,
+                                            zip_fuzofft(bytes, NULL, NULL),
+                                            b);
+      } else {
+        zfprintf(mesg, "Total %s %s (%s %s (%s))\n",
+                                            zip_fuzofft(count, NULL, NULL),
+                                            e,
+                                            zip_fuzofft(bytes, NULL, NULL),
+                                            b,
+                                            errbuf);
+      }
+    }
+    if (logfile) {
+      if (bytes < 1024) {
+        zfprintf(logfile, "Total %s %s (%s %s)\n",
+                                            zip_fuzofft(count, NULL, NULL),
+                                            e,
+                                            zip_fuzofft(bytes, NULL, NULL),
+                                            b);
+      } else {
+        zfprintf(logfile, "Total %s %s (%s %s (%s))\n",
+                                            zip_fuzofft(count, NULL, NULL),
+                                            e,
+                                            zip_fuzofft(bytes, NULL, NULL),
+                                            b,
+                                            errbuf);
+      }
+    }
+  }
+  if (sf_zcomment) {
+    zprintf("\nzipfile comment:\n");
+    if (logfile) {
+      fprintf(logfile, "\nzipfile comment:\n");
+    }
+    if (zcomment) {
+      print_utf8("----------\n");
+      print_utf8(zcomment);
+      if (zcomment[zcomlen-1] != '\n') {
+        print_utf8("\n");
+      }
+      print_utf8("----------\n");
+      if (logfile) {
+        fwrite("----------\n", 1, 11, logfile);
+        fwrite(zcomment, 1, zcomlen, logfile);
+        if (zcomment[zcomlen-1] != '\n') {
+          putc('\n', logfile);
+        }
+        fwrite("----------\n", 1, 11, logfile);
+      }
+    }
+  }
+}
+
+
 #ifndef NO_PROTO
 char *replace_newline_escapes(char *instr)
 #else
@@ -6324,6 +6631,11 @@ void check_path(path, option_name)
 #define o_vn            0x203
 #define o_et            0x204
 #define o_exex          0x205
+#define o_ob            0x206
+#define o_ra            0x207
+#define o_nc            0x208
+#define o_pr            0x209
+#define o_sz            0x20B
 
 
 /* the below is mainly from the old main command line
@@ -6472,11 +6784,13 @@ struct option_struct far options[] = {
     {"MV", "mvs",         o_REQUIRED_VALUE, o_NOT_NEGATABLE, o_MV, "MVS path translate (dots, slashes, lastdot)"},
 #endif /* CMS_MVS */
     {"n",  "suffixes",    o_REQUIRED_VALUE, o_NOT_NEGATABLE, 'n',  "suffixes to not compress: .gz:.zip"},
+    {"nc", "no-cache",    o_OPT_EQ_VALUE,   o_NOT_NEGATABLE, o_nc, "keep input files out of page cache (nc=direct O_DIRECT)"},
     {"nw", "no-wild",     o_NO_VALUE,       o_NOT_NEGATABLE, o_nw, "no wildcards during add or update"},
 #if defined(AMIGA) || defined(MACOS)
     {"N",  "notes",       o_NO_VALUE,       o_NOT_NEGATABLE, 'N',  "add notes as entry comments"},
 #endif
     {"o",  "latest-time", o_NO_VALUE,       o_NOT_NEGATABLE, 'o',  "use latest entry time as archive time"},
+    {"",   "write-buffer",o_REQUIRED_VALUE, o_NOT_NEGATABLE, o_ob, "set output buffer size - default 4M bytes"},
     {"O",  "output-file", o_REQUIRED_VALUE, o_NOT_NEGATABLE, 'O',  "set out zipfile different than in zipfile"},
     {"p",  "paths",       o_NO_VALUE,       o_NEGATABLE,     'p',  "store paths"},
     {"p0", "print0",      o_NO_VALUE,       o_NOT_NEGATABLE, o_p0, "accept 'find -print0' output ('\\0' terms)"},
@@ -6484,6 +6798,7 @@ struct option_struct far options[] = {
     {"pn", "non-ansi-password", o_NO_VALUE, o_NEGATABLE,     o_pn, "allow non-ANSI password"},
     {"ps", "allow-short-pass", o_NO_VALUE,  o_NEGATABLE,     o_ps, "allow short password"},
     {"pp", "prefix-path", o_REQUIRED_VALUE, o_NOT_NEGATABLE, o_pp, "add prefix to all paths in archive"},
+    {"",   "prealloc",    o_REQUIRED_VALUE, o_NOT_NEGATABLE, o_pr, "set archive preallocation step - default 0 (off)"},
     {"pt", "performance-time", o_NO_VALUE,  o_NEGATABLE,     o_pt, "time execution of zip"},
     {"pu", "pswd-to-unzip", o_NO_VALUE,     o_NEGATABLE,     o_pu, "pass password to unzip for test"},
 #ifdef IZ_CRYPT_ANY
@@ -6495,6 +6810,7 @@ struct option_struct far options[] = {
     {"q",  "quiet",       o_NO_VALUE,       o_NOT_NEGATABLE, 'q',  "quiet"},
     {"r",  "recurse-paths", o_NO_VALUE,     o_NOT_NEGATABLE, 'r',  "recurse down listed paths"},
     {"R",  "recurse-patterns", o_NO_VALUE,  o_NOT_NEGATABLE, 'R',  "recurse current dir and match patterns"},
+    {"ra", "read-ahead",  o_NO_VALUE,       o_NEGATABLE,     o_ra, "open and read input files ahead"},
     {"RE", "regex",       o_NO_VALUE,       o_NOT_NEGATABLE, o_RE, "allow [list] matching (regex)"},
     {"s",  "split-size",  o_REQUIRED_VALUE, o_NOT_NEGATABLE, 's',  "do splits, set split size (-s=0 no splits)"},
     {"sb", "split-bell",  o_NO_VALUE,       o_NEGATABLE,     o_sb, "when pause for next split ring bell"},
@@ -6521,6 +6837,7 @@ struct option_struct far options[] = {
 #endif
     {"su", "show-unicode", o_NO_VALUE,      o_NEGATABLE,     o_su, "as -sf but also show escaped Unicode"},
     {"sU", "show-only-unicode", o_NO_VALUE, o_NEGATABLE,     o_sU, "as -sf but only show escaped Unicode"},
+    {"sz", "scan-and-zip",o_NO_VALUE,       o_NEGATABLE,     o_sz, "zip files of new archive as they are found"},
 #if defined(MSDOS) || defined(OS2) || defined(WIN32) || defined(ATARI)
     {"S",  "",            o_NO_VALUE,       o_NOT_NEGATABLE, 'S',  "include system and hidden"},
 #endif /* MSDOS || OS2 || WIN32 || ATARI */
@@ -6613,6 +6930,8 @@ char **argv;            /* command line tokens */
    command help in help() above. */
 {
   int d;                /* true if just adding to a zip file */
+  int grow;             /* true if -g, update the archive in place */
+  uzoff_t grow_from;    /* if d, where the archive is rewritten from */
   char *e;              /* malloc'd comment buffer */
   struct flist far *f;  /* steps through found linked list */
   int i;                /* arg counter, root directory flag */
@@ -6636,17 +6955,11 @@ char **argv;            /* command line tokens */
   struct zlist far * far *w;    /* pointer to last link in zfiles list */
   FILE *x /*, *y */;    /* input and output zip files (y global) */
   struct zlist far *z;  /* steps through zfiles linked list */
-  int bad_open_is_error = 0; /* if read fails, 0=warning, 1=error */
 #ifdef ZIP_DLL_LIB
   int retcode;          /* return code for dll */
 #endif /* ZIP_DLL_LIB */
-#if (!defined(VMS) && !defined(CMS_MVS))
-  char *zipbuf;         /* stdio buffer for the zip file */
-#endif /* !VMS && !CMS_MVS */
   int all_current;      /* used by File Sync to determine if all entries are current */
 
-  struct filelist_struct *filearg;
-
 /* used by get_option */
   unsigned long option; /* option ID returned by get_option */
   int argcnt = 0;       /* current argcnt in args */
@@ -7188,6 +7501,9 @@ char **argv;            /* command line tokens */
   comment_stream = (FILE *)stdin;
 
   init_upper();           /* build case map table */
+#ifdef IZ_CPU_DISPATCH
+  cpu_dispatch_init();    /* pick CRC, match, text kernels for this CPU */
+#endif
 
 #ifdef LARGE_FILE_SUPPORT
   /* test if we can support large files - 9/29/04 */
@@ -8367,12 +8683,57 @@ char **argv;            /* command line tokens */
                        characters */
           no_wild = 1;
           break;
+        case o_nc:  /* Keep input files out of the page cache */
+#ifdef IZ_NOCACHE
+          nocache = 1;
+          if (value) {
+            if (abbrevmatch("direct", value, CASE_INS, MIN_ABBREV_MATCH(1))) {
+              nocache = 2;
+            } else {
+              sprintf(errbuf, "-nc:  only =direct allowed, not '%s'", value);
+              free(value);
+              ZIPERR(ZE_PARMS, errbuf);
+            }
+            free(value);
+          }
+#else
+          if (value)
+            free(value);
+          zipwarn("-nc (--no-cache) not supported in this build, ignored", "");
+#endif
+          break;
 #if defined(AMIGA) || defined(MACOS)
         case 'N':   /* Get zipfile comments from AmigaDOS/MACOS filenotes */
           filenotes = 1; break;
 #endif
         case 'o':   /* Set zip file time to time of latest file in it */
           latest = 1;  break;
+        case o_ob:  /* Set stdio buffer size for the output archive */
+          {
+            uzoff_t obsize;
+
+            obsize = ReadNumString(value);
+            if (obsize == (uzoff_t)-1) {
+              sprintf(errbuf,
+                      "option --write-buffer has bad size:  '%s'",
+                      value);
+              free(value);
+              ZIPERR(ZE_PARMS, errbuf);
+            }
+            if (obsize < 0x400) {
+              /* < 1 KB so there is no multiplier, assume MiB */
+              obsize *= 0x100000;
+            }
+            if (obsize < 0x1000 || obsize > 0x40000000) {
+              sprintf(errbuf,
+                      "output buffer must be 4 KB to 1 GB:  '%s'", value);
+              free(value);
+              ZIPERR(ZE_PARMS, errbuf);
+            }
+            outbuf_size = (extent)obsize;
+            free(value);
+          }
+          break;
         case 'O':   /* Set output file different than input archive */
           if (strcmp( value, "-") == 0)
           {
@@ -8425,6 +8786,32 @@ char **argv;            /* command line tokens */
           path_prefix = value;
           path_prefix_mode = 0;
           break;
+        case o_pr:  /* Set preallocation step for the output archive */
+          {
+            uzoff_t prsize;
+
+            prsize = ReadNumString(value);
+            if (prsize == (uzoff_t)-1) {
+              sprintf(errbuf,
+                      "option --prealloc has bad size:  '%s'",
+                      value);
+              free(value);
+              ZIPERR(ZE_PARMS, errbuf);
+            }
+            if (prsize < 0x400) {
+              /* < 1 KB so there is no multiplier, assume MiB */
+              prsize *= 0x100000;
+            }
+#ifndef IZ_PREALLOC
+            if (prsize != 0) {
+              zipwarn("--prealloc not supported in this build, ignored",
+                      "");
+            }
+#endif
+            prealloc_step = prsize;
+            free(value);
+          }
+          break;
         case o_pn:  /* Allow non-ANSI password */
           if (negated) {
             force_ansi_key = 1;
@@ -8491,6 +8878,18 @@ char **argv;            /* command line tokens */
 #endif  /* MACOS */
           if (verbose) verbose--;
           break;
+        case o_ra:  /* Open and read input files ahead */
+          if (negated) {
+            read_ahead = 0;
+          } else {
+#ifdef IZ_URING
+            read_ahead = 1;
+#else
+            zipwarn("-ra (--read-ahead) not supported in this build, ignored",
+                    "");
+#endif
+          }
+          break;
         case 'r':   /* Recurse into subdirectories, match full path */
           if (recurse == 2) {
             ZIPERR(ZE_PARMS, "do not specify both -r and -R");
@@ -8640,6 +9039,13 @@ char **argv;            /* command line tokens */
           ZIPERR(ZE_PARMS, "no Unicode support: -sU not available");
 #endif
 
+        case o_sz:  /* Zip files of a new archive as they are found */
+          if (negated)
+            stream_add = 0;
+          else
+            stream_add = 1;
+          break;
+
         case 's':   /* enable split archives */
           /* get the split size from value */
           if (strcmp(value, "-") == 0) {
@@ -10956,6 +11362,15 @@ char **argv;            /* command line tokens */
     ZIPERR(ZE_PARMS, "--skip-scan not currently available for use with LIB or DLL");
   }
 #endif
+  if ((action != ADD || d) && stream_add) {
+    ZIPERR(ZE_PARMS, "can't use -d, -f, -u, -U, or -g with -sz");
+  }
+  if (stream_add && (filesync || show_files)) {
+    ZIPERR(ZE_PARMS, "can't use -sz with filesync -FS or show files -sf");
+  }
+  if (stream_add && split_method) {
+    ZIPERR(ZE_PARMS, "can't use -sz with split archives");
+  }
 
   if (skip_file_scan) {
     zipmessage("skipping file scan - input paths must be exact (relative or absolute)", "");
@@ -11043,22 +11458,8 @@ char **argv;            /* command line tokens */
     }
 #endif
 
-#if (!defined(VMS) && !defined(CMS_MVS))
     /* Use large buffer to speed up stdio: */
-#if (defined(_IOFBF) || !defined(BUFSIZ))
-    zipbuf = (char *)malloc(ZBSZ);
-#else
-    zipbuf = (char *)malloc(BUFSIZ);
-#endif
-    if (zipbuf == NULL) {
-      ZIPERR(ZE_MEM, tempzip);
-    }
-# ifdef _IOFBF
-    setvbuf(y, zipbuf, _IOFBF, ZBSZ);
-# else
-    setbuf(y, zipbuf);
-# endif /* _IOBUF */
-#endif /* !VMS  && !CMS_MVS */
+    set_out_buffer(y);
 
 
     if ((r = readzipfile()) != ZE_OK) {
@@ -11073,6 +11474,7 @@ char **argv;            /* command line tokens */
     k = 0;                        /* keep count for end header */
     c = tempzn;                   /* get start of central */
     n = t = 0;
+    cen_batch_begin();            /* write the headers in large pieces */
     for (z = zfiles; z != NULL; z = z->nxt)
     {
       if ((r = putcentral(z)) != ZE_OK) {
@@ -11083,6 +11485,9 @@ char **argv;            /* command line tokens */
       t += z->siz;
       k++;
     }
+    if ((r = cen_batch_end()) != ZE_OK) {
+      ZIPERR(r, tempzip);
+    }
     if (zcount == 0)
       zipwarn("zip file empty", "");
     t = tempzn - c;               /* compute length of central */
@@ -11096,6 +11501,7 @@ char **argv;            /* command line tokens */
     if (fclose(y)) {
       ZIPERR(d ? ZE_WRITE : ZE_TEMP, tempzip);
     }
+    free_out_buffer(y);
     if (in_file != NULL) {
       fclose(in_file);
       in_file = NULL;
@@ -11223,8 +11629,37 @@ char **argv;            /* command line tokens */
     }
     else
 #endif
-    if ((r = readzipfile()) != ZE_OK) {
-      ZIPERR(r, zipfile);
+    {
+#ifdef INPLACE_UPDATE
+      /* undo an earlier in-place update that did not finish, unless only
+         listing the archive (which leaves the journal alone) */
+      if (in_path && !show_files && (r = journal_recover(in_path)) != ZE_OK) {
+        ZIPERR(r, in_path);
+      }
+#endif
+#ifndef ZIP_DLL_LIB
+      /* only listing the archive, so show entries as they are read */
+      if (show_files && kk == 3 && !names_from_file && !copy_only &&
+          !filesync && !pcount && !before && !after && !diff_mode &&
+          !fix && logfile == NULL
+# ifdef BACKUP_SUPPORT
+          && !backup_type
+# endif
+# ifdef UNICODE_EXTRACT_TEST
+          && !create_files
+# endif
+         ) {
+        if (zlist_stream_open()) {
+          if ((r = show_files_stream()) != ZE_OK) {
+            ZIPERR(r, zipfile);
+          }
+          RETURN(finish(ZE_OK));
+        }
+      }
+#endif
+      if ((r = readzipfile()) != ZE_OK) {
+        ZIPERR(r, zipfile);
+      }
     }
     if (show_what_doing) {
       sdmessage("sd: Archive read or no archive", "");
@@ -11315,6 +11750,10 @@ char **argv;            /* command line tokens */
     ZIPERR(ZE_PARMS, "can't use --skip-scan on existing archive");
   }
 
+  if (stream_add && (zcount > 0 || zipbeg)) {
+    ZIPERR(ZE_PARMS, "can't use -sz on existing archive");
+  }
+
   if (have_out && kk == 3 && !names_from_file) {
     /* no input paths so assume copy mode and match everything if --out */
     if (show_what_doing) {
@@ -11344,148 +11783,29 @@ char **argv;            /* command line tokens */
   u_p_task = "Scanning";
 #endif /* def ENABLE_USER_PROGRESS */
 
-  /* Process file arguments from command line added using add_name() */
-  if (filelist) {
-    int old_no_wild = no_wild;
+  /* Process file arguments from command line added using add_name().
+     With -sz they wait until the output is open (zipup_found()). */
+  if (filelist && !stream_add) {
+    scan_files();
+  }
 
-    if (action == ARCHIVE) {
-      /* find in archive */
-      if (show_what_doing) {
-        sdmessage("sd: Scanning archive entries", "");
-      }
-      /* if looking in archive, "-" is not stdin */
-      no_stdin = 1;
-      for (; filelist; ) {
-        char *name = filelist->name;
-        if ((r = proc_archive_name(name, filter_match_case)) != ZE_OK) {
-          if (r == ZE_MISS) {
-            char *n = NULL;
-#ifdef WIN32
-            /* Win9x console always uses OEM character coding, and
-               WinNT console is set to OEM charset by default, too */
-            if ((n = malloc(strlen(name) + 1)) == NULL)
-              ZIPERR(ZE_MEM, "name not matched error");
-            INTERN_TO_OEM(name, n);
-#else
-            n = filelist->name;
-#endif
-            zipwarn("not in archive: ", n);
-#ifdef WIN32
-            free(n);
-#endif
-          }
-          else {
-            ZIPERR(r, name);
-          }
-        }
-        free(filelist->name);
-        filearg = filelist;
-        filelist = filelist->next;
-        free(filearg);
-      } /* for */
-    } /* ARCHIVE */
+#ifdef IZ_CRYPT_AES_WG
 
-    else if (skip_file_scan) {
-      /* skipping file scan - skip recursion and wildcard processing */
-      int zflags = 0;
-      int old_no_stdin = no_stdin;
+  if (encryption_method >= AES_MIN_ENCRYPTION) {
+    /*
+    time_t pool_init_start;
+    time_t pool_init_time;
+    */
 
-      if (show_what_doing) {
-        sdmessage("sd: skip-scan: only quick scan of files", "");
-      }
-      for (; filelist; ) {
-        no_wild = 1;
-        no_stdin = !(filelist->is_stdin);
+    int salt_len;
 
-#ifdef ETWODD_SUPPORT
-        if (etwodd && filelist->is_stdin) {
-          ZIPERR(ZE_PARMS, "can't use -et (--etwodd) with input from stdin");
-        }
-#endif
+    if (show_what_doing) {
+      sdmessage("sd: Initializing AES_WG encryption random number pool", "");
+    }
 
-#ifdef UNICODE_SUPPORT_WIN32
-        if (!no_win32_wide) {
-          wchar_t *namew;
-          if (is_utf8_string(filelist->name, NULL, NULL, NULL, NULL)) {
-            namew = utf8_to_wchar_string(filelist->name);
-          }
-          else {
-            namew = local_to_wchar_string(filelist->name);
-          }
-          r = newnamew(namew, zflags, filter_match_case);
-          free(namew);
-        }
-        else
-#endif
-        {
-          r = newname(filelist->name, zflags, filter_match_case);
-        }
-
-        if (r != ZE_OK) {
-          zipwarn("name not matched: ", filelist->name);
-        }
-        free(filelist->name);
-        filearg = filelist;
-        filelist = filelist->next;
-        free(filearg);
-      } /* for */
-      no_stdin = old_no_stdin;
-    } /* skip file scan */
-
-    else /* file scan */
-    {
-      /* try find matching files on OS first then try find entries in archive */
-      if (show_what_doing) {
-        sdmessage("sd: Scanning files", "");
-      }
-      for (; filelist; ) {
-        no_wild = filelist->verbatim;
-        no_stdin = !(filelist->is_stdin);
-#ifdef ETWODD_SUPPORT
-        if (etwodd && filelist->is_stdin) {
-          ZIPERR(ZE_PARMS, "can't use -et (--etwodd) with input from stdin");
-        }
-#endif
-        r = PROCNAME(filelist->name);
-        if (r != ZE_OK) {
-
-          if (r == ZE_MISS) {
-            if (bad_open_is_error) {
-              zipwarn("name not matched: ", filelist->name);
-              ZIPERR(ZE_OPEN, filelist->name);
-            } else {
-              zipwarn("name not matched: ", filelist->name);
-            }
-          } else {
-            ZIPERR(r, filelist->name);
-          }
-        }
-        free(filelist->name);
-        filearg = filelist;
-        filelist = filelist->next;
-        free(filearg);
-      } /* for filelist */
-    } /* file scan */
-    no_wild = old_no_wild;
-  } /* filelist */
-
-#ifdef IZ_CRYPT_AES_WG
-
-  if (encryption_method >= AES_MIN_ENCRYPTION) {
-    /*
-    time_t pool_init_start;
-    time_t pool_init_time;
-    */
-
-    int salt_len;
-
-    if (show_what_doing) {
-      sdmessage("sd: Initializing AES_WG encryption random number pool", "");
-    }
-
-    /*
-    pool_init_start = time(NULL);
-    */
+    /*
+    pool_init_start = time(NULL);
+    */
 
     /* initialize the random number pool */
     aes_rnp.entropy = entropy_fun;
@@ -11704,6 +12024,7 @@ char **argv;            /* command line tokens */
 
   if (zcount)
     free((zvoid *)zsort);
+  zsearch_free();
 
 /* 2015-07-31 SMS.
  * Added HAVE_LONG_LONG to determine proper output format.
@@ -12006,10 +12327,10 @@ char **argv;            /* command line tokens */
                      ((time_diff ? tfp : tf) >= before) &&
                      (after == 0 || (time_diff ? tfm : tf) < after);   /* delete if -um or -fm */
           if (verbose)
-            zfprintf(mesg, "zip diagnostic: %s %s\n", z->oname,
+            zfprintf(mesg, "zip diagnostic: %s %s\n", ZONAME(z),
                    z->trash ? "up to date" : "missing or early");
           if (logfile)
-            zfprintf(logfile, "zip diagnostic: %s %s\n", z->oname,
+            zfprintf(logfile, "zip diagnostic: %s %s\n", ZONAME(z),
                    z->trash ? "up to date" : "missing or early");
         }
         else if (diff_mode && (tf == z->tim || (time_diff && (tfm == z->tim || tfp == z->tim))) &&
@@ -12102,162 +12423,10 @@ char **argv;            /* command line tokens */
       }
     }
 
-    /* At this point only the global flag is_stdin determines if this is stdin to
-    filetime().  The name "-" is no longer special from this point on. */
-    is_stdin = f->is_stdin;
-    no_stdin = 1;
-
-    tf = 0;
-    usize = (uzoff_t)-1;
-    if (skip_file_scan) {
-      /* We skip getting the file size to avoid the performance penalty.  So
-         all the file sizes are set to zero and any operations using file
-         size won't work.  When the file is actually archived later another
-         stat is done and the file size gotten. */
-      uzoff_t usize = 0;
-
-#ifdef UNICODE_SUPPORT
-      f->utf8_path = 0;
-      /* if Unix port and locale UTF-8, assume paths UTF-8 */
-      if (using_utf8 && (f->uname != NULL)) {
-        f->utf8_path = 1;
-      }
-#endif
-      if ((action != DELETE) && (action != FRESHEN)
-#ifdef UNIX_APPLE
-       && (!IS_ZFLAG_APLDBL(f->zflags))
-#endif /* UNIX_APPLE */
-       ) {
-#ifdef UNICODE_SUPPORT_WIN32
-        if ((!no_win32_wide) && (f->namew != NULL)) {
-          /* if have namew, assume got it from wide file scan or
-             wide command line */
-          if (f->uname) {
-            f->utf8_path = 1;
-          }
-        }
-#endif
-
-#if 0
-          WIN32_FILE_ATTRIBUTE_DATA    fileInfo;
- 
-          if(GetFileAttributesEx(f->name, 0, &fileInfo))
-          {
-            usize = fileInfo.nFileSizeLow;
-//            printf("- GFAE size %d  %s\n", usize, f->name);
-          }
-          else {
-//            printf("- GFAE failed %s\n", f->name);
-          }
-#endif
-      }
-
-#if 0
-      if (action == DELETE || action == FRESHEN ||
-          ((tf == 0)
-#ifdef UNIX_APPLE
-          /* Don't bother an AppleDouble file. */
-          && (!IS_ZFLAG_APLDBL(f->zflags))
-#endif /* UNIX_APPLE */
-          ) ||
-          tf < before || (after && tf >= after) ||
-          (namecmp(f->zname, zipfile) == 0 && !zip_to_stdout)
-         ) {
-        Trace((stderr, "zip diagnostic: ignore file\n"));
-        f = fexpel(f);
-      }
-      else
-#endif
-      {
-        /* ??? */
-        files_total++;
-        f->usize = usize;
-#if 0
-        if (usize != (uzoff_t) -1 && usize != (uzoff_t) -2) {
-          bytes_total += usize;
-          f->usize = usize;
-        }
-#endif
-        f = f->nxt;
-      }
-
-    } /* skip file scan */
-
-    else {
-      /* file scan */
-      ulg tfp;
-      ulg tfm;
-
-      if (!(display_bytes || display_est_to_go || display_zip_rate ||
-            show_files) && (zcount == 0))
-        /* We skip getting the file info (time, size...) to avoid the
-           performance penalty, as we don't need it in these cases.
-           Perhaps there are other cases where we don't need to stat. */
-        tf = (ulg)-1;
-#ifdef UNICODE_SUPPORT
-      f->utf8_path = 0;
-      /* if Unix port and locale UTF-8, assume paths UTF-8 */
-      if (using_utf8 && (f->uname != NULL)) {
-        f->utf8_path = 1;
-      }
-#endif
-      if ((action != DELETE) && (action != FRESHEN)
-#ifdef UNIX_APPLE
-       && (!IS_ZFLAG_APLDBL(f->zflags))
-#endif /* UNIX_APPLE */
-       ) {
-#ifdef UNICODE_SUPPORT_WIN32
-        if ((!no_win32_wide) && (f->namew != NULL)) {
-          /* Use Windows wide name */
-          if (tf != (ulg)-1) {
-            tf = filetimew(f->namew, (ulg *)NULL, (zoff_t *)&usize, NULL);
-          }
-          /* if have namew, assume got it from wide file scan or
-             wide command line */
-          if (f->uname) {
-            f->utf8_path = 1;
-          }
-        }
-        else if (tf != (ulg)-1) {
-          /* Use regular name */
-          tf = filetime(f->name, (ulg *)NULL, (zoff_t *)&usize, NULL);
-        }
-#else
-        if (tf != (ulg)-1) {
-          /* Everyone else uses regular name (which may be UTF-8) */
-          tf = filetime(f->name, (ulg *)NULL, (zoff_t *)&usize, NULL);
-        }
-#endif
-      }
-
-      tfp = tf + time_diff;
-      tfm = tf - time_diff;
-      if ((tf != (ulg)-1) &&
-          (action == DELETE || action == FRESHEN ||
-           ((tf == 0)
-#ifdef UNIX_APPLE
-           /* Don't bother an AppleDouble file. */
-            && (!IS_ZFLAG_APLDBL(f->zflags))
-#endif /* UNIX_APPLE */
-           ) ||
-           (tf < before && (!time_diff || tfp < before)) ||
-           (after && (tf >= after && (!time_diff || tfm >= after))) ||
-           (zipfile && namecmp(f->zname, zipfile) == 0 && !zip_to_stdout)
-          )) {
-        Trace((stderr, "zip diagnostic: ignore file\n"));
-        f = fexpel(f);
-      }
-      else {
-        /* ??? */
-        files_total++;
-        f->usize = 0;
-        if (usize != (uzoff_t)-1 && usize != (uzoff_t)-2) {
-          bytes_total += usize;
-          f->usize = usize;
-        }
-        f = f->nxt;
-      }
-    } /* file scan */
+    if (keep_found(f))
+      f = f->nxt;
+    else
+      f = fexpel(f);
   } /* for found */
 
   if (mesg_line_started) {
@@ -12385,7 +12554,7 @@ char **argv;            /* command line tokens */
           char *oname;
           char *uname;
 
-          oname = z->oname;
+          oname = ZONAME(z);
 # ifdef UNICODE_SUPPORT
           uname = z->uname;
 # else
@@ -12436,16 +12605,16 @@ char **argv;            /* command line tokens */
           {
             if (filesync) {
               if (z->mark && !z->current) {
-                zfprintf(mesg, "  Freshen:  %s", z->oname);
+                zfprintf(mesg, "  Freshen:  %s", ZONAME(z));
                 mesg_displayed = 1;
               }
               else if (!z->mark) {
-                zfprintf(mesg, "  Delete:   %s", z->oname);
+                zfprintf(mesg, "  Delete:   %s", ZONAME(z));
                 mesg_displayed = 1;
               }
             }
             else {
-              zfprintf(mesg, "  %s", z->oname);
+              zfprintf(mesg, "  %s", ZONAME(z));
               mesg_displayed = 1;
             }
           }
@@ -12471,16 +12640,16 @@ char **argv;            /* command line tokens */
           } else {
             if (filesync) {
               if (z->mark && !z->current) {
-                zfprintf(logfile, "  Freshen:  %s", z->oname);
+                zfprintf(logfile, "  Freshen:  %s", ZONAME(z));
                 mesg_displayed = 1;
               }
               else if (!z->mark) {
-                zfprintf(logfile, "  Delete:   %s", z->oname);
+                zfprintf(logfile, "  Delete:   %s", ZONAME(z));
                 mesg_displayed = 1;
               }
             }
             else {
-              zfprintf(logfile, "  %s", z->oname);
+              zfprintf(logfile, "  %s", ZONAME(z));
               mesg_displayed = 1;
             }
           }
@@ -12488,14 +12657,14 @@ char **argv;            /* command line tokens */
 #else /* def UNICODE_SUPPORT */
           if (filesync) {
             if (z->mark) {
-              zfprintf(logfile, "  Freshen:  %s", z->oname);
+              zfprintf(logfile, "  Freshen:  %s", ZONAME(z));
             }
             else if (!z->mark) {
-              zfprintf(logfile, "  Delete:   %s\n", z->oname);
+              zfprintf(logfile, "  Delete:   %s\n", ZONAME(z));
             }
           }
           else {
-            zfprintf(logfile, "  %s\n", z->oname);
+            zfprintf(logfile, "  %s\n", ZONAME(z));
           }
 #endif /* def UNICODE_SUPPORT [else] */
         } /* logfile && !(show_files == 5 || show_files == 6) */
@@ -12559,19 +12728,19 @@ char **argv;            /* command line tokens */
           if (dir) {
             if (r) {
               if (errno != 17) {
-                zprintf(" - could not create directory testdir/%s\n", z->oname);
+                zprintf(" - could not create directory testdir/%s\n", ZONAME(z));
                 zperror("    dir");
               }
             } else {
-              zprintf(" - created directory testdir/%s\n", z->oname);
+              zprintf(" - created directory testdir/%s\n", ZONAME(z));
             }
           } else {
             if (f == NULL) {
-              zprintf(" - could not open testdir/%s\n", z->oname);
+              zprintf(" - could not open testdir/%s\n", ZONAME(z));
               zperror("    file");
             } else {
               fclose(f);
-              zprintf(" - created testdir/%s\n", z->oname);
+              zprintf(" - created testdir/%s\n", ZONAME(z));
               if (z->uname)
                 zprintf("   u - created testdir/%s\n", z->uname);
             }
@@ -12583,16 +12752,16 @@ char **argv;            /* command line tokens */
         if (show_files == 3 || show_files == 4) {
           /* su, su- */
           /* Include escaped Unicode name (if exists) under standard name */
-          if (z->ouname) {
+          if (ZOUNAME(z) != NULL) {
             if (noisy && show_files == 3) {
-              zfprintf(mesg, "\n     Escaped Unicode:  %s", z->ouname);
+              zfprintf(mesg, "\n     Escaped Unicode:  %s", ZOUNAME(z));
               mesg_displayed = 1;
             }
             if (logfile) {
               if (log_utf8) {
                 zfprintf(logfile, "     Unicode:  %s", z->uname);
               } else {
-                zfprintf(logfile, "\n     Escaped Unicode:  %s", z->ouname);
+                zfprintf(logfile, "\n     Escaped Unicode:  %s", ZOUNAME(z));
               }
               log_displayed = 1;
             }
@@ -12602,21 +12771,21 @@ char **argv;            /* command line tokens */
         if (show_files == 5 || show_files == 6) {
           /* sU, sU- */
           /* Display only escaped Unicode name if exists or standard name */
-          if (z->ouname) {
+          if (ZOUNAME(z) != NULL) {
             /* Unicode name */
             if (filesync) {
               if (z->mark && !z->current) {
-                zfprintf(mesg, "  Freshen:  %s", z->ouname);
+                zfprintf(mesg, "  Freshen:  %s", ZOUNAME(z));
                 mesg_displayed = 1;
               }
               else if (!z->mark) {
-                zfprintf(mesg, "  Delete:   %s", z->ouname);
+                zfprintf(mesg, "  Delete:   %s", ZOUNAME(z));
                 mesg_displayed = 1;
               }
             }
             else {
               if (noisy && show_files == 5) {
-                zfprintf(mesg, "  %s", z->ouname);
+                zfprintf(mesg, "  %s", ZOUNAME(z));
                 mesg_displayed = 1;
               }
             }
@@ -12627,7 +12796,7 @@ char **argv;            /* command line tokens */
                 if (z->uname)
                   u = z->uname;
                 else
-                  u = z->oname;
+                  u = ZONAME(z);
                 if (filesync) {
                   if (z->mark && !z->current) {
                     zfprintf(logfile, "  Freshen:  %s", u);
@@ -12646,16 +12815,16 @@ char **argv;            /* command line tokens */
               else {
                 if (filesync) {
                   if (z->mark && !z->current) {
-                    zfprintf(logfile, "  Freshen:  %s", z->ouname);
+                    zfprintf(logfile, "  Freshen:  %s", ZOUNAME(z));
                     log_displayed = 1;
                   }
                   else if (!z->mark) {
-                    zfprintf(logfile, "  Delete:   %s", z->ouname);
+                    zfprintf(logfile, "  Delete:   %s", ZOUNAME(z));
                     log_displayed = 1;
                   }
                 }
                 else {
-                  zfprintf(logfile, "  %s", z->ouname);
+                  zfprintf(logfile, "  %s", ZOUNAME(z));
                   log_displayed = 1;
                 }
               }
@@ -12666,16 +12835,16 @@ char **argv;            /* command line tokens */
             if (noisy && show_files == 5) {
               if (filesync) {
                 if (z->mark && !z->current) {
-                  zfprintf(mesg, "  Freshen:  %s", z->oname);
+                  zfprintf(mesg, "  Freshen:  %s", ZONAME(z));
                   mesg_displayed = 1;
                 }
                 else if (!z->mark) {
-                  zfprintf(mesg, "  Delete:   %s", z->oname);
+                  zfprintf(mesg, "  Delete:   %s", ZONAME(z));
                   mesg_displayed = 1;
                 }
               }
               else {
-                zfprintf(mesg, "  %s", z->oname);
+                zfprintf(mesg, "  %s", ZONAME(z));
                 mesg_displayed = 1;
               }
             }
@@ -12697,16 +12866,16 @@ char **argv;            /* command line tokens */
               else {
                 if (filesync) {
                   if (z->mark && !z->current) {
-                    zfprintf(logfile, "  Freshen:  %s", z->oname);
+                    zfprintf(logfile, "  Freshen:  %s", ZONAME(z));
                     log_displayed = 1;
                   }
                   else if (!z->mark) {
-                    zfprintf(logfile, "  Delete:   %s", z->oname);
+                    zfprintf(logfile, "  Delete:   %s", ZONAME(z));
                     log_displayed = 1;
                   }
                 }
                 else {
-                  zfprintf(logfile, "  %s", z->oname);
+                  zfprintf(logfile, "  %s", ZONAME(z));
                   log_displayed = 1;
                 }
               }
@@ -12882,76 +13051,7 @@ char **argv;            /* command line tokens */
 
     } /* for found */
 
-    if (!(filesync && show_files)) {
-      char e[10];
-      char b[10];
-
-      if (count == 1)
-        strcpy(e, "entry");
-      else
-        strcpy(e, "entries");
-      
-      if (bytes == 1)
-        strcpy(b, "byte");
-      else
-        strcpy(b, "bytes");
-
-      WriteNumString(bytes, errbuf);
-      if (noisy || logfile == NULL) {
-        if (bytes < 1024) {
-          zfprintf(mesg, "Total %s %s (%s %s)\n",
-                                              zip_fuzofft(count, NULL, NULL),
-                                              e,
-                                              zip_fuzofft(bytes, NULL, NULL),
-                                              b);
-        } else {
-          zfprintf(mesg, "Total %s %s (%s %s (%s))\n",
-                                              zip_fuzofft(count, NULL, NULL),
-                                              e,
-                                              zip_fuzofft(bytes, NULL, NULL),
-                                              b,
-                                              errbuf);
-        }
-      }
-      if (logfile) {
-        if (bytes < 1024) {
-          zfprintf(logfile, "Total %s %s (%s %s)\n",
-                                              zip_fuzofft(count, NULL, NULL),
-                                              e,
-                                              zip_fuzofft(bytes, NULL, NULL),
-                                              b);
-        } else {
-          zfprintf(logfile, "Total %s %s (%s %s (%s))\n",
-                                              zip_fuzofft(count, NULL, NULL),
-                                              e,
-                                              zip_fuzofft(bytes, NULL, NULL),
-                                              b,
-                                              errbuf);
-        }
-      }
-    }
-    if (sf_zcomment) {
-      zprintf("\nzipfile comment:\n");
-      if (logfile) {
-        fprintf(logfile, "\nzipfile comment:\n");
-      }
-      if (zcomment) {
-        print_utf8("----------\n");
-        print_utf8(zcomment);
-        if (zcomment[zcomlen-1] != '\n') {
-          print_utf8("\n");
-        }
-        print_utf8("----------\n");
-        if (logfile) {
-          fwrite("----------\n", 1, 11, logfile);
-          fwrite(zcomment, 1, zcomlen, logfile);
-          if (zcomment[zcomlen-1] != '\n') {
-            putc('\n', logfile);
-          }
-          fwrite("----------\n", 1, 11, logfile);
-        }
-      }
-    }
+    show_files_total(count, bytes);
 #ifdef ZIP_DLL_LIB
     if (*lpZipUserFunctions->finish != NULL) {
       char susize[100];
@@ -12968,8 +13068,9 @@ char **argv;            /* command line tokens */
     RETURN(finish(ZE_OK));
   } /* show_files */
 
-  /* Make sure there's something left to do */
-  if (k == 0 && found == NULL && !diff_mode &&
+  /* Make sure there's something left to do (with -sz, the files are
+     not scanned yet, see zipup_found()) */
+  if (k == 0 && found == NULL && filelist == NULL && !diff_mode &&
       !(zfiles == NULL && allow_empty_archive) &&
       !(zfiles != NULL &&
         (latest || fix || adjust || junk_sfx || comadd || zipedit))) {
@@ -13025,7 +13126,24 @@ char **argv;            /* command line tokens */
   }
 
   /* d true if appending */
+  grow = d;
   d = (d && k == 0 && (zipbeg || zfiles != NULL));
+  grow_from = cenbeg;
+
+#ifdef INPLACE_UPDATE
+  /* Deleting with -g: move the entries after the first deleted one down
+     in place, and leave the ones before it alone. */
+  if (!d && grow && action == DELETE && k > 0 &&
+      !have_out && split_method == 0 && total_disks <= 1 &&
+      !zip_to_stdout && !fix && !adjust && !junk_sfx && !comadd &&
+      !zipedit && !filesync && !diff_mode && !latest && !include_stream_ef &&
+      inplace_delete_from(&grow_from)) {
+    d = 1;
+    if (verbose) {
+      zipmessage("deleting from archive in place", "");
+    }
+  }
+#endif
 
 #ifdef IZ_CRYPT_ANY
   /* Initialize the crc_32_tab pointer, when encryption was requested. */
@@ -13168,16 +13286,25 @@ char **argv;            /* command line tokens */
     if ((y = zfopen(zipfile, FOPM)) == NULL) {
       ZIPERR(ZE_NAME, zipfile);
     }
+    set_out_buffer(y);
+#ifdef INPLACE_UPDATE
+    /* Lock the archive and save what the update will overwrite before
+       tempzip says the archive is being written, so an error here (say
+       another zip holds the lock) leaves it alone in ziperr(). */
+    if ((r = journal_begin(zipfile, y, grow_from)) != ZE_OK) {
+      ZIPERR(r, "creating journal for in-place update");
+    }
+#endif
     tempzip = zipfile;
     /*
     tempzf = y;
     */
 
-    if (zfseeko(y, cenbeg, SEEK_SET)) {
+    if (zfseeko(y, grow_from, SEEK_SET)) {
       ZIPERR(ferror(y) ? ZE_READ : ZE_EOF, zipfile);
     }
-    bytes_this_split = cenbeg;
-    tempzn = cenbeg;
+    bytes_this_split = grow_from;
+    tempzn = grow_from;
   }
   else
   {
@@ -13265,22 +13392,15 @@ char **argv;            /* command line tokens */
 #endif
 
 
-#if (!defined(VMS) && !defined(CMS_MVS))
-  /* Use large buffer to speed up stdio: */
-# if (defined(_IOFBF) || !defined(BUFSIZ))
-  zipbuf = (char *)malloc(ZBSZ);
-# else
-  zipbuf = (char *)malloc(BUFSIZ);
-# endif
-  if (zipbuf == NULL) {
-    ZIPERR(ZE_MEM, tempzip);
-  }
-# ifdef _IOFBF
-  setvbuf(y, zipbuf, _IOFBF, ZBSZ);
-# else
-  setbuf(y, zipbuf);
-# endif /* _IOBUF */
-#endif /* !VMS  && !CMS_MVS */
+  /* Use large buffer to speed up stdio (see set_out_buffer()), the grown
+     archive got its own before it was first read: */
+  if (!d)
+    set_out_buffer(y);
+
+#ifdef IZ_PREALLOC
+  /* reserve disk space ahead of the writes (see prealloc_begin()) */
+  prealloc_begin(y);
+#endif
 
   /* If not seekable set some flags 3/14/05 EG */
   output_seekable = 1;
@@ -13364,7 +13484,7 @@ char **argv;            /* command line tokens */
         struct zlist far *localz; /* local header */
 
 #ifdef ENABLE_USER_PROGRESS
-        u_p_name = z->oname;
+        u_p_name = ZONAME(z);
 #endif /* def ENABLE_USER_PROGRESS */
 
         if (action == FRESHEN) {
@@ -13389,7 +13509,7 @@ char **argv;            /* command line tokens */
             else
 #endif
             {
-              zfprintf(mesg, "freshening: %s", z->oname);
+              zfprintf(mesg, "freshening: %s", ZONAME(z));
             }
             m = 1;
 
@@ -13397,7 +13517,7 @@ char **argv;            /* command line tokens */
             fflush(mesg);
           } else if (filesync && z->current) {
             if (verbose) {
-              zfprintf(mesg, "      ok: %s", z->oname);
+              zfprintf(mesg, "      ok: %s", ZONAME(z));
               m = 1;
               mesg_line_started = 1;
               fflush(mesg);
@@ -13411,7 +13531,7 @@ char **argv;            /* command line tokens */
             else
 #endif
             {
-              zfprintf(mesg, "updating: %s", z->oname);
+              zfprintf(mesg, "updating: %s", ZONAME(z));
             }
             m = 1;
 
@@ -13431,7 +13551,7 @@ char **argv;            /* command line tokens */
               zfprintf(logfile, "freshening: %s", z->uname);
             else
 #endif
-              zfprintf(logfile, "freshening: %s", z->oname);
+              zfprintf(logfile, "freshening: %s", ZONAME(z));
             l = 1;
             logfile_line_started = 1;
             fflush(logfile);
@@ -13442,7 +13562,7 @@ char **argv;            /* command line tokens */
                 zfprintf(logfile, " current: %s", z->uname);
               else
 #endif
-                zfprintf(logfile, " current: %s", z->oname);
+                zfprintf(logfile, " current: %s", ZONAME(z));
               l = 1;
               logfile_line_started = 1;
               fflush(logfile);
@@ -13453,7 +13573,7 @@ char **argv;            /* command line tokens */
               zfprintf(logfile, "updating: %s", z->uname);
             else
 #endif
-              zfprintf(logfile, "updating: %s", z->oname);
+              zfprintf(logfile, "updating: %s", ZONAME(z));
             l = 1;
             logfile_line_started = 1;
             fflush(logfile);
@@ -13465,7 +13585,7 @@ char **argv;            /* command line tokens */
 
         /* Get local header flags and extra fields */
         if (readlocal(&localz, z) != ZE_OK) {
-          zipwarn("could not read local entry information: ", z->oname);
+          zipwarn("could not read local entry information: ", ZONAME(z));
           z->lflg = z->flg;
           z->ext = 0;
         } else {
@@ -13520,7 +13640,7 @@ char **argv;            /* command line tokens */
           /* if filesync if entry matches OS just copy */
           if ((r = zipcopy(z)) != ZE_OK)
           {
-            sprintf(errbuf, "was copying %s", z->oname);
+            sprintf(errbuf, "was copying %s", ZONAME(z));
             ZIPERR(r, errbuf);
           }
           zipmessage_nl("", 1);
@@ -13572,7 +13692,7 @@ char **argv;            /* command line tokens */
           */
 
           if (r == ZE_OPEN) {
-            zipwarn_indent("could not open for reading: ", z->oname);
+            zipwarn_indent("could not open for reading: ", ZONAME(z));
             zipwarn_indent( NULL, strerror( errno));
             if (bad_open_is_error) {
               sprintf(errbuf, "was zipping %s", z->name);
@@ -13580,20 +13700,20 @@ char **argv;            /* command line tokens */
             }
             strcpy(action_string, "can't open/read");
           } else if (r == ZE_MISS) {
-            zipwarn_indent("name not matched: ", z->oname);
+            zipwarn_indent("name not matched: ", ZONAME(z));
             strcpy(action_string, "name not matched");
           } else if (r == ZE_SKIP) {
-            zipwarn_indent("ignoring special file: ", z->oname);
+            zipwarn_indent("ignoring special file: ", ZONAME(z));
             strcpy(action_string, "ignoring special");
           } else {
             zipwarn_indent("file and directory with the same name (1): ",
-             z->oname);
+             ZONAME(z));
             strcpy(action_string, "filename=dirname");
           }
-          zipwarn_indent("will just copy entry over: ", z->oname);
+          zipwarn_indent("will just copy entry over: ", ZONAME(z));
           if ((r = zipcopy(z)) != ZE_OK)
           {
-            sprintf(errbuf, "was copying %s", z->oname);
+            sprintf(errbuf, "was copying %s", ZONAME(z));
             ZIPERR(r, errbuf);
           }
           z->mark = 0;
@@ -13610,7 +13730,7 @@ char **argv;            /* command line tokens */
           char *uname;
 
 
-          oname = z->oname;
+          oname = ZONAME(z);
 # ifdef UNICODE_SUPPORT
           uname = z->uname;
 # else
@@ -13640,7 +13760,7 @@ char **argv;            /* command line tokens */
           char *oname;
           char *uname;
 
-          oname = z->oname;
+          oname = ZONAME(z);
 #  ifdef UNICODE_SUPPORT
           uname = z->uname;
 #  else
@@ -13681,7 +13801,7 @@ char **argv;            /* command line tokens */
           }
           else
 #endif
-          zfprintf(mesg, " noting: %s", z->oname);
+          zfprintf(mesg, " noting: %s", ZONAME(z));
 
           if (display_usize) {
             zfprintf(mesg, " (");
@@ -13698,7 +13818,7 @@ char **argv;            /* command line tokens */
             zfprintf(logfile, " noting: %s", z->uname);
           else
 #endif
-            zfprintf(logfile, " noting: %s", z->oname);
+            zfprintf(logfile, " noting: %s", ZONAME(z));
           if (display_usize) {
             zfprintf(logfile, " (");
             DisplayNumString(logfile, z->len );
@@ -13727,7 +13847,7 @@ char **argv;            /* command line tokens */
           char *oname;
           char *uname;
 
-          oname = z->oname;
+          oname = ZONAME(z);
 # ifdef UNICODE_SUPPORT
           uname = z->uname;
 # else
@@ -13757,7 +13877,7 @@ char **argv;            /* command line tokens */
           char *oname;
           char *uname;
 
-          oname = z->oname;
+          oname = ZONAME(z);
 # ifdef UNICODE_SUPPORT
           uname = z->uname;
 # else
@@ -13798,7 +13918,7 @@ char **argv;            /* command line tokens */
           /* skipping this disk */
           strcpy(action_string, "skip");
           if (noisy) {
-            zfprintf(mesg, " skipping: %s", z->oname);
+            zfprintf(mesg, " skipping: %s", ZONAME(z));
             mesg_line_started = 1;
             fflush(mesg);
           }
@@ -13808,7 +13928,7 @@ char **argv;            /* command line tokens */
               zfprintf(logfile, " skipping: %s", z->uname);
             else
 #endif
-              zfprintf(logfile, " skipping: %s", z->oname);
+              zfprintf(logfile, " skipping: %s", ZONAME(z));
             logfile_line_started = 1;
             fflush(logfile);
           }
@@ -13823,7 +13943,7 @@ char **argv;            /* command line tokens */
             }
             else
 #endif
-            zfprintf(mesg, " copying: %s", z->oname);
+            zfprintf(mesg, " copying: %s", ZONAME(z));
 
             if (display_usize) {
               zfprintf(mesg, " (");
@@ -13840,7 +13960,7 @@ char **argv;            /* command line tokens */
               zfprintf(logfile, " copying: %s", z->uname);
             else
 #endif
-              zfprintf(logfile, " copying: %s", z->oname);
+              zfprintf(logfile, " copying: %s", ZONAME(z));
             if (display_usize) {
               zfprintf(logfile, " (");
               DisplayNumString(logfile, z->len );
@@ -13860,7 +13980,7 @@ char **argv;            /* command line tokens */
             ZIPERR(r, "user requested abort");
           } else if (fix != 1) {
             /* exit */
-            sprintf(errbuf, "was copying %s", z->oname);
+            sprintf(errbuf, "was copying %s", ZONAME(z));
             zipwarn("(try -F to attempt to fix)", "");
             ZIPERR(r, errbuf);
           }
@@ -13873,7 +13993,7 @@ char **argv;            /* command line tokens */
             if (zfseeko(y, current_local_offset, SEEK_SET) != 0){
               ZIPERR(r, "could not seek in output file");
             }
-            zipwarn("bad - skipping: ", z->oname);
+            zipwarn("bad - skipping: ", ZONAME(z));
 #ifdef DEBUG
             here = zftello(y);
 #endif
@@ -13905,11 +14025,11 @@ char **argv;            /* command line tokens */
         if (r != ZE_OK && fix == 1) {
           /* remove bad entry from list */
           v = z->nxt;                     /* delete entry from list */
-          free((zvoid *)(z->iname));
-          free((zvoid *)(z->zname));
-          free(z->oname);
+          name_free((zvoid *)(z->iname));
+          name_free((zvoid *)(z->zname));
+          name_free(z->oname);
 #ifdef UNICODE_SUPPORT
-          if (z->uname) free(z->uname);
+          if (z->uname) name_free(z->uname);
 #endif /* def UNICODE_SUPPORT */
           if (z->ext)
             /* don't have local extra until zipcopy reads it */
@@ -13918,7 +14038,7 @@ char **argv;            /* command line tokens */
             free((zvoid *)(z->cextra));
           if (z->com)
             free((zvoid *)(z->comment));
-          farfree((zvoid far *)z);
+          zlist_free(z);
           *w = v;
           zcount--;
         } else {
@@ -13937,7 +14057,7 @@ char **argv;            /* command line tokens */
           char *oname;
           char *uname;
 
-          oname = z->oname;
+          oname = ZONAME(z);
 # ifdef UNICODE_SUPPORT
           uname = z->uname;
 # else
@@ -13967,7 +14087,7 @@ char **argv;            /* command line tokens */
           char *oname;
           char *uname;
 
-          oname = z->oname;
+          oname = ZONAME(z);
 #  ifdef UNICODE_SUPPORT
           uname = z->uname;
 #  else
@@ -14007,7 +14127,7 @@ char **argv;            /* command line tokens */
           }
           else
 #endif
-          zfprintf(mesg, "deleting: %s", z->oname);
+          zfprintf(mesg, "deleting: %s", ZONAME(z));
 
           if (display_usize) {
             zfprintf(mesg, " (");
@@ -14024,7 +14144,7 @@ char **argv;            /* command line tokens */
             zfprintf(logfile, "deleting: %s", z->uname);
           else
 #endif
-            zfprintf(logfile, "deleting: %s", z->oname);
+            zfprintf(logfile, "deleting: %s", ZONAME(z));
           if (display_usize) {
             zfprintf(logfile, " (");
             DisplayNumString(logfile, z->len );
@@ -14049,7 +14169,7 @@ char **argv;            /* command line tokens */
           char *uname;
 
 
-          oname = z->oname;
+          oname = ZONAME(z);
 # ifdef UNICODE_SUPPORT
           uname = z->uname;
 # else
@@ -14079,7 +14199,7 @@ char **argv;            /* command line tokens */
           char *oname;
           char *uname;
 
-          oname = z->oname;
+          oname = ZONAME(z);
 #  ifdef UNICODE_SUPPORT
           uname = z->uname;
 #  else
@@ -14107,11 +14227,11 @@ char **argv;            /* command line tokens */
 
 
         v = z->nxt;                     /* delete entry from list */
-        free((zvoid *)(z->iname));
-        free((zvoid *)(z->zname));
-        free(z->oname);
+        name_free((zvoid *)(z->iname));
+        name_free((zvoid *)(z->zname));
+        name_free(z->oname);
 #ifdef UNICODE_SUPPORT
-        if (z->uname) free(z->uname);
+        if (z->uname) name_free(z->uname);
 #endif /* def UNICODE_SUPPORT */
         if (z->ext)
           /* don't have local extra until zipcopy reads it */
@@ -14120,7 +14240,7 @@ char **argv;            /* command line tokens */
           free((zvoid *)(z->cextra));
         if (z->com)
           free((zvoid *)(z->comment));
-        farfree((zvoid far *)z);
+        zlist_free(z);
         *w = v;
         zcount--;
       } /* Delete */
@@ -14130,11 +14250,11 @@ char **argv;            /* command line tokens */
     { /* z->mark != 1 */
       if (action == ARCHIVE) {
         v = z->nxt;                     /* delete entry from list */
-        free((zvoid *)(z->iname));
-        free((zvoid *)(z->zname));
-        free(z->oname);
+        name_free((zvoid *)(z->iname));
+        name_free((zvoid *)(z->zname));
+        name_free(z->oname);
 #ifdef UNICODE_SUPPORT
-        if (z->uname) free(z->uname);
+        if (z->uname) name_free(z->uname);
 #endif /* def UNICODE_SUPPORT */
         if (z->ext)
           /* don't have local extra until zipcopy reads it */
@@ -14143,7 +14263,7 @@ char **argv;            /* command line tokens */
           free((zvoid *)(z->cextra));
         if (z->com)
           free((zvoid *)(z->comment));
-        farfree((zvoid far *)z);
+        zlist_free(z);
         *w = v;
         zcount--;
       }
@@ -14162,7 +14282,7 @@ char **argv;            /* command line tokens */
             }
             else
 #endif
-            zfprintf(mesg, "deleting: %s", z->oname);
+            zfprintf(mesg, "deleting: %s", ZONAME(z));
 
             if (display_usize) {
               zfprintf(mesg, " (");
@@ -14180,7 +14300,7 @@ char **argv;            /* command line tokens */
               zfprintf(logfile, "deleting: %s", z->uname);
             else
 #endif
-              zfprintf(logfile, "deleting: %s", z->oname);
+              zfprintf(logfile, "deleting: %s", ZONAME(z));
             if (display_usize) {
               zfprintf(logfile, " (");
               DisplayNumString(logfile, z->len );
@@ -14192,10 +14312,18 @@ char **argv;            /* command line tokens */
             logfile_line_started = 0;
           }
         }
-        /* copy the original entry */
-        else if (!d && !diff_mode && (r = zipcopy(z)) != ZE_OK)
+#ifdef INPLACE_UPDATE
+        else if (d && z->off >= grow_from && tempzn + INPLACE_SLACK > z->off)
+        {
+          /* moving entries down in place, must stay behind the reads */
+          ZIPERR(ZE_LOGIC, "in-place delete would overwrite unread entry");
+        }
+#endif
+        /* copy the original entry (if d, only those being moved down) */
+        else if ((!d || z->off >= grow_from) && !diff_mode &&
+                 (r = zipcopy(z)) != ZE_OK)
         {
-          sprintf(errbuf, "was copying %s", z->oname);
+          sprintf(errbuf, "was copying %s", ZONAME(z));
           ZIPERR(r, errbuf);
         }
         w = &z->nxt;
@@ -14216,331 +14344,69 @@ char **argv;            /* command line tokens */
 
   diag("zipping up new entries, if any");
   Trace((stderr, "zip diagnostic: fcount=%u\n", (unsigned)fcount));
-  for (f = found; f != NULL; f = fexpel(f))
-  {
-    /* process found list */
-
-    uzoff_t len;
-
-    /* add a new zfiles entry and set the name */
-    if ((z = (struct zlist far *)farmalloc(sizeof(struct zlist))) == NULL) {
-      ZIPERR(ZE_MEM, "was adding files to zip file");
+#ifdef IZ_URING
+  if (linkput || nocache) {
+    /* symlinks are stored, not opened, don't open their targets;
+       -nc keeps the files out of the cache, read-ahead puts them in */
+    read_ahead = 0;
+  }
+#endif
+  zf_w = w;
+  if (filelist) {
+    /* -sz: scan now, newname() has each batch of files zipped up as it
+       is found.  Leave out the temp file should the scan come to it. */
+    if (show_what_doing) {
+      sdmessage("sd: Scanning files, zipping them up as found", "");
     }
-    z->nxt = NULL;
-    z->name = f->name;
-    f->name = NULL;
-#ifdef UNICODE_SUPPORT
-    z->uname = NULL;          /* UTF-8 name for extra field */
-    z->zuname = NULL;         /* externalized UTF-8 name for matching */
-    z->ouname = NULL;         /* display version of UTF-8 name with OEM */
+    tempzbase = NULL;
+    if (strcmp(tempzip, "-") && zstat(tempzip, &tempzstat) == 0) {
+      tempzbase = last(tempzip, '/');
+#if defined(MSDOS) || defined(WIN32)
+      tempzbase = last(tempzbase, '\\');
+#endif
+    }
+    stream_add = 2;
+    scan_files();
+    zipup_found();              /* what is left of the last batch */
+    stream_add = 1;
+    found_dup_free();
+  }
+  else {
+    zipup_found();
+  }
+  w = zf_w;
+  if (zf_open_err) {
+    o = 1;
+  }
 
-# if 0
-    /* New AppNote bit 11 allowing storing UTF-8 in path */
-    if (utf8_native && f->uname) {
-      if (f->iname)
-        free(f->iname);
-      if ((f->iname = malloc(strlen(f->uname) + 1)) == NULL)
-        ZIPERR(ZE_MEM, "Unicode bit 11");
-      strcpy(f->iname, f->uname);
-#  ifdef WIN32
-      if (f->inamew)
-        free(f->inamew);
-      f->inamew = utf8_to_wchar_string(f->iname);
-#  endif
+#ifndef ZIP_DLL_LIB
+  /* With -sz, the check that there is something to do comes only now */
+  if (stream_add && zcount == 0 && bad_files_so_far == 0 &&
+      !allow_empty_archive) {
+    diag("Nothing left - zipfile");
+    if (recurse && (pcount == 0) && (first_listarg > 0)) {
+      zipwarn("for -r, be sure input names resolve to relative paths (or use -i)", "");
     }
-# endif
+    ZIPERR(ZE_NONE, zipfile);
+  }
+#endif /* !ZIP_DLL_LIB */
 
-    /* Only set z->uname if have a non-ASCII Unicode name */
-    /* The Unicode path extra field is created if z->uname is not NULL,
-       unless on a UTF-8 system, then instead of creating the extra field
-       set bit 11 in the General Purpose Bit Flag */
-    {
-      int is_ascii = 0;
+  /* NULLing this here prevents check_zipfile() from using
+     the password. */
+#if 0
+  if (key != NULL)
+  {
+    free((zvoid *)key);
+    key = NULL;
+  }
+#endif
 
-# ifdef WIN32
-      if (!no_win32_wide)
-        is_ascii = is_ascii_stringw(f->inamew);
-      else
-        is_ascii = is_ascii_string(f->uname);
-# else
-      is_ascii = is_ascii_string(f->uname);
-# endif
+  /* final status 3/17/05 EG */
 
-      if (z->uname == NULL) {
-        if (!is_ascii)
-          z->uname = f->uname;
-        else
-          free(f->uname);
-      } else {
-        free(f->uname);
-      }
-    }
-    f->uname = NULL;
-
-    z->utf8_path = f->utf8_path;
-#endif /* UNICODE_SUPPORT */
-
-    z->iname = f->iname;
-    f->iname = NULL;
-    z->zname = f->zname;
-    f->zname = NULL;
-    z->oname = f->oname;
-    f->oname = NULL;
-#ifdef UNICODE_SUPPORT_WIN32
-    z->namew = f->namew;
-    f->namew = NULL;
-    z->inamew = f->inamew;
-    f->inamew = NULL;
-    z->znamew = f->znamew;
-    f->znamew = NULL;
-#endif
-    z->zflags = f->zflags;
-    z->is_stdin = f->is_stdin;
-
-    z->flg = 0;
-#ifdef UNICODE_SUPPORT
-    if (z->uname && utf8_native)
-      z->flg |= UTF8_BIT;
-#endif
-
-    z->ext = z->cext = z->com = 0;
-    z->extra = z->cextra = NULL;
-    z->mark = 1;
-    z->dosflag = f->dosflag;
-    /* zip it up */
-    DisplayRunningStats();
-
-#ifdef ENABLE_USER_PROGRESS
-    u_p_name = z->oname;
-#endif /* def ENABLE_USER_PROGRESS */
-
-    strcpy(action_string, "add");
-
-    if (noisy)
-    {
-#ifdef UNICODE_SUPPORT
-      if (unicode_show && z->uname) {
-        sprintf(errbuf, "  adding: %s", z->uname);
-        print_utf8(errbuf);
-      }
-      else
-#endif
-      {
-        zfprintf(mesg, "  adding: %s", z->oname);
-      }
-      if (z->is_stdin) {
-        fprintf(mesg, " (stdin)");
-      }
-      mesg_line_started = 1;
-      fflush(mesg);
-    }
-    if (logall)
-    {
-#ifdef UNICODE_SUPPORT
-      if (log_utf8 && z->uname)
-        zfprintf(logfile, "  adding: %s", z->uname);
-      else
-#endif
-      {
-        zfprintf(logfile, "  adding: %s", z->oname);
-      }
-      if (z->is_stdin) {
-        zfprintf(logfile, " (stdin)");
-      }
-      logfile_line_started = 1;
-      fflush(logfile);
-    }
-    /* initial scan */
-
-    /* zip up found list */
-
-    len = f->usize;
-    if ((r = zipup(z)) != ZE_OK  && r != ZE_OPEN && r != ZE_MISS &&
-        r != ZE_SKIP && r != ZE_SAME)
-    {
-      zipmessage_nl("", 1);
-      /*
-      if (noisy)
-      {
-#if (!defined(MACOS) && !defined(ZIP_DLL_LIB))
-        putc('\n', mesg);
-        fflush(mesg);
-#else
-        fprintf(stdout, "\n");
-#endif
-        mesg_line_started = 0;
-        fflush(mesg);
-      }
-      if (logall) {
-        fprintf(logfile, "\n");
-        logfile_line_started = 0;
-        fflush(logfile);
-      }
-      */
-      sprintf(errbuf, "was zipping %s", z->oname);
-      ZIPERR(r, errbuf);
-    } /* zipup */
-    if (r == ZE_OPEN || r == ZE_MISS || r == ZE_SKIP || r == ZE_SAME)
-    {
-      o = 1;
-      zipmessage_nl("", 1);
-      /*
-      if (noisy)
-      {
-#if (!defined(MACOS) && !defined(ZIP_DLL_LIB))
-        putc('\n', mesg);
-        fflush(mesg);
-#else
-        fprintf(stdout, "\n");
-#endif
-        mesg_line_started = 0;
-        fflush(mesg);
-      }
-      if (logall) {
-        fprintf(logfile, "\n");
-        logfile_line_started = 0;
-        fflush(logfile);
-      }
-      */
-      if (r == ZE_OPEN) {
-        zipwarn_indent("could not open for reading: ", z->oname);
-        zipwarn_indent( NULL, strerror( errno));
-        if (bad_open_is_error) {
-          sprintf(errbuf, "was zipping %s", z->name);
-          ZIPERR(r, errbuf);
-        }
-        strcpy(action_string, "can't open/read");
-      } else if (r == ZE_MISS) {
-        zipwarn_indent("name not matched: ", z->oname);
-        strcpy(action_string, "name not matched");
-      } else if (r == ZE_SKIP) {
-        zipwarn_indent("ignoring special file: ", z->oname);
-        strcpy(action_string, "ignoring special");
-      } else {
-        zipwarn_indent("file and directory with the same name (2): ",
-         z->oname);
-        strcpy(action_string, "filename=dirname");
-      }
-      files_so_far++;
-      bytes_so_far += len;
-      bad_files_so_far++;
-      bad_bytes_so_far += len;
-#ifdef ENABLE_USER_PROGRESS
-      u_p_name = NULL;
-#endif /* def ENABLE_USER_PROGRESS */
-      free((zvoid *)(z->name));
-      free((zvoid *)(z->iname));
-      free((zvoid *)(z->zname));
-      free(z->oname);
-#ifdef UNICODE_SUPPORT
-      if (z->uname)
-        free(z->uname);
-# ifdef UNICODE_SUPPORT_WIN32
-      if (z->namew)
-        free((zvoid *)(z->namew));
-      if (z->inamew)
-        free((zvoid *)(z->inamew));
-      if (z->znamew)
-        free((zvoid *)(z->znamew));
-# endif
-#endif /* UNICODE_SUPPORT */
-      farfree((zvoid far *)z);
-    }
-    else
-    {
-      /* Not ZE_OPEN or ZE_MISS */
-#ifdef ZIP_DLL_LIB
-      /* process found list */
-      if (lpZipUserFunctions->service != NULL)
-      {
-        char us[100];
-        char cs[100];
-        long perc = 0;
-        char *oname;
-        char *uname;
-
-
-        oname = z->oname;
-# ifdef UNICODE_SUPPORT
-        uname = z->uname;
-# else
-        uname = NULL;
-# endif
-        if (uname == NULL)
-          uname = z->oname;
-
-        WriteNumString(z->siz, cs);
-        WriteNumString(z->len, us);
-        if (z->siz)
-          perc = percent(z->len, z->siz);
-
-        if ((*lpZipUserFunctions->service)(oname,
-                                           uname,
-                                           us,
-
-                                           cs,
-                                           z->len,
-                                           z->siz,
-                                           action_string,
-                                           method_string,
-                                           info_string,
-                                           perc))
-          ZIPERR(ZE_ABORT, "User terminated operation");
-      }
-# if defined(WIN32) && defined(LARGE_FILE_SUPPORT)
-      else
-      {
-        char *oname;
-        char *uname;
-
-        oname = z->oname;
-#  ifdef UNICODE_SUPPORT
-        uname = z->uname;
-#  else
-        uname = NULL;
-#  endif
-        /* no int64 support in caller */
-        filesize64 = z->siz;
-        low = (unsigned long)(filesize64 & 0x00000000FFFFFFFF);
-        high = (unsigned long)((filesize64 >> 32) & 0x00000000FFFFFFFF);
-        if (lpZipUserFunctions->service_no_int64 != NULL) {
-          if ((*lpZipUserFunctions->service_no_int64)(oname,
-                                                      uname,
-                                                      low,
-                                                      high))
-                    ZIPERR(ZE_ABORT, "User terminated operation");
-        }
-      }
-# endif /* defined(WIN32) && defined(LARGE_FILE_SUPPORT) */
-#endif /* ZIP_DLL_LIB */
-
-      files_so_far++;
-      /* current size of file (just before reading) */
-      good_bytes_so_far += z->len;
-      /* size of file on initial scan */
-      bytes_so_far += len;
-      *w = z;
-      w = &z->nxt;
-      zcount++;
-    }
-  } /* for found list (processing) */
-
-  /* NULLing this here prevents check_zipfile() from using
-     the password. */
-#if 0
-  if (key != NULL)
-  {
-    free((zvoid *)key);
-    key = NULL;
-  }
-#endif
-
-  /* final status 3/17/05 EG */
-
-#ifdef ENABLE_USER_PROGRESS
-  u_p_phase = 4;
-  u_p_task = "Finishing";
-#endif /* def ENABLE_USER_PROGRESS */
+#ifdef ENABLE_USER_PROGRESS
+  u_p_phase = 4;
+  u_p_task = "Finishing";
+#endif /* def ENABLE_USER_PROGRESS */
 
 #ifdef WINDOWS_LONG_PATHS
   if (archive_has_long_path) {
@@ -14705,7 +14571,7 @@ char **argv;            /* command line tokens */
 
 #if 0
           if (noisy)
-            zfprintf(mesg, "Enter comment for %s:\n", z->oname);
+            zfprintf(mesg, "Enter comment for %s:\n", ZONAME(z));
           if (fgets(e, MAXCOMLINE+1, comment_stream) != NULL)
           {
             if ((p = malloc((comment_size = strlen(e))+1)) == NULL)
@@ -15107,6 +14973,7 @@ char **argv;            /* command line tokens */
   k = 0;                        /* keep count for end header */
   c = tempzn;                   /* get start of central */
   n = t = 0;
+  cen_batch_begin();            /* write the headers in large pieces */
   for (z = zfiles; z != NULL; z = z->nxt)
   {
     if (z->mark || !(diff_mode || filesync)) {
@@ -15119,6 +14986,9 @@ char **argv;            /* command line tokens */
       k++;
     }
   }
+  if ((r = cen_batch_end()) != ZE_OK) {
+    ZIPERR(r, tempzip);
+  }
 
   if (k == 0)
     zipwarn("zip file empty", "");
@@ -15161,6 +15031,11 @@ char **argv;            /* command line tokens */
   if ((r = putend(k, t, c, zcomlen, zcomment)) != ZE_OK) {
     ZIPERR(r, tempzip);
   }
+#ifdef IZ_PREALLOC
+  if (prealloc_end(y)) {
+    ZIPERR(d ? ZE_WRITE : ZE_TEMP, tempzip);
+  }
+#endif
 
   /*
   tempzf = NULL;
@@ -15168,9 +15043,15 @@ char **argv;            /* command line tokens */
   if (y == current_local_file) {
     current_local_file = NULL;
   }
+#ifdef INPLACE_UPDATE
+  if (d && (r = journal_sync(y)) != ZE_OK) {
+    ZIPERR(r, tempzip);
+  }
+#endif
   if (fclose(y)) {
     ZIPERR(d ? ZE_WRITE : ZE_TEMP, tempzip);
   }
+  free_out_buffer(y);
   y = NULL;
   if (in_file != NULL) {
     fclose(in_file);
@@ -15211,7 +15092,14 @@ char **argv;            /* command line tokens */
   }
 #endif
 
-  /* Replace old zip file with new zip file, leaving only the new one */
+#ifdef INPLACE_UPDATE
+  /* in-place update is on disk and tested, journal no longer needed */
+  if (d) {
+    journal_commit();
+  }
+#endif
+
+  /* Replace old zip file with new zip file, leaving only the new one */
   if (strcmp(out_path, "-") && !d)
   {
     diag("replacing old zip file with new zip file");
@@ -15375,17 +15263,17 @@ char **argv;            /* command line tokens */
       if (z->mark) {
         if (!no_win32_wide) {
           if (!ClearArchiveBitW(z->namew)){
-            zipwarn("Could not clear archive bit for: ", z->oname);
+            zipwarn("Could not clear archive bit for: ", ZONAME(z));
           }
         } else {
           if (!ClearArchiveBit(z->name)){
-            zipwarn("Could not clear archive bit for: ", z->oname);
+            zipwarn("Could not clear archive bit for: ", ZONAME(z));
           }
         }
       }
 # else
       if (!ClearArchiveBit(z->name)){
-        zipwarn("Could not clear archive bit for: ", z->oname);
+        zipwarn("Could not clear archive bit for: ", ZONAME(z));
       }
 # endif
     }
@@ -15438,13 +15326,714 @@ char **argv;            /* command line tokens */
   }
 
   /* Finish up (process -o, -m, clean up).  Exit code depends on o. */
-#if (!defined(VMS) && !defined(CMS_MVS))
-  free((zvoid *) zipbuf);
-#endif /* !VMS && !CMS_MVS */
   RETURN(finish(o ? ZE_OPEN : ZE_OK));
 }
 
 
+/* Stat the files found and zip them up
+ *
+ * main() scans the files to add into the found list, stats them
+ * (keep_found()), and once the output is open zips them up with
+ * zipup_found().  With -sz (new archives only), the scan waits until
+ * the output is open, and newname() calls zipup_found() each time the
+ * found list holds FOUND_BATCH files.  zipup_found() then stats the
+ * batch itself, so compressing starts with the first files found and
+ * the found list never holds more than a batch.  New files are zipped
+ * in the order found, as there is no sorted found list to take them
+ * from.
+ */
+local void scan_files()
+/* Process file arguments from command line added using add_name(),
+   freeing filelist as they are done. */
+{
+  int r;
+  struct filelist_struct *filearg;
+
+  if (filelist) {
+    int old_no_wild = no_wild;
+
+    if (action == ARCHIVE) {
+      /* find in archive */
+      if (show_what_doing) {
+        sdmessage("sd: Scanning archive entries", "");
+      }
+      /* if looking in archive, "-" is not stdin */
+      no_stdin = 1;
+      for (; filelist; ) {
+        char *name = filelist->name;
+        if ((r = proc_archive_name(name, filter_match_case)) != ZE_OK) {
+          if (r == ZE_MISS) {
+            char *n = NULL;
+#ifdef WIN32
+            /* Win9x console always uses OEM character coding, and
+               WinNT console is set to OEM charset by default, too */
+            if ((n = malloc(strlen(name) + 1)) == NULL)
+              ZIPERR(ZE_MEM, "name not matched error");
+            INTERN_TO_OEM(name, n);
+#else
+            n = filelist->name;
+#endif
+            zipwarn("not in archive: ", n);
+#ifdef WIN32
+            free(n);
+#endif
+          }
+          else {
+            ZIPERR(r, name);
+          }
+        }
+        free(filelist->name);
+        filearg = filelist;
+        filelist = filelist->next;
+        free(filearg);
+      } /* for */
+    } /* ARCHIVE */
+
+    else if (skip_file_scan) {
+      /* skipping file scan - skip recursion and wildcard processing */
+      int zflags = 0;
+      int old_no_stdin = no_stdin;
+
+      if (show_what_doing) {
+        sdmessage("sd: skip-scan: only quick scan of files", "");
+      }
+      for (; filelist; ) {
+        no_wild = 1;
+        no_stdin = !(filelist->is_stdin);
+
+#ifdef ETWODD_SUPPORT
+        if (etwodd && filelist->is_stdin) {
+          ZIPERR(ZE_PARMS, "can't use -et (--etwodd) with input from stdin");
+        }
+#endif
+
+#ifdef UNICODE_SUPPORT_WIN32
+        if (!no_win32_wide) {
+          wchar_t *namew;
+          if (is_utf8_string(filelist->name, NULL, NULL, NULL, NULL)) {
+            namew = utf8_to_wchar_string(filelist->name);
+          }
+          else {
+            namew = local_to_wchar_string(filelist->name);
+          }
+          r = newnamew(namew, zflags, filter_match_case);
+          free(namew);
+        }
+        else
+#endif
+        {
+          r = newname(filelist->name, zflags, filter_match_case);
+        }
+
+        if (r != ZE_OK) {
+          zipwarn("name not matched: ", filelist->name);
+        }
+        free(filelist->name);
+        filearg = filelist;
+        filelist = filelist->next;
+        free(filearg);
+      } /* for */
+      no_stdin = old_no_stdin;
+    } /* skip file scan */
+
+    else /* file scan */
+    {
+      /* try find matching files on OS first then try find entries in archive */
+      if (show_what_doing) {
+        sdmessage("sd: Scanning files", "");
+      }
+      for (; filelist; ) {
+        no_wild = filelist->verbatim;
+        no_stdin = !(filelist->is_stdin);
+#ifdef ETWODD_SUPPORT
+        if (etwodd && filelist->is_stdin) {
+          ZIPERR(ZE_PARMS, "can't use -et (--etwodd) with input from stdin");
+        }
+#endif
+        r = PROCNAME(filelist->name);
+        if (r != ZE_OK) {
+
+          if (r == ZE_MISS) {
+            if (bad_open_is_error) {
+              zipwarn("name not matched: ", filelist->name);
+              ZIPERR(ZE_OPEN, filelist->name);
+            } else {
+              zipwarn("name not matched: ", filelist->name);
+            }
+          } else {
+            ZIPERR(r, filelist->name);
+          }
+        }
+        free(filelist->name);
+        filearg = filelist;
+        filelist = filelist->next;
+        free(filearg);
+      } /* for filelist */
+    } /* file scan */
+    no_wild = old_no_wild;
+  } /* filelist */
+}
+
+local int keep_found(f)
+  struct flist far *f;          /* new file in the found list */
+/* Get the size of f for the totals, and check it against the -t and -tt
+   dates.  Return 0 if f is to be dropped from the found list. */
+{
+  ulg tf;                       /* file time */
+  uzoff_t usize;                /* file size */
+
+  /* At this point only the global flag is_stdin determines if this is stdin to
+  filetime().  The name "-" is no longer special from this point on. */
+  is_stdin = f->is_stdin;
+  no_stdin = 1;
+
+  tf = 0;
+  usize = (uzoff_t)-1;
+  if (skip_file_scan) {
+    /* We skip getting the file size to avoid the performance penalty.  So
+       all the file sizes are set to zero and any operations using file
+       size won't work.  When the file is actually archived later another
+       stat is done and the file size gotten. */
+    uzoff_t usize = 0;
+
+#ifdef UNICODE_SUPPORT
+    f->utf8_path = 0;
+    /* if Unix port and locale UTF-8, assume paths UTF-8 */
+    if (using_utf8 && (f->uname != NULL)) {
+      f->utf8_path = 1;
+    }
+#endif
+    if ((action != DELETE) && (action != FRESHEN)
+#ifdef UNIX_APPLE
+     && (!IS_ZFLAG_APLDBL(f->zflags))
+#endif /* UNIX_APPLE */
+     ) {
+#ifdef UNICODE_SUPPORT_WIN32
+      if ((!no_win32_wide) && (f->namew != NULL)) {
+        /* if have namew, assume got it from wide file scan or
+           wide command line */
+        if (f->uname) {
+          f->utf8_path = 1;
+        }
+      }
+#endif
+
+#if 0
+        WIN32_FILE_ATTRIBUTE_DATA    fileInfo;
+ 
+        if(GetFileAttributesEx(f->name, 0, &fileInfo))
+        {
+          usize = fileInfo.nFileSizeLow;
+//            printf("- GFAE size %d  %s\n", usize, f->name);
+        }
+        else {
+//            printf("- GFAE failed %s\n", f->name);
+        }
+#endif
+    }
+
+#if 0
+    if (action == DELETE || action == FRESHEN ||
+        ((tf == 0)
+#ifdef UNIX_APPLE
+        /* Don't bother an AppleDouble file. */
+        && (!IS_ZFLAG_APLDBL(f->zflags))
+#endif /* UNIX_APPLE */
+        ) ||
+        tf < before || (after && tf >= after) ||
+        (namecmp(f->zname, zipfile) == 0 && !zip_to_stdout)
+       ) {
+      Trace((stderr, "zip diagnostic: ignore file\n"));
+      return 0;
+    }
+    else
+#endif
+    {
+      /* ??? */
+      files_total++;
+      f->usize = usize;
+#if 0
+      if (usize != (uzoff_t) -1 && usize != (uzoff_t) -2) {
+        bytes_total += usize;
+        f->usize = usize;
+      }
+#endif
+      return 1;
+    }
+
+  } /* skip file scan */
+
+  else {
+    /* file scan */
+    ulg tfp;
+    ulg tfm;
+
+    if (!(display_bytes || display_est_to_go || display_zip_rate ||
+          show_files) && (zcount == 0 || stream_add == 2))
+      /* We skip getting the file info (time, size...) to avoid the
+         performance penalty, as we don't need it in these cases.
+         Perhaps there are other cases where we don't need to stat.
+         (With -sz, zcount is the count of files added so far.) */
+      tf = (ulg)-1;
+#ifdef UNICODE_SUPPORT
+    f->utf8_path = 0;
+    /* if Unix port and locale UTF-8, assume paths UTF-8 */
+    if (using_utf8 && (f->uname != NULL)) {
+      f->utf8_path = 1;
+    }
+#endif
+    if ((action != DELETE) && (action != FRESHEN)
+#ifdef UNIX_APPLE
+     && (!IS_ZFLAG_APLDBL(f->zflags))
+#endif /* UNIX_APPLE */
+     ) {
+#ifdef UNICODE_SUPPORT_WIN32
+      if ((!no_win32_wide) && (f->namew != NULL)) {
+        /* Use Windows wide name */
+        if (tf != (ulg)-1) {
+          tf = filetimew(f->namew, (ulg *)NULL, (zoff_t *)&usize, NULL);
+        }
+        /* if have namew, assume got it from wide file scan or
+           wide command line */
+        if (f->uname) {
+          f->utf8_path = 1;
+        }
+      }
+      else if (tf != (ulg)-1) {
+        /* Use regular name */
+        tf = filetime(f->name, (ulg *)NULL, (zoff_t *)&usize, NULL);
+      }
+#else
+      if (tf != (ulg)-1) {
+        /* Everyone else uses regular name (which may be UTF-8) */
+        tf = filetime(f->name, (ulg *)NULL, (zoff_t *)&usize, NULL);
+      }
+#endif
+    }
+
+    tfp = tf + time_diff;
+    tfm = tf - time_diff;
+    if ((tf != (ulg)-1) &&
+        (action == DELETE || action == FRESHEN ||
+         ((tf == 0)
+#ifdef UNIX_APPLE
+         /* Don't bother an AppleDouble file. */
+          && (!IS_ZFLAG_APLDBL(f->zflags))
+#endif /* UNIX_APPLE */
+         ) ||
+         (tf < before && (!time_diff || tfp < before)) ||
+         (after && (tf >= after && (!time_diff || tfm >= after))) ||
+         (zipfile && namecmp(f->zname, zipfile) == 0 && !zip_to_stdout)
+        )) {
+      Trace((stderr, "zip diagnostic: ignore file\n"));
+      return 0;
+    }
+    else {
+      /* ??? */
+      files_total++;
+      f->usize = 0;
+      if (usize != (uzoff_t)-1 && usize != (uzoff_t)-2) {
+        bytes_total += usize;
+        f->usize = usize;
+      }
+      return 1;
+    }
+  } /* file scan */
+}
+
+local int is_tempzip(f)
+  struct flist far *f;          /* new file in the found list */
+/* With -sz the scan runs while the temporary zip file is being written,
+   and may come across it.  Return 1 if f is that file. */
+{
+  z_stat s;
+  extent n, b;
+
+  if (tempzbase == NULL || f->is_stdin)
+    return 0;
+  n = strlen(f->name);
+  b = strlen(tempzbase);
+  if (n < b || strcmp(f->name + n - b, tempzbase) != 0 ||
+      zstat(f->name, &s) != 0)
+    return 0;
+#ifdef VMS
+  return memcmp(s.st_ino, tempzstat.st_ino, sizeof(s.st_ino)) == 0 &&
+         strcmp(s.st_dev, tempzstat.st_dev) == 0;
+#else
+  return s.st_ino == tempzstat.st_ino && s.st_dev == tempzstat.st_dev;
+#endif
+}
+
+void zipup_found()
+/* Zip up the files in the found list, expelling each one as it is done,
+   and link the new entries onto zfiles at zf_w. */
+{
+  struct flist far *f;          /* steps through found linked list */
+  struct zlist far *z;          /* new zfiles entry */
+  struct zlist far * far *w;    /* pointer to last link in zfiles list */
+  int r;                        /* temporary variable */
+  int old_is_stdin = is_stdin;
+  int old_no_stdin = no_stdin;
+#ifdef IZ_URING
+  struct flist far *ra_f;       /* next found file to read ahead */
+#endif
+
+  if (stream_add == 2) {
+    /* -sz: the stat pass main() makes over the found list */
+    for (f = found; f != NULL; ) {
+      Trace((stderr, "zip diagnostic: new file=%s\n", f->oname));
+      if (!is_tempzip(f) && keep_found(f))
+        f = f->nxt;
+      else
+        f = fexpel(f);
+    }
+  }
+
+  w = zf_w;
+#ifdef IZ_URING
+  ra_f = found;
+#endif
+  for (f = found; f != NULL; f = fexpel(f))
+  {
+    /* process found list */
+
+    uzoff_t len;
+
+#ifdef IZ_URING
+    if (read_ahead) {
+      /* drop read-ahead of skipped files, keep the next ones coming */
+      uring_skip_to(f_seq);
+      for (; ra_f != NULL; ra_f = ra_f->nxt, ra_seq++) {
+        if (ra_f->is_stdin || IS_ZFLAG_DIR(ra_f->zflags) ||
+            IS_ZFLAG_FIFO(ra_f->zflags) || IS_ZFLAG_APLDBL(ra_f->zflags))
+          continue;
+        if (!uring_prefetch(ra_f->name, ra_seq))
+          break;
+      }
+      if (ra_f == f) {
+        /* queue full, go on without it (f is freed below) */
+        ra_f = f->nxt;
+        ra_seq++;
+      }
+      f_seq++;
+    }
+#endif
+
+    /* add a new zfiles entry and set the name */
+    if ((z = (struct zlist far *)farmalloc(sizeof(struct zlist))) == NULL) {
+      ZIPERR(ZE_MEM, "was adding files to zip file");
+    }
+    z->zblock = 0;
+    z->nxt = NULL;
+    z->name = f->name;
+    f->name = NULL;
+#ifdef UNICODE_SUPPORT
+    z->uname = NULL;          /* UTF-8 name for extra field */
+    z->zuname = NULL;         /* externalized UTF-8 name for matching */
+    z->ouname = NULL;         /* display version of UTF-8 name with OEM */
+
+# if 0
+    /* New AppNote bit 11 allowing storing UTF-8 in path */
+    if (utf8_native && f->uname) {
+      if (f->iname)
+        free(f->iname);
+      if ((f->iname = malloc(strlen(f->uname) + 1)) == NULL)
+        ZIPERR(ZE_MEM, "Unicode bit 11");
+      strcpy(f->iname, f->uname);
+#  ifdef WIN32
+      if (f->inamew)
+        free(f->inamew);
+      f->inamew = utf8_to_wchar_string(f->iname);
+#  endif
+    }
+# endif
+
+    /* Only set z->uname if have a non-ASCII Unicode name */
+    /* The Unicode path extra field is created if z->uname is not NULL,
+       unless on a UTF-8 system, then instead of creating the extra field
+       set bit 11 in the General Purpose Bit Flag */
+    {
+      int is_ascii = 0;
+
+# ifdef WIN32
+      if (!no_win32_wide)
+        is_ascii = is_ascii_stringw(f->inamew);
+      else
+        is_ascii = is_ascii_string(f->uname);
+# else
+      is_ascii = is_ascii_string(f->uname);
+# endif
+
+      if (z->uname == NULL) {
+        if (!is_ascii)
+          z->uname = f->uname;
+        else
+          name_free(f->uname);
+      } else {
+        name_free(f->uname);
+      }
+    }
+    f->uname = NULL;
+
+    z->utf8_path = f->utf8_path;
+#endif /* UNICODE_SUPPORT */
+
+    z->iname = f->iname;
+    f->iname = NULL;
+    z->zname = f->zname;
+    f->zname = NULL;
+    z->oname = f->oname;
+    f->oname = NULL;
+#ifdef UNICODE_SUPPORT_WIN32
+    z->namew = f->namew;
+    f->namew = NULL;
+    z->inamew = f->inamew;
+    f->inamew = NULL;
+    z->znamew = f->znamew;
+    f->znamew = NULL;
+#endif
+    z->zflags = f->zflags;
+    z->is_stdin = f->is_stdin;
+
+    z->flg = 0;
+#ifdef UNICODE_SUPPORT
+    if (z->uname && utf8_native)
+      z->flg |= UTF8_BIT;
+#endif
+
+    z->ext = z->cext = z->com = 0;
+    z->extra = z->cextra = NULL;
+    z->mark = 1;
+    z->dosflag = f->dosflag;
+    /* zip it up */
+    DisplayRunningStats();
+
+#ifdef ENABLE_USER_PROGRESS
+    u_p_name = ZONAME(z);
+#endif /* def ENABLE_USER_PROGRESS */
+
+    strcpy(action_string, "add");
+
+    if (noisy)
+    {
+#ifdef UNICODE_SUPPORT
+      if (unicode_show && z->uname) {
+        sprintf(errbuf, "  adding: %s", z->uname);
+        print_utf8(errbuf);
+      }
+      else
+#endif
+      {
+        zfprintf(mesg, "  adding: %s", ZONAME(z));
+      }
+      if (z->is_stdin) {
+        fprintf(mesg, " (stdin)");
+      }
+      mesg_line_started = 1;
+      fflush(mesg);
+    }
+    if (logall)
+    {
+#ifdef UNICODE_SUPPORT
+      if (log_utf8 && z->uname)
+        zfprintf(logfile, "  adding: %s", z->uname);
+      else
+#endif
+      {
+        zfprintf(logfile, "  adding: %s", ZONAME(z));
+      }
+      if (z->is_stdin) {
+        zfprintf(logfile, " (stdin)");
+      }
+      logfile_line_started = 1;
+      fflush(logfile);
+    }
+    /* initial scan */
+
+    /* zip up found list */
+
+    len = f->usize;
+    if ((r = zipup(z)) != ZE_OK  && r != ZE_OPEN && r != ZE_MISS &&
+        r != ZE_SKIP && r != ZE_SAME)
+    {
+      zipmessage_nl("", 1);
+      /*
+      if (noisy)
+      {
+#if (!defined(MACOS) && !defined(ZIP_DLL_LIB))
+        putc('\n', mesg);
+        fflush(mesg);
+#else
+        fprintf(stdout, "\n");
+#endif
+        mesg_line_started = 0;
+        fflush(mesg);
+      }
+      if (logall) {
+        fprintf(logfile, "\n");
+        logfile_line_started = 0;
+        fflush(logfile);
+      }
+      */
+      sprintf(errbuf, "was zipping %s", ZONAME(z));
+      ZIPERR(r, errbuf);
+    } /* zipup */
+    if (r == ZE_OPEN || r == ZE_MISS || r == ZE_SKIP || r == ZE_SAME)
+    {
+      zf_open_err = 1;
+      zipmessage_nl("", 1);
+      /*
+      if (noisy)
+      {
+#if (!defined(MACOS) && !defined(ZIP_DLL_LIB))
+        putc('\n', mesg);
+        fflush(mesg);
+#else
+        fprintf(stdout, "\n");
+#endif
+        mesg_line_started = 0;
+        fflush(mesg);
+      }
+      if (logall) {
+        fprintf(logfile, "\n");
+        logfile_line_started = 0;
+        fflush(logfile);
+      }
+      */
+      if (r == ZE_OPEN) {
+        zipwarn_indent("could not open for reading: ", ZONAME(z));
+        zipwarn_indent( NULL, strerror( errno));
+        if (bad_open_is_error) {
+          sprintf(errbuf, "was zipping %s", z->name);
+          ZIPERR(r, errbuf);
+        }
+        strcpy(action_string, "can't open/read");
+      } else if (r == ZE_MISS) {
+        zipwarn_indent("name not matched: ", ZONAME(z));
+        strcpy(action_string, "name not matched");
+      } else if (r == ZE_SKIP) {
+        zipwarn_indent("ignoring special file: ", ZONAME(z));
+        strcpy(action_string, "ignoring special");
+      } else {
+        zipwarn_indent("file and directory with the same name (2): ",
+         ZONAME(z));
+        strcpy(action_string, "filename=dirname");
+      }
+      files_so_far++;
+      bytes_so_far += len;
+      bad_files_so_far++;
+      bad_bytes_so_far += len;
+#ifdef ENABLE_USER_PROGRESS
+      u_p_name = NULL;
+#endif /* def ENABLE_USER_PROGRESS */
+      name_free((zvoid *)(z->name));
+      name_free((zvoid *)(z->iname));
+      name_free((zvoid *)(z->zname));
+      name_free(z->oname);
+#ifdef UNICODE_SUPPORT
+      if (z->uname)
+        name_free(z->uname);
+# ifdef UNICODE_SUPPORT_WIN32
+      if (z->namew)
+        free((zvoid *)(z->namew));
+      if (z->inamew)
+        free((zvoid *)(z->inamew));
+      if (z->znamew)
+        free((zvoid *)(z->znamew));
+# endif
+#endif /* UNICODE_SUPPORT */
+      zlist_free(z);
+    }
+    else
+    {
+      /* Not ZE_OPEN or ZE_MISS */
+#ifdef ZIP_DLL_LIB
+      /* process found list */
+      if (lpZipUserFunctions->service != NULL)
+      {
+        char us[100];
+        char cs[100];
+        long perc = 0;
+        char *oname;
+        char *uname;
+
+
+        oname = ZONAME(z);
+# ifdef UNICODE_SUPPORT
+        uname = z->uname;
+# else
+        uname = NULL;
+# endif
+        if (uname == NULL)
+          uname = ZONAME(z);
+
+        WriteNumString(z->siz, cs);
+        WriteNumString(z->len, us);
+        if (z->siz)
+          perc = percent(z->len, z->siz);
+
+        if ((*lpZipUserFunctions->service)(oname,
+                                           uname,
+                                           us,
+
+                                           cs,
+                                           z->len,
+                                           z->siz,
+                                           action_string,
+                                           method_string,
+                                           info_string,
+                                           perc))
+          ZIPERR(ZE_ABORT, "User terminated operation");
+      }
+# if defined(WIN32) && defined(LARGE_FILE_SUPPORT)
+      else
+      {
+        char *oname;
+        char *uname;
+
+        oname = ZONAME(z);
+#  ifdef UNICODE_SUPPORT
+        uname = z->uname;
+#  else
+        uname = NULL;
+#  endif
+        /* no int64 support in caller */
+        filesize64 = z->siz;
+        low = (unsigned long)(filesize64 & 0x00000000FFFFFFFF);
+        high = (unsigned long)((filesize64 >> 32) & 0x00000000FFFFFFFF);
+        if (lpZipUserFunctions->service_no_int64 != NULL) {
+          if ((*lpZipUserFunctions->service_no_int64)(oname,
+                                                      uname,
+                                                      low,
+                                                      high))
+                    ZIPERR(ZE_ABORT, "User terminated operation");
+        }
+      }
+# endif /* defined(WIN32) && defined(LARGE_FILE_SUPPORT) */
+#endif /* ZIP_DLL_LIB */
+
+      files_so_far++;
+      /* current size of file (just before reading) */
+      good_bytes_so_far += z->len;
+      /* size of file on initial scan */
+      bytes_so_far += len;
+      *w = z;
+      w = &z->nxt;
+      zcount++;
+    }
+  } /* for found list (processing) */
+  zf_w = w;
+  fnxt = &found;
+
+  if (stream_add == 2) {
+    /* back to the scan */
+    is_stdin = old_is_stdin;
+    no_stdin = old_no_stdin;
+  }
+}
+
+
+
 /***************  END OF ZIP MAIN CODE  ***************/
 
 
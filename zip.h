@@ -745,6 +745,7 @@ struct zlist {
   int encrypt_method;
   ush thresh_mthd;              /* Compression method used to determine Zip64 threshold */
   int is_stdin;                 /* Set if input file is stdin */   
+  int zblock;                   /* Set if from an entry block (zlist_alloc()) */
   struct zlist far *nxt;        /* Pointer to next header in list */
 };
 
@@ -909,10 +910,10 @@ extern char *global_entry_comment_path; /* If set, use this path for entry comme
 /* Public globals */
 extern uch upper[256];          /* Country dependent case map table */
 extern uch lower[256];
-#ifdef EBCDIC
+#ifdef IZ_EBCDIC_TABLES
 extern ZCONST uch ascii[256];   /* EBCDIC <--> ASCII translation tables */
 extern ZCONST uch ebcdic[256];
-#endif /* EBCDIC */
+#endif /* IZ_EBCDIC_TABLES */
 
 #if (!defined(USE_ZLIB) || defined(USE_OWN_CRCTAB))
   extern ZCONST ulg near *crc_32_tab;
@@ -1445,6 +1446,11 @@ extern uzoff_t bytes_this_split; /* bytes written to current split */
 extern int read_split_archive;   /* 1=scanzipf_reg detected spanning signature */
 extern int split_method;         /* 0=no splits, 1=seekable, 2=data descs, -1=no */
 extern uzoff_t split_size;       /* how big each split should be */
+extern extent outbuf_size;       /* stdio buffer size for output (--write-buffer) */
+extern uzoff_t prealloc_step;    /* archive preallocation step (--prealloc) */
+extern int read_ahead;           /* 1=open and read input files ahead (-ra) */
+extern int nocache;              /* input out of page cache, 2=O_DIRECT (-nc) */
+extern int stream_add;           /* 1=zip new files as found (-sz), 2=scanning */
 extern int split_bell;           /* when pause for next split ring bell */
 extern uzoff_t bytes_prev_splits; /* total bytes written to all splits before this */
 extern uzoff_t bytes_this_entry; /* bytes written for this entry across all splits */
@@ -1722,6 +1728,7 @@ extern int bflag;
 #  define error(msg)    ziperr(ZE_LOGIC, msg)
 #else
    void error OF((ZCONST char *));
+   void zipup_found OF((void));
 #  ifdef VMSCLI
      void help OF((void));
 #  endif
@@ -1746,6 +1753,9 @@ extern int bflag;
 #  else
      void flush_outbuf OF((char *, unsigned *));
      extern unsigned (*read_buf) OF((char *, unsigned int));
+#    ifdef IZ_SPARSE
+       extern int read_buf_zeros;
+#    endif
 #  endif /* !USE_ZLIB */
    int seekable OF((FILE *));
 
@@ -1766,6 +1776,9 @@ extern int bflag;
         /* in zipfile.c */
 #ifndef UTIL
    struct zlist far *zsearch OF((ZCONST char *));
+   void zsearch_index OF((void));
+   void zsearch_free OF((void));
+   ulg zname_hash OF((ZCONST char *));
 #  ifdef USE_EF_UT_TIME
      int get_ef_ut_ztime OF((struct zlist far *, iztimes *));
 #  endif /* USE_EF_UT_TIME */
@@ -1773,6 +1786,32 @@ extern int bflag;
 #endif /* !UTIL */
 char *ziptyp OF((char *));
 int readzipfile OF((void));
+/* entries of the archive read, in blocks */
+struct zlist far *zlist_alloc OF((void));
+void zlist_free OF((struct zlist far *));
+void zlist_blocks_free OF((void));
+/* display names, made on first use */
+char *zlist_oname OF((struct zlist far *));
+#define ZONAME(z) ((z)->oname != NULL ? (z)->oname : zlist_oname(z))
+#if defined(UNICODE_SUPPORT) && !defined(UTIL)
+   char *zlist_ouname OF((struct zlist far *));
+#  define ZOUNAME(z) ((z)->ouname != NULL || (z)->zuname == NULL ? \
+                      (z)->ouname : zlist_ouname(z))
+#endif
+#if !defined(UTIL) && defined(INPLACE_UPDATE)
+   /* journal for in-place updates */
+   int journal_begin OF((char *, FILE *, uzoff_t));
+   int journal_sync OF((FILE *));
+   int journal_active OF((void));
+   int journal_rollback OF((void));
+   void journal_commit OF((void));
+   int journal_recover OF((char *));
+#endif
+#ifndef UTIL
+   /* entries one at a time, for listing (-sf) */
+   int zlist_stream_open OF((void));
+   int zlist_stream OF((int (*)(struct zlist far *)));
+#endif
 /*#ifdef LCC_WIN32*/
 #ifndef NO_PROTO
 int zread_file(struct zlist far *z, int l);
@@ -1785,6 +1824,9 @@ int putlocal OF((struct zlist far *, int));
 #endif
 int putextended OF((struct zlist far *));
 int putcentral OF((struct zlist far *));
+void cen_batch_begin OF((void));
+int cen_batch_end OF((void));
+void cen_batch_drop OF((void));
 /* zip64 support 09/05/2003 R.Nausedat */
 int putend OF((uzoff_t, uzoff_t, uzoff_t, ush, char *));
 /* moved seekable to separate function 3/14/05 EG */
@@ -1835,6 +1877,7 @@ void display_dot OF((int, int));
    wchar_t *msnamew OF((wchar_t *));
 # endif
    int check_dup_sort OF((int sort_found));
+   void found_dup_free OF((void));
    int filter OF((char *, int));
 #ifndef NO_PROTO
    int newname(char *name, int zflags, int casesensitive);
@@ -1873,6 +1916,30 @@ char *tempname OF((char *));
 
 /* for splits */
 int close_split OF((ulg, FILE *, char *));
+int set_out_buffer OF((FILE *));
+void free_out_buffer OF((FILE *));
+#ifdef IZ_PREALLOC
+  void prealloc_begin OF((FILE *));
+  int prealloc_end OF((FILE *));
+#endif
+
+#if !defined(UTIL) && \
+    (defined(IZ_URING) || defined(IZ_NOCACHE) || defined(IZ_SPARSE))
+  /* input files (unix/unix.c) */
+  int ufile_open OF((char *, int));
+  long ufile_read OF((int, char *, extent));
+  int ufile_rewind OF((int));
+  int ufile_close OF((int));
+#endif
+#if !defined(UTIL) && defined(IZ_SPARSE)
+  int ufile_sparse OF((int));
+  int ufile_zeros OF((int));
+#endif
+#if !defined(UTIL) && defined(IZ_URING)
+  /* io_uring read-ahead of input files (unix/unix.c) */
+  int uring_prefetch OF((char *, ulg));
+  void uring_skip_to OF((ulg));
+#endif
 int ask_for_split_read_path OF((ulg));
 int ask_for_split_write_path OF((ulg));
 char *get_in_split_path OF((char *, ulg));
@@ -1882,6 +1949,9 @@ int rename_split OF((char *, char *));
 int set_filetype OF((char *));
 
 int bfcopy OF((uzoff_t));
+#ifdef IZ_COPY_RANGE
+  uzoff_t zfcopy_fd OF((int, zoff_t, uzoff_t));
+#endif
 
 int fcopy OF((FILE *, FILE *, uzoff_t));
 
@@ -2025,6 +2095,17 @@ char *string_dup(ZCONST char *in_string, ZCONST char *error_message, int fluff);
 char *string_dup OF((ZCONST char *, char *, int));
 #endif
 
+/* Names that live until zip is done (see name_alloc() in fileio.c) */
+char *name_alloc OF((extent));
+#ifndef NO_PROTO
+char *name_dup(ZCONST char *in_string, ZCONST char *error_message, int fluff);
+#else
+char *name_dup OF((ZCONST char *, char *, int));
+#endif
+void name_free OF((zvoid *));
+char *name_share OF((char *, char *));
+void name_arena_free OF((void));
+
 /* Wide version of string_dup() */
 #ifdef WIN32
 # ifndef NO_PROTO
@@ -2093,13 +2174,20 @@ int free_flags OF((option_flag *[]));
 
 void init_upper    OF((void));
 int  namecmp       OF((ZCONST char *string1, ZCONST char *string2));
-
-#ifdef EBCDIC
+#define NSORT_CASEMAP 0         /* name_sort() folds keys as namecmp() */
+#define NSORT_LOWER   1         /* name_sort() folds keys as strcasecmp() */
+void name_sort     OF((zvoid **base, extent n,
+                       char *(*name)(ZCONST zvoid *), int fold,
+                       int (*cmp)(ZCONST zvoid *, ZCONST zvoid *)));
+
+#ifdef IZ_EBCDIC_TABLES
+  char *memxlate     OF((char *mem1, ZCONST char *mem2, extent len,
+                         ZCONST uch *table));
   char *strtoasc     OF((char *str1, ZCONST char *str2));
   char *strtoebc     OF((char *str1, ZCONST char *str2));
   char *memtoasc     OF((char *mem1, ZCONST char *mem2, unsigned len));
   char *memtoebc     OF((char *mem1, ZCONST char *mem2, unsigned len));
-#endif /* EBCDIC */
+#endif /* IZ_EBCDIC_TABLES */
 #ifdef IZ_ISO2OEM_ARRAY
   char *str_iso_to_oem    OF((char *dst, ZCONST char *src));
 #endif
@@ -2117,6 +2205,51 @@ void expand_args   OF((int *, char ***));
 #else
   int  is_text_buf OF((ZCONST char *buf_ptr, size_t buf_size));
 #endif
+extent ascii_span    OF((ZCONST char *s, int printable));
+
+/* Runtime CPU feature dispatch (see IZ_CPU_DISPATCH in tailor.h).
+ * cpu_dispatch_init() probes the CPU once and points each kernel
+ * pointer below at the best version available.  Until it runs, the
+ * pointers hold the portable C versions.
+ */
+#ifdef IZ_CPU_DISPATCH
+# define CPU_SSE2     0x0001
+# define CPU_SSSE3    0x0002
+# define CPU_SSE41    0x0004
+# define CPU_PCLMUL   0x0008
+
+extern int cpu_features;        /* CPU_ bits found by cpu_dispatch_init() */
+
+void  cpu_dispatch_init   OF((void));
+char *cpu_dispatch_string OF((void));
+
+extern int (*is_text_kernel) OF((ZCONST char *buf_ptr, size_t buf_size));
+int   is_text_buf_c       OF((ZCONST char *buf_ptr, size_t buf_size));
+int   is_text_buf_sse2    OF((ZCONST char *buf_ptr, size_t buf_size));
+
+# if !defined(USE_ZLIB) && !defined(ASM_CRC)
+#  define DISPATCH_CRC32
+  extern ulg (*crc32_kernel) OF((ulg crc, ZCONST uch *buf, extent len));
+  ulg crc32_c             OF((ulg crc, ZCONST uch *buf, extent len));
+  ulg crc32_pclmul        OF((ulg crc, ZCONST uch *buf, extent len));
+# endif
+
+# ifndef UTIL
+#  if !defined(USE_ZLIB) && !defined(ASMV)
+#   define DISPATCH_LONGEST_MATCH
+   extern int (*longest_match_kernel) OF((unsigned cur_match));
+   int longest_match_c    OF((unsigned cur_match));
+   int longest_match_sse2 OF((unsigned cur_match));
+#  endif
+#  ifndef EBCDIC
+#   define DISPATCH_LF_TO_CRLF
+   extern unsigned (*lf_to_crlf_kernel) OF((char *dst, ZCONST char *src,
+                                            unsigned size));
+   unsigned lf_to_crlf_c    OF((char *dst, ZCONST char *src, unsigned size));
+   unsigned lf_to_crlf_sse2 OF((char *dst, ZCONST char *src, unsigned size));
+#  endif
+# endif /* ndef UTIL */
+#endif /* def IZ_CPU_DISPATCH */
 
 /* this is no longer used ...
 unsigned int adler16 OF((unsigned int, ZCONST uch *, extent));
@@ -15,7 +15,7 @@
 
 #include "zip.h"
 #include "revision.h"
-#ifdef UNICODE_SUPPORT
+#if defined(UNICODE_SUPPORT) || defined(INPLACE_UPDATE)
 # include "crc32.h"
 #endif
 
@@ -24,6 +24,11 @@
 
 #include <errno.h>
 
+#ifdef INPLACE_UPDATE
+/* for flock() */
+# include <sys/file.h>
+#endif
+
 /* for toupper() */
 #include <ctype.h>
 
@@ -38,6 +43,14 @@
 # include <windows.h>
 #endif
 
+#if !defined(UTIL) && defined(INPLACE_UPDATE)
+# include <unistd.h>            /* ftruncate(), fsync(), unlink() */
+#endif
+
+#if !defined(UTIL) && defined(IZ_MAPIN)
+# include <sys/mman.h>          /* mmap() for zlist_stream() */
+#endif
+
 /*
  * XXX start of zipfile.h
  */
@@ -248,13 +261,22 @@ local void append_string_to_mem OF((char *, int, char**, extent *, extent *));
 /* Local functions */
 
 local int find_next_signature OF((FILE *f));
+local void sig_scan_drop OF((void));
 local int find_signature OF((FILE *, ZCONST char *));
 local int is_signature OF((ZCONST char *, ZCONST char *));
 local int at_signature OF((FILE *, ZCONST char *));
+local void cd_blk_start OF((FILE *, uzoff_t, uzoff_t));
+local void cd_blk_end OF((FILE *));
+local int cd_blk_fill OF((FILE *, extent));
+local int cd_next_signature OF((FILE *));
+local int cd_read OF((char *, extent, FILE *));
+local zoff_t cd_tell OF((FILE *));
 
 local int zqcmp OF((ZCONST zvoid *, ZCONST zvoid *));
+local char *zname_key OF((ZCONST zvoid *));
 #ifdef UNICODE_SUPPORT
  local int zuqcmp OF((ZCONST zvoid *, ZCONST zvoid *));
+ local char *zuname_key OF((ZCONST zvoid *));
 #endif
 #if 0
  local int scanzipf_reg OF((FILE *f));
@@ -321,6 +343,141 @@ ZCONST zvoid *a, *b;          /* pointers to pointers to zip entries */
  }
 #endif
 
+/* Names to key the zfile list by in name_sort(), as zqcmp() and
+ * zuqcmp() compare them. */
+
+local char *zname_key(z)
+  ZCONST zvoid *z;              /* pointer to zip entry */
+{
+  return ((struct zlist far *)z)->zname;
+}
+
+#ifdef UNICODE_SUPPORT
+ local char *zuname_key(z)
+   ZCONST zvoid *z;             /* pointer to zip entry */
+ {
+  if (((struct zlist far *)z)->zuname)
+    return ((struct zlist far *)z)->zuname;
+  return ((struct zlist far *)z)->zname;
+ }
+#endif
+
+
+/* Entry blocks
+ *
+ * A large archive means a zlist entry per central directory record,
+ * and a walk of zfiles (marking, the filesync compare, putcentral(),
+ * trash()) per pass.  With a farmalloc() each, the entries end up all
+ * over the heap and every step of a walk is a cache miss.  So
+ * scanzipf_regnew() takes its entries from blocks of consecutive
+ * structures instead (zlist_alloc()), and a walk of the list read goes
+ * through memory in order.  Blocks start at ZLIST_BLOCK_MIN entries and
+ * double up to ZLIST_BLOCK_MAX.  Entries from a block have zblock set;
+ * zlist_free() frees only the entries that came from farmalloc(), and
+ * zlist_blocks_free() releases the blocks when zip is done.
+ */
+struct zlist_block {
+  struct zlist_block *next;     /* block allocated before this one */
+  extent size;                  /* entries in e */
+  extent used;                  /* entries handed out */
+  struct zlist e[1];
+};
+
+local struct zlist_block *zlist_blocks = NULL;  /* newest first */
+
+struct zlist far *zlist_alloc()
+/* Return a new, zeroed entry from the current block, or NULL if out of
+   memory. */
+{
+  struct zlist_block *b;
+  extent size;
+
+  b = zlist_blocks;
+  if (b == NULL || b->used == b->size) {
+    size = ZLIST_BLOCK_MIN;
+    if (b != NULL)
+      size = IZ_MIN(2 * b->size, ZLIST_BLOCK_MAX);
+    if ((b = (struct zlist_block *)malloc(sizeof(struct zlist_block) +
+                                 (size - 1) * sizeof(struct zlist))) == NULL)
+      return NULL;
+    b->next = zlist_blocks;
+    b->size = size;
+    b->used = 0;
+    zlist_blocks = b;
+  }
+  /* the callers don't set every field */
+  memset((zvoid *)&b->e[b->used], 0, sizeof(struct zlist));
+  b->e[b->used].zblock = 1;
+  return &b->e[b->used++];
+}
+
+void zlist_free(z)
+  struct zlist far *z;
+/* Free an entry from farmalloc().  Entries from a block stay until
+   zlist_blocks_free(). */
+{
+  if (!z->zblock)
+    farfree((zvoid far *)z);
+}
+
+void zlist_blocks_free()
+/* Free all the entry blocks.  No entry from zlist_alloc() may be used
+   after this. */
+{
+  struct zlist_block *b;
+
+  while ((b = zlist_blocks) != NULL) {
+    zlist_blocks = b->next;
+    free((zvoid *)b);
+  }
+}
+
+/* zlist_oname() - display name of entry z, made on first use
+ *
+ * scanzipf_regnew() leaves z->oname NULL.  Most entries of a large
+ * archive are never named in a message (none are with -q), so the
+ * display name is made here the first time ZONAME() asks for it, and
+ * kept in z->oname (shared with the name it was made from if the same).
+ */
+char *zlist_oname(z)
+  struct zlist far *z;
+{
+  if (z->oname == NULL) {
+#if defined(UNICODE_SUPPORT) && !defined(UTIL)
+    if (z->iname != NULL)
+      z->oname = name_share(local_to_display_string(z->iname), z->iname);
+#else
+    if (z->zname != NULL)
+      z->oname = name_share(string_dup(z->zname, "zlist_oname", NO_FLUFF),
+                            z->zname);
+#endif
+  }
+  return z->oname;
+}
+
+#if defined(UNICODE_SUPPORT) && !defined(UTIL)
+/* zlist_ouname() - display version of z->zuname, made on first use
+ *
+ * As for zlist_oname(), for entries read by scanzipf_regnew() that have
+ * a Unicode name.  With -UN=escape or -UN=show, non-ASCII characters of
+ * the UTF-8 name are escaped.
+ */
+char *zlist_ouname(z)
+  struct zlist far *z;
+{
+# if !defined(WIN32) && !defined(EBCDIC)
+  if (z->ouname == NULL && z->uname != NULL && z->zuname != NULL) {
+    if (unicode_escape_all || unicode_show)
+      /* Escape anything not 7-bit ASCII */
+      z->ouname = utf8_to_escape_string(z->uname);
+    if (z->ouname == NULL)
+      z->ouname = string_dup(z->zuname, "zlist_ouname", NO_FLUFF);
+  }
+# endif
+  return z->ouname;
+}
+#endif /* UNICODE_SUPPORT && !UTIL */
+
 
 #ifndef UTIL
 
@@ -386,13 +543,182 @@ ZCONST zvoid far *z;    /* pointer to a pointer to a zip entry */
 # endif
 
 
+/* Hash index for zsearch()
+ *
+ * newname() looks up every file scanned, so with a large archive the
+ * two binary searches of zsort and zusort, at a namecmp() per probe,
+ * add up.  zsearch_index() is called once zsort (and zusort) are built
+ * and hashes the same entries into open-addressed tables: zhash keyed
+ * on zname, zuhash on zuname (zname if no Unicode name).  The hash
+ * folds case with case_map(), as namecmp() does, so names equal to
+ * namecmp() land in the same chain.  Where names repeat, the first
+ * entry in zfiles is found.  zsort and zusort are still there for
+ * anything that needs the entries in order.  If the tables cannot be
+ * allocated, zsearch() just uses the binary searches.
+ *
+ * Each table has an array of 16 bit tags (zhtag, zuhtag) beside it,
+ * taken from bits 16 to 31 of the hash, 0 for an empty slot.  A
+ * probe walks the tags and only reads the entry and its name when the
+ * tag matches, so a lookup that misses (a new file) touches no entry.
+ */
+local struct zlist far **zhash = NULL;  /* table keyed on zname */
+local ush *zhtag = NULL;                /* tags of zhash */
+# ifdef UNICODE_SUPPORT
+local struct zlist far **zuhash = NULL; /* table keyed on zuname */
+local ush *zuhtag = NULL;               /* tags of zuhash */
+# endif
+local extent zhash_mask;                /* table size - 1 (power of 2) */
+
+/* Tag of hash h, never 0 */
+#define ZHASH_TAG(h) ((ush)((h) >> 16) ? (ush)((h) >> 16) : (ush)1)
+
+ulg zname_hash(n)
+  ZCONST char *n;
+/* FNV-1a of the case-mapped name.  Also used by found_dup(). */
+{
+  ulg h = 2166136261UL;
+
+  while (*n) {
+    h ^= (ulg)(uch)case_map(*n);
+    h *= 16777619UL;
+    n++;
+  }
+  return h;
+}
+
+local void zhash_put(t, tag, z, n)
+  struct zlist far **t;
+  ush *tag;
+  struct zlist far *z;
+  ZCONST char *n;
+{
+  extent i;
+  ulg h;
+
+  h = zname_hash(n);
+  for (i = (extent)h & zhash_mask; tag[i] != 0; i = (i + 1) & zhash_mask)
+    ;
+  t[i] = z;
+  tag[i] = ZHASH_TAG(h);
+}
+
+void zsearch_index()
+/* Build the hash tables for zsearch() from the zfiles list. */
+{
+  extent size;
+  struct zlist far *z;
+
+  zsearch_free();
+  if (zcount == 0)
+    return;
+  for (size = 16; size < 2 * (extent)zcount; size <<= 1)
+    if (size > ((extent)-1) / (4 * sizeof(struct zlist far *)))
+      return;
+  zhash_mask = size - 1;
+  if ((zhash = (struct zlist far **)malloc(size *
+                  sizeof(struct zlist far *))) == NULL ||
+      (zhtag = (ush *)calloc(size, sizeof(ush))) == NULL) {
+    zsearch_free();
+    return;
+  }
+# ifdef UNICODE_SUPPORT
+  if ((zuhash = (struct zlist far **)malloc(size *
+                   sizeof(struct zlist far *))) == NULL ||
+      (zuhtag = (ush *)calloc(size, sizeof(ush))) == NULL) {
+    zsearch_free();
+    return;
+  }
+# endif
+  for (z = zfiles; z != NULL; z = z->nxt) {
+    zhash_put(zhash, zhtag, z, z->zname);
+# ifdef UNICODE_SUPPORT
+    zhash_put(zuhash, zuhtag, z, z->zuname ? z->zuname : z->zname);
+# endif
+  }
+}
+
+void zsearch_free()
+/* Free the zsearch() hash tables (done with zsort). */
+{
+  if (zhash != NULL) {
+    free((zvoid *)zhash);
+    zhash = NULL;
+  }
+  if (zhtag != NULL) {
+    free((zvoid *)zhtag);
+    zhtag = NULL;
+  }
+# ifdef UNICODE_SUPPORT
+  if (zuhash != NULL) {
+    free((zvoid *)zuhash);
+    zuhash = NULL;
+  }
+  if (zuhtag != NULL) {
+    free((zvoid *)zuhtag);
+    zuhtag = NULL;
+  }
+# endif
+}
+
+local struct zlist far *zhash_get(n, uni)
+  ZCONST char *n;       /* name to find */
+  int uni;              /* 1 = look in zuhash */
+{
+  struct zlist far **t;
+  ush *tag;
+  struct zlist far *z;
+  ZCONST char *zn;
+  extent i;
+  ulg h;
+  ush g;
+
+  t = zhash;
+  tag = zhtag;
+# ifdef UNICODE_SUPPORT
+  if (uni) {
+    t = zuhash;
+    tag = zuhtag;
+  }
+# endif
+  h = zname_hash(n);
+  g = ZHASH_TAG(h);
+  for (i = (extent)h & zhash_mask; tag[i] != 0; i = (i + 1) & zhash_mask) {
+    if (tag[i] != g)
+      continue;
+    z = t[i];
+    zn = z->zname;
+# ifdef UNICODE_SUPPORT
+    if (uni && z->zuname != NULL)
+      zn = z->zuname;
+# endif
+    if (namecmp(n, zn) == 0)
+      return z;
+  }
+  return NULL;
+}
+
 struct zlist far *zsearch(n)
   ZCONST char *n;      /* name to find */
 /* Return a pointer to the entry in zfile with the name n, or NULL if
-   not found. */
+   not found.  zcount can be nonzero with no zsort to search (the
+   entries -sz adds as it scans), so check zsort as well. */
 {
   zvoid far **p;        /* result of search() */
 
+  if (zsort == NULL)
+    return NULL;
+  if (zcount && zhash != NULL) {
+    struct zlist far *z;
+
+    if ((z = zhash_get(n, 0)) != NULL)
+      return z;
+# ifdef UNICODE_SUPPORT
+    /* Currently Unicode is not trusted for fix mode 2 (option -FF). */
+    if (fix != 2)
+      return zhash_get(n, 1);
+# endif
+    return NULL;
+  }
   if (zcount) {
     if ((p = search(n, (ZCONST zvoid far **)zsort, zcount, zbcmp)) != NULL)
       return *(struct zlist far **)p;
@@ -902,7 +1228,7 @@ local void read_Unicode_Path_entry(pZipListEntry)
   Version = (uch) *pTemp;
   pTemp += 1;
   if (Version > 1) {
-    zipwarn("Unicode Path Extra Field version > 1 - skipping", pZipListEntry->oname);
+    zipwarn("Unicode Path Extra Field version > 1 - skipping", ZONAME(pZipListEntry));
     return;
   }
 
@@ -938,12 +1264,12 @@ local void read_Unicode_Path_entry(pZipListEntry)
     zprintf("unicode_mismatch = %d\n", unicode_mismatch);
     if (unicode_mismatch == UNICODE_MISMATCH_WARN) {
       /* warn and continue */
-      zipwarn("Unicode does not match path - ignoring Unicode: ", pZipListEntry->oname);
+      zipwarn("Unicode does not match path - ignoring Unicode: ", ZONAME(pZipListEntry));
     } else if (unicode_mismatch == UNICODE_MISMATCH_IGNORE) {
       /* ignore and continue */
     } else if (unicode_mismatch == UNICODE_MISMATCH_ERROR) {
       /* error */
-      sprintf(errbuf, "Unicode does not match path:  %s\n", pZipListEntry->oname);
+      sprintf(errbuf, "Unicode does not match path:  %s\n", ZONAME(pZipListEntry));
       strcat(errbuf,
         "                     Likely entry name changed but Unicode not updated\n");
       strcat(errbuf,
@@ -1007,7 +1333,7 @@ local void read_Unicode_Path_local_entry(pZipListEntry)
   Version = (uch) *pTemp;
   pTemp += 1;
   if (Version > 1) {
-    zipwarn("Unicode Path Extra Field version > 1 - skipping", pZipListEntry->oname);
+    zipwarn("Unicode Path Extra Field version > 1 - skipping", ZONAME(pZipListEntry));
     return;
   }
 
@@ -1042,12 +1368,12 @@ local void read_Unicode_Path_local_entry(pZipListEntry)
   if (chksum != iname_chksum) {
     if (unicode_mismatch == UNICODE_MISMATCH_WARN) {
       /* warn and continue */
-      zipwarn("Unicode does not match path - ignoring Unicode: ", pZipListEntry->oname);
+      zipwarn("Unicode does not match path - ignoring Unicode: ", ZONAME(pZipListEntry));
     } else if (unicode_mismatch == UNICODE_MISMATCH_IGNORE) {
       /* ignore and continue */
     } else if (unicode_mismatch == UNICODE_MISMATCH_ERROR) {
       /* error */
-      sprintf(errbuf, "Unicode does not match path:  %s\n", pZipListEntry->oname);
+      sprintf(errbuf, "Unicode does not match path:  %s\n", ZONAME(pZipListEntry));
       strcat(errbuf,
         "                     Likely entry name changed but Unicode not updated\n");
       strcat(errbuf,
@@ -2641,14 +2967,14 @@ struct zlist far *z;
         sprintf(errbuf, "made by version %d.%d on system type %d: ",
                 (ush)(z->vem & 0xff) / (ush)10, (ush)(z->vem & 0xff) % (ush)10,
                 z->vem >> 8);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
     if (z->ver != 10 && z->ver != 11 && z->ver != 20 && z->ver != 45)
     {
         sprintf(errbuf, "needs unzip %d.%d on system type %d: ",
                 (ush)(z->ver & 0xff) / (ush)10,
                 (ush)(z->ver & 0xff) % (ush)10, z->ver >> 8);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
 
     if ((fix == 2) && (z->flg != z->lflg))
@@ -2662,19 +2988,19 @@ struct zlist far *z;
     {
         sprintf(errbuf, "local flags = 0x%04x, central = 0x%04x: ",
                 z->lflg, z->flg);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
     else if (z->flg & ~0xf && (z->flg & ~0xf0) != UTF8_BIT)
     /* Only bit in high byte we support is the new UTF-8 bit */
     {
         sprintf(errbuf, "undefined bits used in flags = 0x%04x: ", z->flg);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
 
 #if 0
     if (z->how > LAST_KNOWN_COMPMETHOD)    {
         sprintf(errbuf, "unknown compression method %u: ", z->how);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
 #endif
     if (z->how == (ush)BEST || z->how == STORE || z->how == DEFLATE
@@ -2692,18 +3018,18 @@ struct zlist far *z;
     }
     if (known_how == 0)    {
         sprintf(errbuf, "unknown compression method %u: ", z->how);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
 
     if (z->dsk)
     {
         sprintf(errbuf, "starts on disk %lu: ", z->dsk);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
     if (z->att!=FT_ASCII_TXT && z->att!=FT_BINARY && z->att!=FT_EBCDIC_TXT)
     {
         sprintf(errbuf, "unknown internal attributes = 0x%04x: ", z->att);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
 # if 0
 /* This test is ridiculous, it produces an error message for almost every */
@@ -2712,7 +3038,7 @@ struct zlist far *z;
     if (((n = z->vem >> 8) != 3) && n != 2 && n != 13 && z->atx & ~0xffL)
     {
         sprintf(errbuf, "unknown external attributes = 0x%08lx: ", z->atx);
-        zipwarn(errbuf, z->oname);
+        zipwarn(errbuf, ZONAME(z));
     }
 # endif
 
@@ -2728,7 +3054,7 @@ struct zlist far *z;
           sprintf(errbuf,
                   "local extra (%ld bytes) != central extra (%ld bytes): ",
                   (ulg)z->ext, (ulg)z->cext);
-          if (noisy) zfprintf(mesg, "        zip info: %s%s\n", errbuf, z->oname);
+          if (noisy) zfprintf(mesg, "        zip info: %s%s\n", errbuf, ZONAME(z));
         }
 #   if (!defined(RISCOS) && !defined(CMS_MVS))
         /* in noisy mode, extra field sizes are always reported */
@@ -2742,7 +3068,7 @@ struct zlist far *z;
 #  endif /* 0 */
         {
             zfprintf(mesg, "zip info: %s has %ld bytes of %sextra data\n",
-                    z->oname, z->ext ? (ulg)z->ext : (ulg)z->cext,
+                    ZONAME(z), z->ext ? (ulg)z->ext : (ulg)z->cext,
                     z->ext ? (z->cext ? "" : "local ") : "central ");
         }
     }
@@ -2848,6 +3174,7 @@ local int scanzipf_fix(f)
       if ((z = (struct zlist far *)farmalloc(sizeof(struct zlist))) == NULL ||
           zcount + 1 < zcount)
         return ZE_MEM;
+      z->zblock = 0;
       if (fread(b, LOCHEAD, 1, f) != 1) {
           farfree((zvoid far *)z);
           break;
@@ -3538,6 +3865,7 @@ zprintf("start of central directory cenbeg %ld\n", cenbeg);
         return ferror(f) ? ZE_READ : ZE_EOF;
       if ((z = (struct zlist far *)farmalloc(sizeof(struct zlist))) == NULL)
         return ZE_MEM;
+      z->zblock = 0;
       z->vem = SH(CENVEM + b);
       for (u = (char far *)(&(z->ver)), n = 0; n < (CENNAM-CENVER); n++)
         u[n] = b[CENVER + n];
@@ -3875,76 +4203,88 @@ char *copy_sig(copyto, copyfrom)
 #endif /* currently unused */
 
 
+/* find_next_signature() keeps the last block it read.  The callers read
+ * the header after a signature, maybe skip some data, and then look for
+ * the next signature, which is usually in the same block, so it is
+ * scanned from memory instead of read again.
+ */
+local uch sig_scan_buf[SIG_SCAN_BUFSIZE]; /* find_next_signature() window */
+local FILE *sig_scan_f = NULL;          /* file sig_scan_buf is from */
+local zoff_t sig_scan_off;              /* file offset of sig_scan_buf[0] */
+local extent sig_scan_len = 0;          /* bytes in sig_scan_buf */
+
+local void sig_scan_drop()
+/* Forget the block.  Called when in_file is opened, as a new FILE can
+   have the address of one closed before. */
+{
+  sig_scan_f = NULL;
+  sig_scan_len = 0;
+}
+
 local int find_next_signature(f)
   FILE *f;
+/* Scans the file from the current position for P K ? ?, the last two
+ * below 16, finding each 'P' with memchr() instead of a getc() per byte,
+ * which for -FF on a big archive took hours.  If the position is in the
+ * block kept from the last call, the scan starts there without reading;
+ * otherwise a new block is read at the position.  On a match the file is
+ * left just after the signature, else at EOF (or error).
+ */
 {
-  int m;
-  /* used for debugging */
-#if 0
-  zoff_t here;
-#endif /* 0 */
-
-  /* look for P K ? ? signature */
-
-  m = getc(f);
-
-#if 0
-  here = zftello(f);
-#endif /* 0 */
-
-  while (m != EOF)
-  {
-    if (m == 0x50 /*'P' except EBCDIC*/) {
-      /* found a P */
-      sigbuf[0] = (char) m;
-
-      if ((m = getc(f)) == EOF)
-        break;
-      if (m != 0x4b /*'K' except EBCDIC*/) {
-        /* not a signature */
-        ungetc(m, f);
-      } else {
-        /* found P K */
-        sigbuf[1] = (char) m;
-
-        if ((m = getc(f)) == EOF)
-          break;
-        if (m == 0x50 /*'P' except EBCDIC*/) {
-          /* not a signature but maybe start of new one */
-          ungetc(m, f);
-          continue;
-        } else if (m >= 16) {
-          /* last 2 chars expect < 16 for signature */
-          continue;
-        }
-        sigbuf[2] = (char) m;
-
-        if ((m = getc(f)) == EOF)
-          break;
-        if (m == 0x50 /*'P' except EBCDIC*/) {
-          /* not a signature but maybe start of new one */
-          ungetc(m, f);
-          continue;
-        } else if (m >= 16) {
-          /* last 2 chars expect < 16 */
-          continue;
-        }
-        sigbuf[3] = (char) m;
-
-        /* found possible signature */
+  zoff_t pos;           /* file position at the call */
+  extent start;         /* where to start scanning in sig_scan_buf */
+  extent keep;          /* first byte not yet ruled out */
+  extent n;
+  uch *p;
+  uch *end;
+
+  if ((pos = zftello(f)) < 0)
+    return 0;
+  if (f != sig_scan_f || pos < sig_scan_off ||
+      pos > sig_scan_off + (zoff_t)sig_scan_len) {
+    /* not in the block, start a new one here */
+    sig_scan_f = f;
+    sig_scan_off = pos;
+    sig_scan_len = 0;
+  }
+  start = (extent)(pos - sig_scan_off);
+
+  for (;;) {
+    end = sig_scan_buf + sig_scan_len;
+    p = sig_scan_buf + start;
+    while ((p = (uch *)memchr(p, 0x50 /*'P' except EBCDIC*/, end - p))
+           != NULL && end - p >= 4) {
+      if (p[1] == 0x4b /*'K' except EBCDIC*/ && p[2] < 16 && p[3] < 16) {
+        memcpy(sigbuf, p, 4);
+        /* leave the file just after the signature */
+        if (zfseeko(f, sig_scan_off + (zoff_t)(p - sig_scan_buf) + 4,
+                    SEEK_SET) != 0)
+          return 0;
         return 1;
       }
+      p++;
     }
-    m = getc(f);
-  }
-  if (ferror(f)) {
-    return 0;
+    /* Keep the bytes not ruled out (a signature may start in the last
+       3), and read more after them. */
+    keep = sig_scan_len < 3 ? 0 : sig_scan_len - 3;
+    if (keep < start)
+      keep = start;
+    memmove(sig_scan_buf, sig_scan_buf + keep, sig_scan_len - keep);
+    sig_scan_off += (zoff_t)keep;
+    sig_scan_len -= keep;
+    start = 0;
+    if (zfseeko(f, sig_scan_off + (zoff_t)sig_scan_len, SEEK_SET) != 0 ||
+        (n = fread(sig_scan_buf + sig_scan_len, 1,
+                   SIG_SCAN_BUFSIZE - sig_scan_len, f)) == 0)
+      break;
+    sig_scan_len += n;
   }
 
-  /* found nothing */
+  /* found nothing, at EOF (or error) */
   return 0;
 }
 
+
 /* find_signature
  *
  * Find signature.
@@ -4039,6 +4379,128 @@ local int is_signature(sig1, sig2)
 }
 
 
+/* Central directory block reader
+ *
+ * scanzipf_regnew() reads the central directory through these instead
+ * of a getc() per signature byte and three or four fread()s per entry.
+ * cd_blk_start() reads the central directory, or the first CD_BLOCK_MAX
+ * bytes of it, in one go, and the entries are then parsed from memory,
+ * the block being refilled as needed.  Anything unexpected (junk before
+ * a signature, a record running past the size given in the end record)
+ * drops the block and goes back to the stdio functions at the same
+ * place in the file, so the results are the same either way.
+ */
+
+local char *cd_blk = NULL;      /* central directory bytes */
+local extent cd_blk_size;       /* allocated size of cd_blk */
+local extent cd_blk_len;        /* bytes in cd_blk */
+local extent cd_blk_pos;        /* next byte to parse */
+local uzoff_t cd_blk_off;       /* archive offset of cd_blk[0] */
+local uzoff_t cd_blk_left;      /* central directory bytes not yet read */
+
+local void cd_blk_start(f, off, size)
+  FILE *f;                      /* archive, positioned at off */
+  uzoff_t off;                  /* offset of central directory */
+  uzoff_t size;                 /* size of central directory */
+{
+  cd_blk_end(NULL);
+  if (size == 0)
+    return;
+  cd_blk_size = (extent)IZ_MIN(size, (uzoff_t)CD_BLOCK_MAX);
+  if ((cd_blk = (char *)malloc(cd_blk_size)) == NULL)
+    return;                     /* just use stdio */
+  cd_blk_len = cd_blk_pos = 0;
+  cd_blk_off = off;
+  cd_blk_left = size;
+  if (!cd_blk_fill(f, 1))
+    cd_blk_end(f);
+}
+
+local void cd_blk_end(f)
+  FILE *f;                      /* archive, or NULL if it is closed */
+/* Drop the block.  If f is given, leave it at the next byte to parse. */
+{
+  if (cd_blk == NULL)
+    return;
+  if (f != NULL)
+    zfseeko(f, (zoff_t)(cd_blk_off + cd_blk_pos), SEEK_SET);
+  free(cd_blk);
+  cd_blk = NULL;
+}
+
+local int cd_blk_fill(f, need)
+  FILE *f;
+  extent need;                  /* bytes wanted at cd_blk + cd_blk_pos */
+/* Return 1 when need bytes are in the block, reading more of the
+   central directory if that helps, else 0. */
+{
+  extent have = cd_blk_len - cd_blk_pos;
+  extent n;
+  extent got;
+
+  if (have >= need)
+    return 1;
+  if (cd_blk_left == 0 || need > cd_blk_size)
+    return 0;
+  if (have)
+    memmove(cd_blk, cd_blk + cd_blk_pos, have);
+  cd_blk_off += cd_blk_pos;
+  cd_blk_pos = 0;
+  n = (extent)IZ_MIN((uzoff_t)(cd_blk_size - have), cd_blk_left);
+  got = fread(cd_blk + have, 1, n, f);
+  cd_blk_len = have + got;
+  cd_blk_left = (got < n) ? 0 : cd_blk_left - got;
+  return cd_blk_len >= need;
+}
+
+local int cd_next_signature(f)
+  FILE *f;
+/* find_next_signature() for the central directory */
+{
+  uch *p;
+
+  if (cd_blk != NULL) {
+    if (cd_blk_fill(f, 4)) {
+      p = (uch *)cd_blk + cd_blk_pos;
+      if (p[0] == 0x50 && p[1] == 0x4b && p[2] < 16 && p[3] < 16) {
+        memcpy(sigbuf, p, 4);
+        cd_blk_pos += 4;
+        return 1;
+      }
+    }
+    cd_blk_end(f);              /* not at a signature, scan with getc() */
+  }
+  return find_next_signature(f);
+}
+
+local int cd_read(buf, size, f)
+  char *buf;
+  extent size;
+  FILE *f;
+/* fread(buf, size, 1, f) for the central directory */
+{
+  if (size == 0)
+    return 1;
+  if (cd_blk != NULL) {
+    if (cd_blk_fill(f, size)) {
+      memcpy(buf, cd_blk + cd_blk_pos, size);
+      cd_blk_pos += size;
+      return 1;
+    }
+    cd_blk_end(f);
+  }
+  return (int)fread(buf, size, 1, f);
+}
+
+local zoff_t cd_tell(f)
+  FILE *f;
+{
+  if (cd_blk != NULL)
+    return (zoff_t)(cd_blk_off + cd_blk_pos);
+  return zftello(f);
+}
+
+
 /* at_signature
  *
  * Is at signature in file
@@ -4183,6 +4645,7 @@ local int scanzipf_fixnew()
   }
   else
   {
+    sig_scan_drop();
 
 # ifndef ZIP64_SUPPORT
     /* 2004-12-06 SMS.
@@ -4451,6 +4914,7 @@ local int scanzipf_fixnew()
 
         split_path = get_in_split_path(in_path, current_in_disk);
       }
+      sig_scan_drop();
       if (skip_disk) {
         /* skip this current disk - this works because central directory entries
            can't be split across splits */
@@ -4516,6 +4980,7 @@ local int scanzipf_fixnew()
           zipwarn("reading central directory", "");
           return ZE_MEM;
         }
+        z->zblock = 0;
 
         z->vem = 0;
         z->ver = 0;
@@ -4595,7 +5060,9 @@ local int scanzipf_fixnew()
               return ZE_MEM;
             for (z = zfiles; z != NULL; z = z->nxt)
               x[i++] = z;
-            qsort((char *)zsort, zcount, sizeof(struct zlist far *), zqcmp);
+            name_sort((zvoid **)zsort, zcount, zname_key, NSORT_CASEMAP,
+                      zqcmp);
+            zsearch_index();
 
             /* Skip Unicode searching */
           }
@@ -5002,6 +5469,7 @@ local int scanzipf_regnew()
 #endif
   struct zlist far * far *x = NULL;  /* pointer last entry's link */
   struct zlist far *z;        /* current zip entry structure */
+  int cd_err;                 /* error from the central directory loop */
 
 
   /* open the zipfile */
@@ -5009,6 +5477,7 @@ local int scanzipf_regnew()
     zipwarn("could not open input archive", in_path);
     return ZE_OPEN;
   }
+  sig_scan_drop();
 
 #ifndef ZIP64_SUPPORT
   /* 2004-12-06 SMS.
@@ -5469,6 +5938,7 @@ local int scanzipf_regnew()
         split_path = get_in_split_path(in_path, z64eocdr_disk);
       }
       free(split_path);
+      sig_scan_drop();
     }
 
     current_in_disk = z64eocdr_disk;
@@ -5568,6 +6038,7 @@ local int scanzipf_regnew()
     cd_total_entries = LLG(scbuf + 28);
     total_cd_total_entries += cd_total_entries;
 
+    cd_total_size = LLG(scbuf + 36);
     in_cd_start_offset = LLG(scbuf + 44) + adjust_offset;
 
     if (version_needed > 46) {
@@ -5659,6 +6130,7 @@ local int scanzipf_regnew()
           split_path = get_in_split_path(zipfile, current_in_disk);
         }
       }
+      sig_scan_drop();
       if (skip_disk) {
         /* skip this current disk - this works because central directory entries
            can't be split across splits */
@@ -5682,13 +6154,17 @@ local int scanzipf_regnew()
         }
         first_CD = 0;
         x = zfilesnext;
+        if (total_disks == 1) {
+          /* parse the central directory from memory, see cd_read() */
+          cd_blk_start(in_file, in_cd_start_offset, cd_total_size);
+        }
       }
     }
 
     /* Main loop */
     /* Look for next signature and process it */
-    while (find_next_signature(in_file)) {
-      current_in_offset = zftello(in_file);
+    while (cd_next_signature(in_file)) {
+      current_in_offset = cd_tell(in_file);
 
       if (is_signature(sigbuf, "PK\05\06")) {
         /* End Of Central Directory Record */
@@ -5733,7 +6209,8 @@ local int scanzipf_regnew()
           zipwarn(errbuf, "");
           fclose(in_file);
           in_file = NULL;
-          return ZE_FORM;
+          cd_err = ZE_FORM;
+          goto cd_error;
         }
       }
 
@@ -5767,20 +6244,22 @@ local int scanzipf_regnew()
         file comment (variable size)
        */
 
-      if (fread(scbuf, CENHEAD, 1, in_file) != 1) {
+      if (cd_read(scbuf, CENHEAD, in_file) != 1) {
         zipwarn("reading central directory: ", strerror(errno));
         if (fix == 1) {
           zipwarn("bad archive - error reading central directory", "");
           zipwarn("skipping this entry...", "");
           continue;
         } else {
-          return ferror(in_file) ? ZE_READ : ZE_EOF;
+          cd_err = ferror(in_file) ? ZE_READ : ZE_EOF;
+          goto cd_error;
         }
       }
 
-      if ((z = (struct zlist far *)farmalloc(sizeof(struct zlist))) == NULL) {
+      if ((z = zlist_alloc()) == NULL) {
         zipwarn("reading central directory", "");
-        return ZE_MEM;
+        cd_err = ZE_MEM;
+        goto cd_error;
       }
 
       z->vem = SH(CENVEM + scbuf);
@@ -5844,22 +6323,26 @@ local int scanzipf_regnew()
           continue;
         }
 #ifndef DEBUG
-        return ZE_FORM;
+        cd_err = ZE_FORM;
+        goto cd_error;
 #endif
       }
-      if ((z->iname = malloc(z->nam+1)) ==  NULL ||
+      if ((z->iname = name_alloc(z->nam+1)) ==  NULL ||
           (z->cext && (z->cextra = malloc(z->cext)) == NULL) ||
-          (z->com && (z->comment = malloc(z->com + 1)) == NULL))
-        return ZE_MEM;
-      if (fread(z->iname, z->nam, 1, in_file) != 1 ||
-          (z->cext && fread(z->cextra, z->cext, 1, in_file) != 1) ||
-          (z->com && fread(z->comment, z->com, 1, in_file) != 1)) {
+          (z->com && (z->comment = malloc(z->com + 1)) == NULL)) {
+        cd_err = ZE_MEM;
+        goto cd_error;
+      }
+      if (cd_read(z->iname, z->nam, in_file) != 1 ||
+          (z->cext && cd_read(z->cextra, z->cext, in_file) != 1) ||
+          (z->com && cd_read(z->comment, z->com, in_file) != 1)) {
         if (fix == 1) {
           zipwarn("error reading entry:  ", strerror(errno));
           zipwarn("skipping this entry...", "");
           continue;
         }
-        return ferror(in_file) ? ZE_READ : ZE_EOF;
+        cd_err = ferror(in_file) ? ZE_READ : ZE_EOF;
+        goto cd_error;
       }
       if (z->com)
         z->comment[z->com] = '\0';
@@ -5869,16 +6352,17 @@ local int scanzipf_regnew()
       if (z->flg & UTF8_BIT) {
         char *iname;
         /* path is UTF-8 */
-        if ((z->uname = malloc(strlen(z->iname) + 1)) == NULL) {
+        if ((z->uname = name_alloc(strlen(z->iname) + 1)) == NULL) {
           zipwarn("could not allocate memory: scanzipf_reg", "");
-          return ZE_MEM;
+          cd_err = ZE_MEM;
+          goto cd_error;
         }
         strcpy(z->uname, z->iname);
         /* Create a local name.  If UTF-8 system this should also be UTF-8 */
         iname = utf8_to_local_stringz(z->uname);
         if (iname) {
-          free(z->iname);
-          z->iname = iname;
+          name_free(z->iname);
+          z->iname = name_share(iname, z->uname);
         }
         else
           zipwarn("illegal UTF-8 name: ", z->uname);
@@ -5954,14 +6438,22 @@ local int scanzipf_regnew()
       z->trash = 0;
 #if defined(UNICODE_SUPPORT) && !defined(UTIL)
       z->zname = in2ex(z->iname);       /* convert to external name */
-      if (z->zname == NULL)
-        return ZE_MEM;
-      if ((z->name = malloc(strlen(z->zname) + 1)) == NULL) {
+      if (z->zname == NULL) {
+        cd_err = ZE_MEM;
+        goto cd_error;
+      }
+      /* usually the same, so share the arena copy (name_share()) */
+      z->zname = name_share(z->zname, z->iname);
+      if (z->zname == z->iname)
+        z->name = z->zname;
+      else if ((z->name = name_alloc(strlen(z->zname) + 1)) == NULL) {
         zipwarn("could not allocate memory: scanzipf_reg", "");
-        return ZE_MEM;
+        cd_err = ZE_MEM;
+        goto cd_error;
       }
-      strcpy(z->name, z->zname);
-      z->oname = local_to_display_string(z->iname);
+      else
+        strcpy(z->name, z->zname);
+      /* z->oname is made on first use (zlist_oname()) */
 
 # ifdef WIN32
       z->namew = NULL;
@@ -5984,7 +6476,8 @@ local int scanzipf_regnew()
           /* not able to convert name, so use iname */
           if ((name = malloc(strlen(z->iname) + 1)) == NULL) {
             zipwarn("could not allocate memory: scanzipf_reg", "");
-            return ZE_MEM;
+            cd_err = ZE_MEM;
+            goto cd_error;
           }
           strcpy(name, z->iname);
         }
@@ -5995,10 +6488,13 @@ local int scanzipf_regnew()
 # else /* !EBCDIC */
         if ((z->zuname = malloc(strlen(name) + 1)) == NULL) {
           zipwarn("could not allocate memory: scanzipf_reg", "");
-          return ZE_MEM;
+          cd_err = ZE_MEM;
+          goto cd_error;
         }
         strcpy(z->zuname, name);
-        /* For output to terminal */
+#  ifdef WIN32
+        /* For output to terminal.  Elsewhere z->ouname is made on first
+           use (zlist_ouname()), but here z->wuname is made from it. */
         if (unicode_escape_all || unicode_show) {
           char *ouname;
           /* Escape anything not 7-bit ASCII */
@@ -6008,7 +6504,8 @@ local int scanzipf_regnew()
           else {
             if ((z->ouname = malloc(strlen(name) + 1)) == NULL) {
               zipwarn("could not allocate memory: scanzipf_reg", "");
-              return ZE_MEM;
+              cd_err = ZE_MEM;
+              goto cd_error;
             }
             strcpy(z->ouname, name);
           }
@@ -6019,17 +6516,19 @@ local int scanzipf_regnew()
         } else {
           if ((z->ouname = malloc(strlen(name) + 1)) == NULL) {
             zipwarn("could not allocate memory: scanzipf_reg", "");
-            return ZE_MEM;
+            cd_err = ZE_MEM;
+            goto cd_error;
           }
           strcpy(z->ouname, name);
         }
-#  ifdef WIN32
 
         if (!no_win32_wide) {
           z->inamew = utf8_to_wchar_string(z->uname);
           z->znamew = in2exw(z->inamew); /* convert to external name */
-          if (z->znamew == NULL)
-            return ZE_MEM;
+          if (z->znamew == NULL) {
+            cd_err = ZE_MEM;
+            goto cd_error;
+          }
         }
 
         local_to_oem_string(z->ouname, z->ouname);
@@ -6041,7 +6540,8 @@ local int scanzipf_regnew()
         */
         if ((z->wuname = malloc(strlen(z->ouname) + 1)) == NULL) {
           zipwarn("could not allocate memory: scanzipf_reg", "");
-          return ZE_MEM;
+          cd_err = ZE_MEM;
+          goto cd_error;
         }
         strcpy(z->wuname, z->ouname);
         oem_to_local_string(z->wuname, z->wuname);
@@ -6053,20 +6553,23 @@ local int scanzipf_regnew()
         if (!no_win32_wide) {
           z->inamew = local_to_wchar_string(z->iname);
           z->znamew = in2exw(z->inamew); /* convert to external name */
-          if (z->znamew == NULL)
-            return ZE_MEM;
+          if (z->znamew == NULL) {
+            cd_err = ZE_MEM;
+            goto cd_error;
+          }
         }
 # endif
       }
 #else /* !(UNICODE_SUPPORT && !UTIL) */
 # ifdef UTIL
 /* We only need z->iname in the utils */
-      z->name = string_dup(z->iname, "scanzipf_regnew z->name 1", NO_FLUFF);
+      z->name = name_dup(z->iname, "scanzipf_regnew z->name 1", NO_FLUFF);
 #  ifdef EBCDIC
 /* z->zname is used for printing and must be coded in native charset */
       if ((z->zname = malloc(z->nam+1)) ==  NULL) {
         zipwarn("could not allocate memory: scanzipf_reg", "");
-        return ZE_MEM;
+        cd_err = ZE_MEM;
+        goto cd_error;
       }
       strtoebc(z->zname, z->iname);
 #  else
@@ -6074,15 +6577,17 @@ local int scanzipf_regnew()
 #  endif
 # else /* !UTIL */
       z->zname = in2ex(z->iname);       /* convert to external name */
-      if (z->zname == NULL)
-        return ZE_MEM;
-      z->name = string_dup(z->zname, "scanzipf_regnew z->name 2", NO_FLUFF);
-# endif /* ?UTIL */
-      if ((z->oname = malloc(strlen(z->zname) + 1)) == NULL) {
-        zipwarn("could not allocate memory: scanzipf_reg", "");
-        return ZE_MEM;
+      if (z->zname == NULL) {
+        cd_err = ZE_MEM;
+        goto cd_error;
       }
-      strcpy(z->oname, z->zname);
+      z->zname = name_share(z->zname, z->iname);
+      if (z->zname == z->iname)
+        z->name = z->zname;
+      else
+        z->name = name_dup(z->zname, "scanzipf_regnew z->name 2", NO_FLUFF);
+# endif /* ?UTIL */
+      /* z->oname is made on first use (zlist_oname()) */
 #endif /* ?(UNICODE_SUPPORT && !UTIL) */
 
 #ifndef UTIL
@@ -6102,6 +6607,7 @@ local int scanzipf_regnew()
     } /* while reading file */
 
     /* close disk and do next disk */
+    cd_blk_end(NULL);
     fclose(in_file);
     in_file = NULL;
     free(split_path);
@@ -6129,9 +6635,338 @@ local int scanzipf_regnew()
 
   return ZE_OK;
 
+cd_error:
+  /* Error in the main loop.  Drop the central directory block, as the
+     end of the loop does. */
+  cd_blk_end(NULL);
+  return cd_err;
+
 } /* end of function scanzipf_regnew() */
 
 
+#ifndef UTIL
+
+/* Streaming the central directory
+ *
+ * Listing an archive alone (zip -sf, -su, -sU) through readzipfile()
+ * builds every zlist entry, sorts zsort and zusort, and only then shows
+ * anything.  zlist_stream_open() instead finds the end record of
+ * in_path, and zlist_stream() walks the central directory from a
+ * mapping of it (IZ_MAPIN) or a record at a time, handing each entry to
+ * a visitor in central directory order in one reused zlist, so memory
+ * does not grow with the archive and output starts at once.
+ */
+
+/* largest end record plus comment, and largest central header */
+#define ZSTREAM_TAIL (4 + ENDHEAD + 0xFFFFL)
+#define ZSTREAM_REC  (4 + CENHEAD + 3 * 0xFFFFL)
+
+local FILE *zs_file = NULL;     /* archive being walked */
+local uch *zs_buf = NULL;       /* one central header, if not mapped */
+local uzoff_t zs_cd_off;        /* offset of central directory */
+local uzoff_t zs_cd_size;       /* size of central directory */
+local uzoff_t zs_cd_n;          /* entries in central directory */
+#ifdef IZ_MAPIN
+local uch *zs_map = NULL;       /* archive up to end of central dir */
+local extent zs_map_len;
+#endif
+
+local void zlist_stream_close OF((void));
+local int zlist_stream_entry OF((struct zlist far *, uch *));
+local void zlist_stream_free OF((struct zlist far *));
+
+local void zlist_stream_close()
+{
+#ifdef IZ_MAPIN
+  if (zs_map != NULL)
+    munmap((zvoid *)zs_map, zs_map_len);
+  zs_map = NULL;
+#endif
+  if (zs_buf != NULL)
+    free((zvoid *)zs_buf);
+  zs_buf = NULL;
+  if (zs_file != NULL)
+    fclose(zs_file);
+  zs_file = NULL;
+}
+
+int zlist_stream_open()
+/* Get ready for zlist_stream() and set zcomment and zcomlen.  Return 1
+   if ready, else 0 for what zlist_stream() does not walk (a split or
+   empty archive, one that does not open, a central directory that is
+   not where the end record says, no memory), which readzipfile() should
+   then read, reporting any error itself. */
+{
+  uch *b;                       /* end of the archive */
+  uch *p;                       /* end record in b */
+  extent n;                     /* bytes in b */
+  extent i;
+  zoff_t size;                  /* archive size */
+  uzoff_t e;                    /* offset of end record */
+  uch sig[4];
+
+  if ((zs_file = zfopen(in_path, FOPR)) == NULL)
+    return 0;
+  if ((zs_buf = (uch *)malloc(ZSTREAM_REC)) == NULL) {
+    zlist_stream_close();
+    return 0;
+  }
+  b = zs_buf;
+  if (zfseeko(zs_file, (zoff_t)0, SEEK_END) != 0 ||
+      (size = zftello(zs_file)) < 4 + ENDHEAD) {
+    zlist_stream_close();
+    return 0;
+  }
+  n = (extent)IZ_MIN((uzoff_t)size, (uzoff_t)ZSTREAM_TAIL);
+  if (zfseeko(zs_file, size - (zoff_t)n, SEEK_SET) != 0 ||
+      fread(b, 1, n, zs_file) != n) {
+    zlist_stream_close();
+    return 0;
+  }
+
+  /* the last end record signature, as scanzipf_regnew() takes */
+  p = NULL;
+  for (i = n - ENDHEAD - 4 + 1; i-- > 0; ) {
+    if (b[i] == 0x50 && b[i+1] == 0x4b && b[i+2] == 5 && b[i+3] == 6) {
+      p = b + i + 4;
+      break;
+    }
+  }
+  if (p == NULL || SH(p + ENDDSK) != 0 || SH(p + ENDBEG) != 0 ||
+      (extent)(p - b) + ENDHEAD + SH(p + ENDCOM) > n) {
+    zlist_stream_close();
+    return 0;
+  }
+  e = (uzoff_t)size - n + (p - b) - 4;
+  zs_cd_n = (uzoff_t)SH(p + ENDTOT);
+  zs_cd_size = (uzoff_t)LG(p + ENDSIZ);
+  zs_cd_off = (uzoff_t)LG(p + ENDOFF);
+
+  /* Zip64 end record, through the locator before the end record */
+  if ((extent)(p - b) >= EC64LOC + 8 &&
+      is_signature((char *)p - EC64LOC - 8, "PK\06\07")) {
+#ifdef ZIP64_SUPPORT
+    uch *l = p - EC64LOC - 4;   /* locator, after its signature */
+    uch r[4 + EC64REC];         /* Zip64 end record */
+
+    e = (uzoff_t)LLG(l + 4);
+    if (LG(l) != 0 || LG(l + 12) != 1 ||
+        zfseeko(zs_file, (zoff_t)e, SEEK_SET) != 0 ||
+        fread(r, 1, sizeof(r), zs_file) != sizeof(r) ||
+        !is_signature((char *)r, "PK\06\06") ||
+        LG(r + 16) != 0 || LG(r + 20) != 0) {
+      zlist_stream_close();
+      return 0;
+    }
+    zs_cd_n = (uzoff_t)LLG(r + 32);
+    zs_cd_size = (uzoff_t)LLG(r + ZIP64_EOCD_OFS_SIZE);
+    zs_cd_off = (uzoff_t)LLG(r + ZIP64_EOCD_OFS_CD_START);
+#else
+    zlist_stream_close();
+    return 0;
+#endif
+  }
+
+  /* the central directory must end at the end record and start with a
+     central header, else leave the adjusting to scanzipf_regnew() */
+  if (zs_cd_n == 0 || zs_cd_off + zs_cd_size != e ||
+      zfseeko(zs_file, (zoff_t)zs_cd_off, SEEK_SET) != 0 ||
+      fread(sig, 1, 4, zs_file) != 4 ||
+      !is_signature((char *)sig, "PK\01\02")) {
+    zlist_stream_close();
+    return 0;
+  }
+
+#ifdef IZ_MAPIN
+  zs_map_len = (extent)(zs_cd_off + zs_cd_size);
+  if ((uzoff_t)zs_map_len == zs_cd_off + zs_cd_size) {
+    zs_map = (uch *)mmap(NULL, zs_map_len, PROT_READ, MAP_PRIVATE,
+                         fileno(zs_file), 0);
+    if (zs_map == (uch *)MAP_FAILED)
+      zs_map = NULL;
+  }
+#endif
+  if (zfseeko(zs_file, (zoff_t)zs_cd_off, SEEK_SET) != 0) {
+    zlist_stream_close();
+    return 0;
+  }
+
+  zcomlen = SH(p + ENDCOM);
+  if (zcomlen) {
+    if ((zcomment = malloc(zcomlen + 1)) == NULL) {
+      zlist_stream_close();
+      return 0;
+    }
+    memcpy(zcomment, p + ENDHEAD, zcomlen);
+    zcomment[zcomlen] = '\0';
+#ifdef EBCDIC
+    memtoebc(zcomment, zcomment, zcomlen);
+#endif
+  }
+  return 1;
+}
+
+local int zlist_stream_entry(z, p)
+  struct zlist far *z;          /* entry to fill in */
+  uch *p;                       /* central header, after its signature */
+/* Fill in z from p, making the names as scanzipf_regnew() does. */
+{
+  uch *h = p + CENHEAD;         /* name, extra field, comment */
+
+  memset((zvoid *)z, 0, sizeof(struct zlist));
+  z->vem = SH(CENVEM + p);
+  z->ver = SH(CENVER + p);
+  z->flg = SH(CENFLG + p);
+  z->how = SH(CENHOW + p);
+  z->tim = LG(CENTIM + p);
+  z->crc = LG(CENCRC + p);
+  z->siz = LG(CENSIZ + p);
+  z->len = LG(CENLEN + p);
+  z->nam = SH(CENNAM + p);
+  z->cext = SH(CENEXT + p);
+  z->com = SH(CENCOM + p);
+  z->dsk = SH(CENDSK + p);
+  z->att = SH(CENATT + p);
+  z->atx = LG(CENATX + p);
+  z->off = LG(CENOFF + p);
+  z->dosflag = (z->vem & 0xff00) == 0;
+
+  if ((z->iname = malloc(z->nam + 1)) == NULL ||
+      (z->com && (z->comment = malloc(z->com + 1)) == NULL))
+    return ZE_MEM;
+  memcpy(z->iname, h, z->nam);
+  z->iname[z->nam] = '\0';
+  if (z->cext)
+    z->cextra = (char *)h + z->nam;     /* in the mapping or zs_buf */
+  if (z->com) {
+    memcpy(z->comment, h + z->nam + z->cext, z->com);
+    z->comment[z->com] = '\0';
+#ifdef EBCDIC
+    memtoebc(z->comment, z->comment, z->com);
+#endif
+  }
+
+#ifdef UNICODE_SUPPORT
+  if (z->flg & UTF8_BIT) {
+    char *iname;
+
+    z->uname = string_dup(z->iname, "zlist_stream_entry", NO_FLUFF);
+    if ((iname = utf8_to_local_stringz(z->uname)) != NULL) {
+      free(z->iname);
+      z->iname = iname;
+    }
+  } else if (!unicode_dont_use) {
+    z->name = z->iname;         /* used if the extra field has no path */
+    read_Unicode_Path_entry(z);
+    z->name = NULL;
+  }
+  if (z->uname) {
+    z->utf8_path = 1;
+    if ((z->zuname = utf8_to_local_stringz(z->uname)) == NULL)
+      z->zuname = string_dup(z->iname, "zlist_stream_entry", NO_FLUFF);
+  }
+#endif
+#ifdef WIN32
+  if (!(z->flg & UTF8_BIT)) {
+    /* path and comment may be OEM */
+    Ext_ASCII_TO_Native(z->iname, (z->vem >> 8), (z->vem & 0xff),
+                        ((z->atx & 0xffff0000L) != 0), FALSE);
+    if (z->com)
+      Ext_ASCII_TO_Native(z->comment, (z->vem >> 8), (z->vem & 0xff),
+                          ((z->atx & 0xffff0000L) != 0), FALSE);
+  }
+#endif
+#ifdef ZIP64_SUPPORT
+  adjust_zip_central_entry(z);
+#endif
+  if ((z->zname = in2ex(z->iname)) == NULL)
+    return ZE_MEM;
+  return ZE_OK;
+}
+
+local void zlist_stream_free(z)
+  struct zlist far *z;
+/* Free what zlist_stream_entry() and the visitor made for z. */
+{
+  if (z->zname != NULL && z->zname != z->iname)
+    free(z->zname);
+  if (z->iname != NULL)
+    free(z->iname);
+  if (z->oname != NULL)
+    free(z->oname);
+  if (z->comment != NULL)
+    free(z->comment);
+#ifdef UNICODE_SUPPORT
+  if (z->uname != NULL)
+    free(z->uname);
+  if (z->zuname != NULL)
+    free(z->zuname);
+  if (z->ouname != NULL)
+    free(z->ouname);
+#endif
+  z->zname = z->iname = z->oname = z->comment = NULL;
+}
+
+int zlist_stream(visit)
+  int (*visit) OF((struct zlist far *));   /* nonzero return stops */
+/* Hand each entry of the archive opened by zlist_stream_open() to
+   visit().  The zlist and what it points to are only good during the
+   call.  Return an error code in the ZE_ class. */
+{
+  struct zlist z;               /* the entry being visited */
+  uzoff_t pos = 0;              /* offset in central directory */
+  uzoff_t i;
+  uch *p;                       /* central header, signature first */
+  extent len;                   /* bytes of it */
+  int done = 0;                 /* visitor is done */
+  int r = ZE_OK;
+
+  if (zs_file == NULL)
+    return ZE_LOGIC;
+  for (i = 0; i < zs_cd_n && r == ZE_OK && !done; i++) {
+#ifdef IZ_MAPIN
+    if (zs_map != NULL) {
+      p = zs_map + (extent)(zs_cd_off + pos);
+      len = 4 + CENHEAD;
+      if (pos + len <= zs_cd_size)
+        len += SH(p + 4 + CENNAM) + SH(p + 4 + CENEXT) + SH(p + 4 + CENCOM);
+      if (pos + len > zs_cd_size || !is_signature((char *)p, "PK\01\02")) {
+        r = ZE_FORM;
+        break;
+      }
+    } else
+#endif
+    {
+      p = zs_buf;
+      len = 4 + CENHEAD;
+      if (pos + len > zs_cd_size || fread(p, 1, len, zs_file) != len ||
+          !is_signature((char *)p, "PK\01\02")) {
+        r = ferror(zs_file) ? ZE_READ : ZE_FORM;
+        break;
+      }
+      len = SH(p + 4 + CENNAM) + SH(p + 4 + CENEXT) + SH(p + 4 + CENCOM);
+      if (pos + 4 + CENHEAD + len > zs_cd_size ||
+          (len && fread(p + 4 + CENHEAD, 1, len, zs_file) != len)) {
+        r = ferror(zs_file) ? ZE_READ : ZE_FORM;
+        break;
+      }
+      len += 4 + CENHEAD;
+    }
+    pos += len;
+
+    if ((r = zlist_stream_entry(&z, p + 4)) == ZE_OK)
+      done = (*visit)(&z);
+    zlist_stream_free(&z);
+  }
+  if (r == ZE_FORM)
+    zipwarn("bad archive - error reading central directory", "");
+  zlist_stream_close();
+  return r;
+}
+
+#endif /* !UTIL */
+
+
 
 
 
@@ -6348,7 +7183,7 @@ int readzipfile()
       for (z = zfiles; z != NULL; z = z->nxt)
 
         *x++ = z;
-      qsort((char *)zsort, zcount, sizeof(struct zlist far *), zqcmp);
+      name_sort((zvoid **)zsort, zcount, zname_key, NSORT_CASEMAP, zqcmp);
 
 #ifdef UNICODE_SUPPORT
       /* sort by zuname (local conversion of UTF-8 name) */
@@ -6357,7 +7192,10 @@ int readzipfile()
         return ZE_MEM;
       for (z = zfiles; z != NULL; z = z->nxt)
         *x++ = z;
-      qsort((char *)zusort, zcount, sizeof(struct zlist far *), zuqcmp);
+      name_sort((zvoid **)zusort, zcount, zuname_key, NSORT_CASEMAP, zuqcmp);
+#endif
+#ifndef UTIL
+      zsearch_index();
 #endif
     }
   }
@@ -6494,7 +7332,7 @@ int read_inc_file(inc_file)
         return ZE_MEM;
       for (z = zfiles; z != NULL; z = z->nxt)
         *x++ = z;
-      qsort((char *)zsort, zcount, sizeof(struct zlist far *), zqcmp);
+      name_sort((zvoid **)zsort, zcount, zname_key, NSORT_CASEMAP, zqcmp);
 
 #ifdef UNICODE_SUPPORT
       /* sort by zuname (local conversion of UTF-8 name) */
@@ -6503,7 +7341,7 @@ int read_inc_file(inc_file)
         return ZE_MEM;
       for (z = zfiles; z != NULL; z = z->nxt)
         *x++ = z;
-      qsort((char *)zusort, zcount, sizeof(struct zlist far *), zuqcmp);
+      name_sort((zvoid **)zusort, zcount, zuname_key, NSORT_CASEMAP, zuqcmp);
 #endif /* def UNICODE_SUPPORT */
     }
   }
@@ -6844,7 +7682,7 @@ int putlocal(z, rewrite)
     {
       /* assume Zip64 */
       if (force_zip64 == 0) {
-        zipwarn("Entry too big:", z->oname);
+        zipwarn("Entry too big:", ZONAME(z));
         ZIPERR(ZE_BIG,
          "Large entry support disabled (with --force-zip64-) but entry needs");
       }
@@ -6899,7 +7737,7 @@ int putlocal(z, rewrite)
     }
     if (force_zip64 == 0 && zip64_entry) {
       /* tried to force into standard entry but needed Zip64 entry */
-      zipwarn("Entry too big:", z->oname);
+      zipwarn("Entry too big:", ZONAME(z));
       ZIPERR(ZE_BIG,
        "Large entry support disabled (with --force-zip64-) but entry needs");
     }
@@ -6914,14 +7752,14 @@ int putlocal(z, rewrite)
     if (was_zip64 == 0 && zip64_entry == 1) {
       /* guessed wrong and need Zip64 */
       if (force_zip64 == 0) {
-        zipwarn("Entry too big:", z->oname);
+        zipwarn("Entry too big:", ZONAME(z));
         ZIPERR(ZE_BIG,
           "Compressed/stored entry unexpectedly large - do not use '--force-zip64-'");
       } else {
         if (!zip64_placeholder_used)
         {
           /* space was not reserved for Zip64 - nothing to do at this point */
-          zipwarn("Entry too big:", z->oname);
+          zipwarn("Entry too big:", ZONAME(z));
           ZIPERR(ZE_BIG,
            "Poor compression resulted in unexpectedly large entry - try --force-zip64");
         }
@@ -7153,7 +7991,7 @@ int putlocal(z, rewrite)
     iname[i] = '\0';
     nam = (ush)strlen(iname);
     sprintf(errbuf, "long path truncated to %d bytes", i);
-    zipwarn(errbuf, z->oname);
+    zipwarn(errbuf, ZONAME(z));
   }
 
   /* As uname->iname if utf8_native and the local Unicode ef has been
@@ -7175,7 +8013,7 @@ int putlocal(z, rewrite)
 # endif
     uname[i] = '\0';
     sprintf(errbuf, "long path truncated to %d bytes", i);
-    zipwarn(errbuf, z->oname);
+    zipwarn(errbuf, ZONAME(z));
   }
 #endif
 
@@ -7224,12 +8062,12 @@ int putlocal(z, rewrite)
         if (z->com && z->comment) {
           z->comment[z->com] = '\0';
           zfprintf(mesg,
-        "\nCurrent comment for %s:\n %s", z->oname, z->comment);
+        "\nCurrent comment for %s:\n %s", ZONAME(z), z->comment);
           zfprintf(mesg,
         "\nEnter comment (hit ENTER to keep, TAB ENTER to remove) for %s:\n ",
-                  z->oname);
+                  ZONAME(z));
         } else {
-          zfprintf(mesg, "\nEnter comment for %s:\n ", z->oname);
+          zfprintf(mesg, "\nEnter comment for %s:\n ", ZONAME(z));
         }
       }
       if (fgets(e, MAXCOMLINE+1, comment_stream) != NULL)
@@ -7530,6 +8368,94 @@ int putextended(z)
   return ZE_OK;
 }
 
+
+/* Central header batches
+ *
+ * For a large archive, writing the central directory is a putcentral()
+ * per entry, each making its header in a malloc'd block and handing it
+ * to bfwrite().  Between cen_batch_begin() and cen_batch_end(),
+ * putcentral() instead appends each header to one buffer, which goes to
+ * bfwrite() when it reaches CEN_BATCH bytes.  If a split would end
+ * inside the buffer, the headers are given to bfwrite() one at a time
+ * as before, so it can still move a header that does not fit to the
+ * next split.  zip.c batches its central directory loops.  The
+ * utilities do not, as they zftello() the output after the loop.
+ */
+
+local char *cen_batch = NULL;   /* central headers not yet written */
+local extent cen_batch_len;     /* bytes in cen_batch */
+local extent cen_batch_size;    /* allocated size of cen_batch */
+local uzoff_t cen_batch_n;      /* headers in cen_batch */
+
+local int cen_batch_flush OF((void));
+
+void cen_batch_begin()
+{
+  if (CEN_BATCH == 0 || cen_batch != NULL)
+    return;
+  cen_batch_size = (extent)CEN_BATCH + 1024;
+  if ((cen_batch = (char *)malloc(cen_batch_size)) == NULL)
+    return;                     /* write each header as made */
+  cen_batch_len = 0;
+  cen_batch_n = 0;
+}
+
+local int cen_batch_flush()
+/* Write the batched central headers.  Return an error code in the ZE_
+   class. */
+{
+  extent i;                     /* offset of next header */
+  extent r;                     /* length of header */
+  uch *p;
+
+  if (cen_batch_len == 0)
+    return ZE_OK;
+  if (split_size == 0 ||
+      bytes_this_split + cen_batch_len <= split_size) {
+    if (bfwrite(cen_batch, 1, cen_batch_len, BFWRITE_CENTRALHEADER) !=
+        cen_batch_len)
+      return ZE_TEMP;
+    /* bfwrite() counted one central header */
+    cd_entries_this_disk += cen_batch_n - 1;
+    total_cd_entries += cen_batch_n - 1;
+  } else {
+    for (i = 0; i < cen_batch_len; i += r) {
+      p = (uch *)cen_batch + i + 4;
+      r = 4 + CENHEAD + SH(p + CENNAM) + SH(p + CENEXT) + SH(p + CENCOM);
+      if (bfwrite(cen_batch + i, 1, r, BFWRITE_CENTRALHEADER) != r)
+        return ZE_TEMP;
+    }
+  }
+  cen_batch_len = 0;
+  cen_batch_n = 0;
+  return ZE_OK;
+}
+
+int cen_batch_end()
+/* Write what is left of the batch and go back to writing each header as
+   it is made.  Return an error code in the ZE_ class. */
+{
+  int r;
+
+  if (cen_batch == NULL)
+    return ZE_OK;
+  r = cen_batch_flush();
+  free(cen_batch);
+  cen_batch = NULL;
+  return r;
+}
+
+void cen_batch_drop()
+/* Throw away the headers not yet written and go back to writing each
+   header as it is made, for ziperr() to write a central directory of its
+   own after an error in the middle of a batch. */
+{
+  if (cen_batch != NULL) {
+    free(cen_batch);
+    cen_batch = NULL;
+  }
+}
+
 int putcentral(z)
   struct zlist far *z;    /* zip entry to write central header for */
 /* Write a central header described by *z to file *f.  Return an error code
@@ -7576,6 +8502,13 @@ int putcentral(z)
   ulg len = (ulg)z->len;
 #endif
 
+  if (cen_batch != NULL) {
+    /* append to the batch (cen_batch_begin()) */
+    block = cen_batch;
+    offset = cen_batch_len;
+    blocksize = cen_batch_size;
+  }
+
   /* Make copies of z->iname and z->uname to write to header.  These
      copies may be modified by prefixing and/or case changing. */
   if ((iname = malloc(strlen(z->iname) + 1)) == NULL) {
@@ -7750,7 +8683,7 @@ int putcentral(z)
     iname[i] = '\0';
     nam = (ush)strlen(iname);
     sprintf(errbuf, "long path truncated to %d bytes", i);
-    zipwarn(errbuf, z->oname);
+    zipwarn(errbuf, ZONAME(z));
   }
 
   /* As uname->iname if utf8_native and the local Unicode ef has been
@@ -7772,7 +8705,7 @@ int putcentral(z)
 # endif
     uname[i] = '\0';
     sprintf(errbuf, "long path truncated to %d bytes", i);
-    zipwarn(errbuf, z->oname);
+    zipwarn(errbuf, ZONAME(z));
   }
 #endif
 
@@ -7985,6 +8918,14 @@ int putcentral(z)
 #endif
   }
 
+  if (cen_batch != NULL) {
+    cen_batch = block;          /* may have been moved by realloc() */
+    cen_batch_len = offset;
+    cen_batch_size = blocksize;
+    cen_batch_n++;
+    return cen_batch_len >= (extent)CEN_BATCH ? cen_batch_flush() : ZE_OK;
+  }
+
   /* write the header */
   if (bfwrite(block, 1, offset, BFWRITE_CENTRALHEADER) != offset) {
     free(block);
@@ -8412,10 +9353,10 @@ int zipcopy(z)
     localz->com = z->com;
   }
 
-  /* archives to fix should be static and not include entry read from stdin */
-  if (fix) {
-    localz->is_stdin = 0;
-  } 
+  /* a copied entry is never read from stdin, and localz is from
+     farmalloc(), not an entry block */
+  localz->is_stdin = 0;
+  localz->zblock = 0;
 
   localz->vem = 0;
   if (fix != 2) {
@@ -8537,7 +9478,7 @@ int zipcopy(z)
 
 #ifdef UNICODE_SUPPORT
     free(localz->uname);
-    free(z->uname);
+    name_free(z->uname);
     if (is_utf8_string(z->iname, NULL, NULL, NULL, NULL)) {
       localz->uname = string_dup(z->iname, "localz->uname (zipcopy)", NO_FLUFF);
       z->uname = string_dup(z->iname, "z->uname (zipcopy)", NO_FLUFF);
@@ -8613,7 +9554,7 @@ int zipcopy(z)
       print_utf8(errbuf);
     } else {
 #endif
-      sprintf(errbuf, " copying: %s ", z->oname);
+      sprintf(errbuf, " copying: %s ", ZONAME(z));
       zipmessage_nl(errbuf, 0);
 #ifdef UNICODE_SUPPORT
     }
@@ -8638,7 +9579,7 @@ int zipcopy(z)
                                               &comp_method);
       if (result == 0) {
         /* no AES_WG extra field */
-        zipwarn("file AES WG encrypted, but missing extra field: ", z->oname);
+        zipwarn("file AES WG encrypted, but missing extra field: ", ZONAME(z));
       }
     } /* 99 */
     localz->encrypt_method = aes_strength;
@@ -8651,10 +9592,13 @@ int zipcopy(z)
   }
 
 
-  if ((localz->oname = malloc(strlen(z->oname) + 1)) == NULL) {
-    return ZE_MEM;
+  /* if z has no display name yet, localz gets one on first use */
+  if (z->oname != NULL) {
+    if ((localz->oname = malloc(strlen(z->oname) + 1)) == NULL) {
+      return ZE_MEM;
+    }
+    strcpy(localz->oname, z->oname);
   }
-  strcpy(localz->oname, z->oname);
 
   /* Copied entries are not selected.  putlocal() makes some decisions
      based on if an entry is selected. */
@@ -8699,7 +9643,7 @@ int zipcopy(z)
 
   if (r == ZE_EOF || skip_this_disk) {
       /* missing disk */
-      zipwarn("aborting: ", z->oname);
+      zipwarn("aborting: ", ZONAME(z));
 
       if (r == ZE_OK)
         r = ZE_FORM;
@@ -8743,7 +9687,7 @@ int zipcopy(z)
       localz->len = des_usize;
     } else {
       /* no end to this entry found */
-      zipwarn("no end of stream entry (data descriptor) found: ", z->oname);
+      zipwarn("no end of stream entry (data descriptor) found: ", ZONAME(z));
       zipwarn("rewinding and scanning for later entries", "");
 
       /* seek back in output to start of this entry so can overwrite */
@@ -8830,7 +9774,7 @@ int zipcopy(z)
     zipmessage_nl(errbuf, 1);
 
     if (r == ZE_READ) {
-      zipwarn("entry truncated: ", z->oname);
+      zipwarn("entry truncated: ", ZONAME(z));
       sprintf(errbuf, "expected compressed/stored size %s, actual %s",
               zip_fzofft(localz->siz, NULL, "u"), zip_fzofft(bytes_this_entry, NULL, "u"));
       zipwarn(errbuf, "");
@@ -9122,4 +10066,387 @@ int trash()
   return ZE_OK;
 }
 
+
+#ifdef INPLACE_UPDATE
+
+/* -- Journal for in-place updates --
+ *
+ * When the archive is updated in place (-g) everything from the start
+ * of the old central directory to the end of the file is going to be
+ * overwritten.  Before that, journal_begin() saves those bytes in
+ * "<archive>-journal":
+ *
+ *   "IZJ1"               signature
+ *   8 bytes              original length of the archive
+ *   8 bytes              offset the saved bytes came from
+ *   8 bytes              number of saved bytes
+ *   4 bytes              CRC-32 of the saved bytes
+ *   4 bytes              (reserved, zero)
+ *   ...                  the saved bytes
+ *
+ * The header is written last and the journal is synced before the
+ * archive is touched, so a journal with a good header can always be
+ * played back.  If zip fails, ziperr() rolls the archive back with
+ * journal_rollback().  If zip is killed, the next run that is going to
+ * write the archive does the same with journal_recover().  Once the
+ * updated archive is safely on disk, journal_commit() removes the
+ * journal.
+ *
+ * A journal is also there while an update is still going on, so the
+ * updating zip holds an exclusive flock() on the archive from
+ * journal_begin() until the journal is gone.  journal_recover() waits
+ * for that lock before playing a journal back, so it only ever rolls
+ * back an update whose zip has died.
+ */
+
+#define JOURNAL_SUFFIX  "-journal"
+#define JOURNAL_SIG     "IZJ1"
+#define JOURNAL_HDR     32
+#define JOURNAL_BUFSZ   0x10000
+
+local char *journal_name = NULL;        /* journal of the current update */
+local char *journal_zip = NULL;         /* archive being updated */
+local FILE *journal_lockf = NULL;       /* archive, open to hold the lock */
+
+local char *journal_path OF((char *));
+local int journal_lock OF((char *, int));
+local void journal_unlock OF((void));
+local void journal_put OF((uch *, uzoff_t, int));
+local uzoff_t journal_get OF((uch *, int));
+local int journal_restore OF((char *, char *, int *));
+
+
+local char *journal_path(zipname)
+  char *zipname;
+/* Return the malloc'd name of the journal for archive zipname. */
+{
+  char *p;
+
+  if ((p = malloc(strlen(zipname) + strlen(JOURNAL_SUFFIX) + 1)) != NULL) {
+    strcpy(p, zipname);
+    strcat(p, JOURNAL_SUFFIX);
+  }
+  return p;
+}
+
+
+local int journal_lock(zipname, wait)
+  char *zipname;        /* archive to lock */
+  int wait;             /* 1 = wait for another zip to let go */
+/* Take an exclusive flock() on archive zipname, held until
+   journal_unlock().  Return an error code in the ZE_ class. */
+{
+  int r;
+
+  if (journal_lockf != NULL)
+    return ZE_OK;
+  if ((journal_lockf = zfopen(zipname, FOPR)) == NULL)
+    return ZE_OPEN;
+  while ((r = flock(fileno(journal_lockf),
+                    wait ? LOCK_EX : LOCK_EX | LOCK_NB)) != 0 &&
+         errno == EINTR)
+    ;
+  if (r != 0) {
+    if (errno == EWOULDBLOCK)
+      zipwarn("archive is being updated by another zip: ", zipname);
+    fclose(journal_lockf);
+    journal_lockf = NULL;
+    return ZE_OPEN;
+  }
+  return ZE_OK;
+}
+
+
+local void journal_unlock()
+/* Let go of the lock taken by journal_lock(). */
+{
+  if (journal_lockf != NULL) {
+    fclose(journal_lockf);
+    journal_lockf = NULL;
+  }
+}
+
+
+local void journal_put(p, v, n)
+  uch *p;
+  uzoff_t v;
+  int n;
+/* Store n bytes of v at p, little-endian. */
+{
+  for (; n; n--, v >>= 8)
+    *p++ = (uch)(v & 0xff);
+}
+
+
+local uzoff_t journal_get(p, n)
+  uch *p;
+  int n;
+/* Return the n byte little-endian value at p. */
+{
+  uzoff_t v = 0;
+
+  while (n--)
+    v = (v << 8) | p[n];
+  return v;
+}
+
+
+int journal_begin(zipname, f, from)
+  char *zipname;        /* name of archive f */
+  FILE *f;              /* archive, open for update */
+  uzoff_t from;         /* offset where the update starts */
+/* Lock archive f, save its bytes from offset from to the end in the
+   journal, and leave f positioned at from.  Return an error code in the
+   ZE_ class. */
+{
+  FILE *j;              /* journal */
+  uch h[JOURNAL_HDR];   /* journal header */
+  uch *b;               /* copy buffer */
+  uzoff_t len;          /* length of archive */
+  uzoff_t n;            /* bytes left to save */
+  extent m;             /* bytes this pass */
+  ulg crc;              /* CRC of saved bytes */
+  int r;                /* result */
+
+  if ((r = journal_lock(zipname, 0)) != ZE_OK)
+    return r;
+  if (zfseeko(f, 0, SEEK_END)) {
+    journal_unlock();
+    return ZE_READ;
+  }
+  len = (uzoff_t)zftello(f);
+  if (len < from) {
+    journal_unlock();
+    return ZE_FORM;
+  }
+  if ((journal_name = journal_path(zipname)) == NULL) {
+    journal_unlock();
+    return ZE_MEM;
+  }
+  if ((b = (uch *)malloc(JOURNAL_BUFSZ)) == NULL) {
+    free(journal_name);
+    journal_name = NULL;
+    journal_unlock();
+    return ZE_MEM;
+  }
+  if ((j = zfopen(journal_name, FOPW)) == NULL) {
+    free((zvoid *)b);
+    free(journal_name);
+    journal_name = NULL;
+    journal_unlock();
+    return ZE_CREAT;
+  }
+
+  /* placeholder header, so a partial journal is never played back */
+  memset(h, 0, JOURNAL_HDR);
+  r = fwrite(h, 1, JOURNAL_HDR, j) == JOURNAL_HDR ? ZE_OK : ZE_WRITE;
+  if (r == ZE_OK && zfseeko(f, from, SEEK_SET))
+    r = ZE_READ;
+  crc = CRCVAL_INITIAL;
+  for (n = len - from; r == ZE_OK && n; n -= m) {
+    m = n > JOURNAL_BUFSZ ? JOURNAL_BUFSZ : (extent)n;
+    if (fread(b, 1, m, f) != m)
+      r = ZE_READ;
+    else if (fwrite(b, 1, m, j) != m)
+      r = ZE_WRITE;
+    else
+      crc = crc32(crc, b, m);
+  }
+  free((zvoid *)b);
+
+  if (r == ZE_OK) {
+    memcpy(h, JOURNAL_SIG, 4);
+    journal_put(h + 4, len, 8);
+    journal_put(h + 12, from, 8);
+    journal_put(h + 20, len - from, 8);
+    journal_put(h + 28, (uzoff_t)crc, 4);
+    if (zfseeko(j, 0, SEEK_SET) || fwrite(h, 1, JOURNAL_HDR, j) != JOURNAL_HDR
+        || fflush(j) || fsync(fileno(j)))
+      r = ZE_WRITE;
+  }
+  if (fclose(j) && r == ZE_OK)
+    r = ZE_WRITE;
+  if (r == ZE_OK && zfseeko(f, from, SEEK_SET))
+    r = ZE_READ;
+  if (r != ZE_OK) {
+    unlink(journal_name);
+    free(journal_name);
+    journal_name = NULL;
+    journal_unlock();
+    return r;
+  }
+  journal_zip = zipname;
+  return ZE_OK;
+}
+
+
+int journal_sync(f)
+  FILE *f;              /* archive updated in place */
+/* Cut the archive off at the current position (an update can make it
+   shorter) and force it to disk, so the journal can go.  Return an error
+   code in the ZE_ class. */
+{
+  if (fflush(f) || ftruncate(fileno(f), (off_t)zftello(f)) ||
+      fsync(fileno(f)))
+    return ZE_WRITE;
+  return ZE_OK;
+}
+
+
+int journal_active()
+/* Return true if an in-place update is in progress. */
+{
+  return journal_name != NULL;
+}
+
+
+void journal_commit()
+/* The update is on disk, remove the journal, then let go of the lock. */
+{
+  if (journal_name != NULL) {
+    unlink(journal_name);
+    free(journal_name);
+    journal_name = NULL;
+    journal_zip = NULL;
+  }
+  journal_unlock();
+}
+
+
+local int journal_restore(jname, zipname, done)
+  char *jname;          /* journal */
+  char *zipname;        /* archive */
+  int *done;            /* set true if the archive was written to */
+/* Play back journal jname to archive zipname and remove the journal.  A
+   journal without a valid header or with bad data was never finished,
+   so the archive was not touched yet and the journal is just removed.
+   Return an error code in the ZE_ class. */
+{
+  FILE *j;              /* journal */
+  FILE *f;              /* archive */
+  uch h[JOURNAL_HDR];   /* journal header */
+  uch *b;               /* copy buffer */
+  uzoff_t len;          /* original length of archive */
+  uzoff_t from;         /* offset of saved bytes */
+  uzoff_t cnt;          /* number of saved bytes */
+  uzoff_t n;            /* bytes left */
+  extent m;             /* bytes this pass */
+  ulg crc;              /* CRC of saved bytes */
+  int r;                /* result */
+
+  *done = 0;
+  if ((j = zfopen(jname, FOPR)) == NULL)
+    return ZE_OK;
+  if ((b = (uch *)malloc(JOURNAL_BUFSZ)) == NULL) {
+    fclose(j);
+    return ZE_MEM;
+  }
+
+  /* check it all before touching the archive */
+  r = ZE_FORM;
+  if (fread(h, 1, JOURNAL_HDR, j) == JOURNAL_HDR &&
+      memcmp(h, JOURNAL_SIG, 4) == 0) {
+    len = journal_get(h + 4, 8);
+    from = journal_get(h + 12, 8);
+    cnt = journal_get(h + 20, 8);
+    if (from + cnt == len) {
+      crc = CRCVAL_INITIAL;
+      for (n = cnt; n; n -= m) {
+        m = n > JOURNAL_BUFSZ ? JOURNAL_BUFSZ : (extent)n;
+        if (fread(b, 1, m, j) != m)
+          break;
+        crc = crc32(crc, b, m);
+      }
+      if (n == 0 && (uzoff_t)crc == journal_get(h + 28, 4))
+        r = ZE_OK;
+    }
+  }
+  if (r != ZE_OK) {
+    free((zvoid *)b);
+    fclose(j);
+    unlink(jname);
+    return ZE_OK;
+  }
+
+  if ((f = zfopen(zipname, FOPM)) == NULL) {
+    free((zvoid *)b);
+    fclose(j);
+    return ZE_OPEN;
+  }
+  *done = 1;
+  if (zfseeko(j, JOURNAL_HDR, SEEK_SET) || zfseeko(f, from, SEEK_SET))
+    r = ZE_READ;
+  for (n = cnt; r == ZE_OK && n; n -= m) {
+    m = n > JOURNAL_BUFSZ ? JOURNAL_BUFSZ : (extent)n;
+    if (fread(b, 1, m, j) != m)
+      r = ZE_READ;
+    else if (fwrite(b, 1, m, f) != m)
+      r = ZE_WRITE;
+  }
+  free((zvoid *)b);
+  fclose(j);
+  if (r == ZE_OK &&
+      (fflush(f) || ftruncate(fileno(f), (off_t)len) || fsync(fileno(f))))
+    r = ZE_WRITE;
+  if (fclose(f) && r == ZE_OK)
+    r = ZE_WRITE;
+  /* keep the journal if the archive could not be restored */
+  if (r == ZE_OK)
+    unlink(jname);
+  return r;
+}
+
+
+int journal_rollback()
+/* Undo the in-place update in progress from its journal.  The archive
+   must be closed.  Return an error code in the ZE_ class. */
+{
+  int done;             /* archive written */
+  int r;                /* result */
+
+  if (journal_name == NULL)
+    return ZE_OK;
+  if ((r = journal_restore(journal_name, journal_zip, &done)) == ZE_OK) {
+    free(journal_name);
+    journal_name = NULL;
+    journal_zip = NULL;
+    journal_unlock();
+  }
+  return r;
+}
+
+
+int journal_recover(zipname)
+  char *zipname;        /* archive about to be read and then written */
+/* If an earlier in-place update of zipname was interrupted, roll it back
+   before the archive is read.  A zip still updating the archive holds
+   the lock, so wait for it first; by then its journal is normally gone.
+   Return an error code in the ZE_ class. */
+{
+  char *p;              /* journal name */
+  z_stat s;             /* to see if there is a journal */
+  int done;             /* archive written */
+  int r;                /* result */
+
+  if ((p = journal_path(zipname)) == NULL)
+    return ZE_MEM;
+  if (zstat(p, &s) != 0 || journal_lock(zipname, 1) != ZE_OK) {
+    /* no journal, or no archive to roll back */
+    free(p);
+    return ZE_OK;
+  }
+  r = journal_restore(p, zipname, &done);
+  journal_unlock();
+  if (done) {
+    if (r == ZE_OK)
+      zipwarn("rolled back interrupted update of ", zipname);
+    else
+      zipwarn("could not roll back interrupted update, journal kept: ", p);
+  }
+  free(p);
+  return r;
+}
+
+#endif /* INPLACE_UPDATE */
+
 #endif /* !UTIL */
@@ -846,7 +846,7 @@ char **argv;                  /* command line tokens */
     if ((a = zgetline(abf, WRBUFSIZ+1)) != NULL && a[0] == MARK && a[1] == '=')
     {
       if (z->name != z->iname)
-        free((zvoid *)z->iname);
+        name_free((zvoid *)z->iname);
 #ifdef UNICODE_SUPPORT
       utf8 = is_utf8_string(a, NULL, NULL, NULL, NULL);
       if (utf8) {
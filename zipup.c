@@ -54,6 +54,14 @@
 #  include "os2/os2zip.h"
 #endif
 
+#ifdef IZ_MAPIN
+#  include <sys/mman.h>
+#  include <signal.h>
+#  if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#    define MAP_ANONYMOUS MAP_ANON
+#  endif
+#endif
+
 #if defined(MMAP)
 #  include <sys/mman.h>
 #  ifndef PAGESIZE   /* used to be SYSV, what about pagesize on SVR3 ? */
@@ -150,6 +158,12 @@
 
 /* Local functions */
 local unsigned iz_file_read OF((char *buf, unsigned size));
+#ifdef IZ_MAPIN
+  local void in_map_open OF((zoff_t len));
+  local void in_map_close OF((void));
+  local void in_map_bus OF((int sig, siginfo_t *info, void *ctx));
+  local unsigned iz_file_map OF((char **pbuf, unsigned size));
+#endif
 #ifdef USE_ZLIB
   local int zl_deflate_init OF((int pack_level));
 #else /* !USE_ZLIB */
@@ -231,6 +245,10 @@ static ISzAlloc g_Alloc = { SzAlloc, SzFree };
 
   unsigned (*read_buf) OF((char *buf, unsigned size)) = iz_file_read;
   /* Current input function. Set to mem_read for in-memory compression */
+# ifdef IZ_SPARSE
+  int read_buf_zeros = 0;
+  /* Set by iz_file_read() when what it read is zeros from a hole */
+# endif
 #endif /* !USE_ZLIB */
 
 
@@ -243,6 +261,15 @@ local ftype ifile;              /* file to compress */
    *  special value "(ulg)-1L" reserved to signal normal reads.
    */
 #endif /* MMAP || BIG_MEM */
+#ifdef IZ_MAPIN
+  local uch *in_map = NULL;     /* input file mapped by in_map_open() */
+  local size_t in_map_len;      /* size of the mapping */
+  local size_t in_map_pos;      /* mapped bytes already passed on */
+  local size_t in_map_page;     /* page size, for in_map_bus() */
+  local struct sigaction in_map_old_bus;  /* SIGBUS action before ours */
+  local volatile sig_atomic_t in_map_lost = 0; /* file shrank while mapped */
+  local int in_map_redo = 0;    /* entry being redone with read() */
+#endif /* IZ_MAPIN */
 
 /* Show-what-doing compression level message storage. */
 local char l_str[ 4];
@@ -588,6 +615,9 @@ int l;                  /* True if this file is a symbolic link. */
      */
     if (zrewind( ifile) < 0)
       return ZE_READ;
+#ifdef IZ_MAPIN
+    in_map_pos = 0;
+#endif
 
     /* Allocate a read buffer.  (Might be smarter to do this less often.) */
     if ((b = malloc(SBSZ)) == NULL)
@@ -603,6 +633,9 @@ int l;                  /* True if this file is a symbolic link. */
     {
       if (zrewind( ifile) < 0)
         sts = ZE_READ;
+#ifdef IZ_MAPIN
+      in_map_pos = 0;
+#endif
     }
   }
 
@@ -742,6 +775,11 @@ struct zlist far *z;    /* zip entry to compress */
      This just forces file_binary = 1 at first read when restart
      compression/store. */
   restart_as_binary = 0;
+#ifdef IZ_MAPIN
+  /* Set when a mapped file was truncated and the entry is being zipped
+     again with read(), see in_map_bus(). */
+  in_map_redo = 0;
+#endif
 
   /* local variable may be updated later */
   z->encrypt_method = encryption_method;
@@ -754,12 +792,12 @@ struct zlist far *z;    /* zip entry to compress */
 
   /* used for progress tracking */
   bytes_read_this_entry = 0;
-  entry_name = z->oname;
+  entry_name = ZONAME(z);
 #ifdef UNICODE_SUPPORT
   if (z->uname)
     unicode_entry_name = z->uname;
   else
-    unicode_entry_name = z->oname;
+    unicode_entry_name = ZONAME(z);
 #else
   unicode_entry_name = NULL;
 #endif
@@ -885,7 +923,7 @@ struct zlist far *z;    /* zip entry to compress */
         /* dup the string, adding 1 char (byte) of fluff at end for adding / */
         new_iname = string_dup(z->iname, "new_iname (zipup)", ADD_FLUFF(1));
         strcat(new_iname, "/");
-        free(z->iname);
+        name_free(z->iname);
         z->iname = new_iname;
       }
     }
@@ -1189,16 +1227,24 @@ if (l) {
      be "binary", we reset some things and jump back here to reprocess
      the file as binary.  Output must be seekable (!use_data_descriptor) and
      output can't be split archive.  Restarting when output is split is
-     more work, but may be added soon. */
+     more work, but may be added soon.  A mapped file that is truncated
+     while being zipped is redone from here the same way, with read(). */
   saved_bytes_this_split = bytes_this_split;
   saved_tempzn = tempzn;
 
 Restart_As_Binary:
 
+# ifdef IZ_MAPIN
+  if (restart_as_binary || in_map_redo) {
+# else
   if (restart_as_binary) {
+# endif
 # if defined(MMAP) || defined(BIG_MEM)
     remain = (ulg)-1L; /* changed only for MMAP or BIG_MEM */
 # endif /* MMAP || BIG_MEM */
+# ifdef IZ_MAPIN
+    in_map_close();
+# endif
 # if (!defined(USE_ZLIB) || defined(MMAP) || defined(BIG_MEM))
     window_size = 0L;
 # endif /* !USE_ZLIB || MMAP || BIG_MEM */
@@ -1218,7 +1264,11 @@ Restart_As_Binary:
   else
   { /* !z->is_stdin */
 #if !(defined(VMS) && defined(VMS_PK_EXTRA))
+#ifdef IZ_MAPIN
+    if (extra_fields && !restart_as_binary && !in_map_redo) {
+#else
     if (extra_fields && !restart_as_binary) {
+#endif
       /* create select extra fields and change z->att and z->atx if desired */
       /* On WinNT this is where security is handled. */
       /* if we're restarting as binary, already did this */
@@ -1400,6 +1450,10 @@ Restart_As_Binary:
 # endif /* ?MMAP */
     }
 #endif /* MMAP || BIG_MEM */
+#ifdef IZ_MAPIN
+    /* Map ordinary files for all methods, see iz_file_map() */
+    in_map_open(q);
+#endif /* IZ_MAPIN */
 
   } /* !z->is_stdin */
 
@@ -2060,7 +2114,7 @@ Restart_As_Binary:
         sprintf(errbuf, " (%s)", z->uname);
       else
 # endif
-        sprintf(errbuf, " (%s)", z->oname);
+        sprintf(errbuf, " (%s)", ZONAME(z));
 
       if (file_binary)
       {
@@ -2148,10 +2202,32 @@ Restart_As_Binary:
     else
 #endif
     {
+      char *sb = b;     /* data to store, b or the mapped input file */
 
+#ifdef IZ_MAPIN
+      /* Store straight from the mapping, unless zfwrite() is to encrypt
+       * the data in place.
+       */
+      while ((k = (in_map != NULL && key == NULL) ? iz_file_map(&sb, SBSZ)
+                                                  : iz_file_read(b, SBSZ)) > 0
+             && k != (extent) EOF)
+#else
       while ((k = iz_file_read(b, SBSZ)) > 0 && k != (extent) EOF)
+#endif
       {
-        if (zfwrite(b, 1, k) != k)
+#if defined(IZ_MAPIN) && defined(IZ_COPY_RANGE)
+        /* The crc was taken from the mapping, so let the kernel move the
+         * data (zfcopy_fd() does nothing for split or encrypted output),
+         * and write only what it did not.
+         */
+        extent kc = 0;
+
+        if (sb != b)
+          kc = (extent)zfcopy_fd(ifile, (zoff_t)(sb - (char *)in_map), k);
+        if (kc < k && zfwrite(sb + kc, 1, k - kc) != k - kc)
+#else
+        if (zfwrite(sb, 1, k) != k)
+#endif
         {
           if (ifile != fbad)
             zclose(ifile);
@@ -2164,7 +2240,11 @@ Restart_As_Binary:
         /* Display progress dots. */
         if (!display_globaldots)
         {
+#ifdef IZ_MAPIN
+          display_dot(0, (sb == b) ? SBSZ : MAPIN_CHUNK);
+#else
           display_dot(0, SBSZ);
+#endif
         }
       }
 
@@ -2231,7 +2311,7 @@ Restart_As_Binary:
 
     if (z->att == (ush)FT_BINARY && TRANSLATE_EOL)
     {
-      sprintf(errbuf, " (%s)", z->oname);
+      sprintf(errbuf, " (%s)", ZONAME(z));
       if (file_binary)
       {
         /* initial binary decision correct */
@@ -2297,10 +2377,36 @@ Restart_As_Binary:
     zperror("\nzip warning");
     if (logfile)
       zfprintf(logfile, "\nzip warning: %s\n", strerror(errno));
-    zipwarn("could not read input file: ", z->oname);
+    zipwarn("could not read input file: ", ZONAME(z));
   }
   if (ifile != fbad)
     zclose(ifile);
+#ifdef IZ_MAPIN
+  in_map_close();
+# ifdef ALLOW_TEXT_BIN_RESTART
+  if (in_map_lost) {
+    /* The file was truncated while mapped and the entry has zeros where
+       the lost data was.  in_map_open() only maps when the output is
+       seekable and not split, so seek back and zip the file again with
+       read(), which sees the short file and warns as usual. */
+    in_map_lost = 0;
+    if (zfseeko(y, z->off, SEEK_SET) != 0) {
+      zipwarn(" file truncated while zipping, rest stored as zeros: ",
+              z->name);
+    }
+    else {
+      bytes_this_split = saved_bytes_this_split;
+      bytes_this_entry = 0;
+      bytes_read_this_entry = 0;
+      tempzn = saved_tempzn;
+      in_map_redo = 1;
+      file_binary = -1;
+
+      goto Restart_As_Binary;
+    }
+  }
+# endif /* ALLOW_TEXT_BIN_RESTART */
+#endif /* IZ_MAPIN */
 #ifdef MMAP
   if (remain != (ulg)-1L) {
     munmap((caddr_t) window, window_size);
@@ -2665,7 +2771,7 @@ zfprintf( stderr, " Done.          crc = %08x .\n", crc);
     char *oname;
     char *uname;
 
-    oname = z->oname;
+    oname = ZONAME(z);
 #ifdef UNICODE_SUPPORT
     uname = z->uname;
 #else
@@ -2691,7 +2797,7 @@ zfprintf( stderr, " Done.          crc = %08x .\n", crc);
     char *oname;
     char *uname;
 
-    oname = z->oname;
+    oname = ZONAME(z);
 #   ifdef UNICODE_SUPPORT
     uname = z->uname;
 #   else
@@ -2779,6 +2885,184 @@ zfprintf( stderr, " Done.          crc = %08x .\n", crc);
 }
 
 
+#ifdef DISPATCH_LF_TO_CRLF
+#include <emmintrin.h>
+
+unsigned (*lf_to_crlf_kernel) OF((char *dst, ZCONST char *src,
+                                  unsigned size)) = lf_to_crlf_c;
+
+/* Copy size (> 0) bytes from src to dst, turning each LF into CR LF,
+ * and return the number of bytes stored.  As used by iz_file_read()
+ * for -l, src is the upper half of the buffer and dst its start, so
+ * dst may run into src, but never past the next byte still to be read.
+ */
+unsigned lf_to_crlf_c(dst, src, size)
+  char *dst;
+  ZCONST char *src;
+  unsigned size;
+{
+  char *d = dst;
+
+  do {
+    if ((*d++ = *src++) == '\n') *(d-1) = CR_IZ, *d++ = LF;
+  } while (--size != 0);
+  return (unsigned)(d - dst);
+}
+
+/* SSE2 version of lf_to_crlf_c().  A 16-byte block without LF (most of
+ * them, in typical text) is stored in one move.  Each block is loaded
+ * before anything is stored for it, and its output (at most 32 bytes)
+ * ends before the next unread block, so the overlap above is safe.
+ */
+IZ_TARGET("sse2")
+unsigned lf_to_crlf_sse2(dst, src, size)
+  char *dst;
+  ZCONST char *src;
+  unsigned size;
+{
+  char *d = dst;
+  ZCONST char *end = src + size;
+  __m128i lf = _mm_set1_epi8('\n');
+  __m128i v;
+  int j;
+
+  while (end - src >= 16) {
+    v = _mm_loadu_si128((ZCONST __m128i *)src);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf)) == 0) {
+      _mm_storeu_si128((__m128i *)d, v);
+      d += 16;
+    } else {
+      for (j = 0; j < 16; j++) {
+        if ((*d++ = src[j]) == '\n') *(d-1) = CR_IZ, *d++ = LF;
+      }
+    }
+    src += 16;
+  }
+  while (src < end) {
+    if ((*d++ = *src++) == '\n') *(d-1) = CR_IZ, *d++ = LF;
+  }
+  return (unsigned)(d - dst);
+}
+#endif /* DISPATCH_LF_TO_CRLF */
+
+
+#ifdef IZ_MAPIN
+local void in_map_open(len)
+  zoff_t len;                   /* file size, from filetime() */
+/* Map the current input file, if it is a regular file of a size worth
+ * mapping and nothing needs the read() path (-l/-ll translation, -nc,
+ * -ra).  Otherwise in_map stays NULL and the file is read as before.
+ * Pipes, FIFOs and devices fail the S_ISREG test.
+ *
+ * A file truncated while mapped can't be read past its new end, so
+ * the entry must then be redone with read() (see in_map_bus()).  That
+ * needs the same seekable, unsplit output as the text/binary restart,
+ * so split archives and streamed output are always read.
+ */
+{
+  struct stat s;
+  uch *p;
+
+  in_map_close();
+  if (TRANSLATE_EOL || ifile == fbad || nocache || read_ahead)
+    return;
+# ifdef ALLOW_TEXT_BIN_RESTART
+  if (in_map_redo || split_method != 0 || use_data_descriptor)
+    return;
+# else
+  return;
+# endif
+  if (len < (zoff_t)MAPIN_MIN || (uzoff_t)len > (uzoff_t)MAPIN_MAX ||
+      (zoff_t)(size_t)len != len)
+    return;
+  if (fstat(ifile, &s) != 0 || !S_ISREG(s.st_mode) ||
+      (zoff_t)s.st_size != len)
+    return;
+# ifdef IZ_SPARSE
+  if (ufile_sparse(ifile))
+    return;                     /* holes are cheaper read, see sp_read() */
+# endif
+  p = (uch *)mmap(NULL, (size_t)len, PROT_READ, MAP_PRIVATE, ifile, 0);
+  if (p == (uch *)MAP_FAILED) {
+    Trace((mesg, " mmap failure, reading instead\n"));
+    return;
+  }
+  if (in_map_page == 0) {
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = in_map_bus;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGBUS, &sa, &in_map_old_bus) != 0) {
+      munmap((void *)p, (size_t)len);
+      return;
+    }
+    in_map_page = (size_t)sysconf(_SC_PAGESIZE);
+  }
+# ifndef NO_MADVISE
+  madvise((void *)p, (size_t)len, MADV_SEQUENTIAL);
+# endif
+  in_map = p;
+  in_map_len = (size_t)len;
+  in_map_pos = 0;
+  in_map_lost = 0;
+}
+
+
+local void in_map_bus(sig, info, ctx)
+  int sig;
+  siginfo_t *info;
+  void *ctx;
+/* SIGBUS handler, installed by the first in_map_open().  Touching a
+ * mapped page past the end of a file that shrank raises SIGBUS.  Put
+ * zero pages over the rest of the mapping so the compressor can finish,
+ * and set in_map_lost so zipup() redoes the entry.  Anything else goes
+ * to the previous action (zip's handler()).
+ */
+{
+  uch *a = (uch *)info->si_addr;
+
+  if (in_map != NULL && a >= in_map && a < in_map + in_map_len) {
+    a = in_map + ((size_t)(a - in_map) & ~(in_map_page - 1));
+    if (mmap((void *)a, (size_t)(in_map + in_map_len - a), PROT_READ,
+             MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0) != MAP_FAILED) {
+      in_map_lost = 1;
+      return;
+    }
+  }
+  sigaction(SIGBUS, &in_map_old_bus, NULL);
+  raise(sig);
+}
+
+
+local void in_map_close()
+{
+  if (in_map != NULL) {
+    munmap((void *)in_map, in_map_len);
+    in_map = NULL;
+  }
+}
+
+
+local unsigned iz_file_map(pbuf, size)
+  char **pbuf;
+  unsigned size;
+/* Like iz_file_read(), but when the input file is mapped, set *pbuf to
+ * the data in the mapping instead of copying it, and pass on up to
+ * MAPIN_CHUNK bytes, however small size is.  Otherwise read into *pbuf.
+ * The crc, size and text checks are iz_file_read()'s either way.
+ * The data must not be changed in place.
+ */
+{
+  if (in_map != NULL) {
+    *pbuf = (char *)in_map + in_map_pos;
+    if (size < MAPIN_CHUNK)
+      size = MAPIN_CHUNK;
+  }
+  return iz_file_read(*pbuf, size);
+}
+#endif /* IZ_MAPIN */
 
 
 local unsigned iz_file_read(buf, size)
@@ -2802,6 +3086,9 @@ local unsigned iz_file_read(buf, size)
   unsigned len = 0;
   char *b;
   uzoff_t isize_prev;           /* Previous isize.  Used for overflow check. */
+#if defined(IZ_SPARSE) && !defined(USE_ZLIB)
+  int zeros = 0;                /* buf is zeros from a hole in the file */
+#endif
   static int char_was_saved = 0;/* 1= a character was saved from last buf. */
   static char saved_char = 0;   /* Character that was saved. */
   static int eof_reached = 0;
@@ -2842,7 +3129,21 @@ local unsigned iz_file_read(buf, size)
 #endif /* MMAP || BIG_MEM */
 
   if (TRANSLATE_EOL == 0) {
+#ifdef IZ_MAPIN
+    if (in_map != NULL) {
+      /* Data at the current map position (from iz_file_map()) is used
+       * in place.  Any other buffer gets a copy.
+       */
+      len = (unsigned)IZ_MIN((size_t)size, in_map_len - in_map_pos);
+      if (len > 0 && buf != (char *)in_map + in_map_pos)
+        memcpy(buf, in_map + in_map_pos, len);
+      in_map_pos += len;
+    } else
+#endif /* IZ_MAPIN */
     len = zread(ifile, buf, size);
+#if defined(IZ_SPARSE) && !defined(USE_ZLIB)
+    zeros = ufile_zeros(ifile);
+#endif
 
     if (len == (unsigned)EOF || len == 0) {
       if (file_binary < 0 && len == 0) {
@@ -2914,8 +3215,6 @@ local unsigned iz_file_read(buf, size)
      */
     if (aflag == FT_ASCII_TXT)
     {
-      unsigned i;
-
       /* This was already done above. */
 #if 0
       /* Check buf for binary (once, at the first read operation). */
@@ -2931,10 +3230,7 @@ local unsigned iz_file_read(buf, size)
          if output is seekable.  If not, file is hosed. */
       if (file_binary == 0)
       {
-        for (i = 0; i < len; i++)
-        {
-          buf[i] = (char)ascii[ (uch)buf[i] ];
-        }
+        memtoasc(buf, buf, len);
       }
     }
 
@@ -3000,9 +3296,14 @@ local unsigned iz_file_read(buf, size)
       else
 #endif /* EBCDIC */
       {
+#ifdef DISPATCH_LF_TO_CRLF
+         len = (*lf_to_crlf_kernel)(buf, b, size);
+         buf += len;
+#else
          do {
             if ((*buf++ = *b++) == '\n') *(buf-1) = CR_IZ, *buf++ = LF, len++;
          } while (--size != 0);
+#endif
       }
       buf -= len;
     } else { /* do not translate binary */
@@ -3199,6 +3500,12 @@ local unsigned iz_file_read(buf, size)
     }
   } /* translate_eol == 2 */
 
+#if defined(IZ_SPARSE) && !defined(USE_ZLIB)
+  if (zeros) {
+    read_buf_zeros = 1;
+    crc = crc32_zeros(crc, (uzoff_t)len);
+  } else
+#endif
   crc = crc32(crc, (uch *) buf, len);
   /* 2005-05-23 SMS.
      Increment file size.  A small-file program reading a large file may
@@ -3465,6 +3772,9 @@ local zoff_t filecompress(z_entry, cmpr_method)
     unsigned mrk_cnt = 1;
     int maybe_stored = FALSE;
     ulg cmpr_size;
+# ifdef IZ_MAPIN
+    char *mp;
+# endif
 # if defined(MMAP) || defined(BIG_MEM)
     unsigned ibuf_sz = (unsigned)SBSZ;
 # else
@@ -3509,16 +3819,26 @@ local zoff_t filecompress(z_entry, cmpr_method)
     {
         zstrm.next_in = (Bytef *)f_ibuf;
     }
-    zstrm.avail_in = iz_file_read((char *)zstrm.next_in, ibuf_sz);
-
-    if (zstrm.avail_in < ibuf_sz) {
-        unsigned more = iz_file_read((char *)(zstrm.next_in + zstrm.avail_in),
-                                  (ibuf_sz - zstrm.avail_in));
-        if (more == (unsigned)EOF || more == 0) {
-            maybe_stored = TRUE;
-        } else {
-            zstrm.avail_in += more;
-        }
+# ifdef IZ_MAPIN
+    if (in_map != NULL) {
+        /* Deflate straight from the mapping.  A mapped file is larger
+           than SBSZ, so it never fits the buffer and is never stored. */
+        zstrm.avail_in = iz_file_map(&mp, ibuf_sz);
+        zstrm.next_in = (Bytef *)mp;
+    } else
+# endif /* IZ_MAPIN */
+    {
+      zstrm.avail_in = iz_file_read((char *)zstrm.next_in, ibuf_sz);
+
+      if (zstrm.avail_in < ibuf_sz) {
+          unsigned more = iz_file_read((char *)(zstrm.next_in + zstrm.avail_in),
+                                    (ibuf_sz - zstrm.avail_in));
+          if (more == (unsigned)EOF || more == 0) {
+              maybe_stored = TRUE;
+          } else {
+              zstrm.avail_in += more;
+          }
+      }
     }
     bytes_so_far += zstrm.avail_in;
     zstrm.next_out = (Bytef *)f_obuf;
@@ -3552,13 +3872,21 @@ local zoff_t filecompress(z_entry, cmpr_method)
                       display_dot( 1, WSIZE);
                     }
                 }
+# ifdef IZ_MAPIN
+            if (in_map != NULL) {
+                zstrm.avail_in = iz_file_map(&mp, ibuf_sz);
+                zstrm.next_in = (Bytef *)mp;
+            } else
+# endif /* IZ_MAPIN */
+            {
 # if defined(MMAP) || defined(BIG_MEM)
-            if (remain == (ulg)-1L)
-                zstrm.next_in = (Bytef *)f_ibuf;
+              if (remain == (ulg)-1L)
+                  zstrm.next_in = (Bytef *)f_ibuf;
 # else
-            zstrm.next_in = (Bytef *)f_ibuf;
+              zstrm.next_in = (Bytef *)f_ibuf;
 # endif
-            zstrm.avail_in = iz_file_read((char *)zstrm.next_in, ibuf_sz);
+              zstrm.avail_in = iz_file_read((char *)zstrm.next_in, ibuf_sz);
+            }
             bytes_so_far += zstrm.avail_in;
         }
     }
@@ -3764,6 +4092,9 @@ int *cmpr_method;
     unsigned mrk_cnt = 1;
     int maybe_stored = FALSE;
     zoff_t cmpr_size;
+# ifdef IZ_MAPIN
+    char *mp;
+# endif
 # if defined(MMAP) || defined(BIG_MEM)
     unsigned ibuf_sz = (unsigned)SBSZ;
 # else
@@ -3806,22 +4137,32 @@ int *cmpr_method;
 
     /* This is the first buffer read.  file_binary will be set based
        on the contents of this buffer. */
-    bstrm.avail_in = iz_file_read(bstrm.next_in, ibuf_sz);
-
-    if (bstrm.avail_in < ibuf_sz) {
-        /* Should this be iz_file_read_bt(), too? */
-        /* If less than a buffer was available, read more.  As this may
-           impact initial binary/text decision after first buffer was
-           read by iz_file_read() above, iz_file_read_bt() is used.
-           So if file_binary was set to text, this will change it to
-           binary if any binary is found in the additional read. */
-        unsigned more = iz_file_read_bt(bstrm.next_in + bstrm.avail_in,
-                                  (ibuf_sz - bstrm.avail_in));
-        if ((more == (unsigned) EOF || more == 0) && !use_data_descriptor) {
-            maybe_stored = TRUE;
-        } else {
-            bstrm.avail_in += more;
-        }
+# ifdef IZ_MAPIN
+    if (in_map != NULL) {
+        /* Compress straight from the mapping.  A mapped file is larger
+           than SBSZ, so it is never stored. */
+        bstrm.avail_in = iz_file_map(&mp, ibuf_sz);
+        bstrm.next_in = mp;
+    } else
+# endif /* IZ_MAPIN */
+    {
+      bstrm.avail_in = iz_file_read(bstrm.next_in, ibuf_sz);
+
+      if (bstrm.avail_in < ibuf_sz) {
+          /* Should this be iz_file_read_bt(), too? */
+          /* If less than a buffer was available, read more.  As this may
+             impact initial binary/text decision after first buffer was
+             read by iz_file_read() above, iz_file_read_bt() is used.
+             So if file_binary was set to text, this will change it to
+             binary if any binary is found in the additional read. */
+          unsigned more = iz_file_read_bt(bstrm.next_in + bstrm.avail_in,
+                                    (ibuf_sz - bstrm.avail_in));
+          if ((more == (unsigned) EOF || more == 0) && !use_data_descriptor) {
+              maybe_stored = TRUE;
+          } else {
+              bstrm.avail_in += more;
+          }
+      }
     }
     bytes_so_far += bstrm.avail_in;
 
@@ -3863,20 +4204,27 @@ int *cmpr_method;
                       display_dot(1, WSIZE);
                     }
                 }
-# if defined(MMAP) || defined(BIG_MEM)
-            if (remain == (ulg)-1L)
-                bstrm.next_in = (char *)f_ibuf;
-# else
-            bstrm.next_in = (char *)f_ibuf;
-# endif
-
             /* At this point we're running through buffers and doing the
                compressing.  file_binary should have already been set
                above.  For all compression methods we typically set
                file_binary using the first buffer or two.  We now also
                check all buffers read by iz_file_read() and keep
                file_binary_final current. */
-            bstrm.avail_in = iz_file_read(bstrm.next_in, ibuf_sz);
+# ifdef IZ_MAPIN
+            if (in_map != NULL) {
+                bstrm.avail_in = iz_file_map(&mp, ibuf_sz);
+                bstrm.next_in = mp;
+            } else
+# endif /* IZ_MAPIN */
+            {
+# if defined(MMAP) || defined(BIG_MEM)
+              if (remain == (ulg)-1L)
+                  bstrm.next_in = (char *)f_ibuf;
+# else
+              bstrm.next_in = (char *)f_ibuf;
+# endif
+              bstrm.avail_in = iz_file_read(bstrm.next_in, ibuf_sz);
+            }
             bytes_so_far += bstrm.avail_in;
         }
       }